@@ -0,0 +1,83 @@
+/* Run the same Lox programs on the stack and on the register backend and
+ * report the number of instructions executed and the run time of each.
+ *
+ * Usage: bench_backends [script.lox ...]
+ * Without arguments the scripts in bench/lox are run.
+ */
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char* defaultScripts[] = {
+  BENCH_LOX_DIR "/fib.lox",
+  BENCH_LOX_DIR "/loop.lox",
+  BENCH_LOX_DIR "/strings.lox",
+};
+
+/*---------------------------------------------------------------------------*/
+
+static char* readFile(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if ( file == NULL ) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    exit(74);
+  }
+
+  fseek(file, 0L, SEEK_END);
+  size_t fileSize = (size_t)ftell(file);
+  rewind(file);
+
+  char* buffer = malloc(fileSize + 1);
+  size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+  buffer[bytesRead] = '\0';
+
+  fclose(file);
+  return buffer;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void run(const char* path, const char* source, Backend backend)
+{
+  initVM();
+  vm.backend = backend;
+
+  clock_t start = clock();
+  InterpretResult result = interpret(source);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  const char* name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+
+  fprintf(stderr, "%-16s %-9s %14llu %9.3f%s\n", name,
+          backend == BACKEND_REGISTER ? "register" : "stack",
+          (unsigned long long)vm.instructionCount, seconds,
+          result == INTERPRET_OK ? "" : "  (failed)");
+
+  freeVM();
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, const char* argv[])
+{
+  int count = argc > 1 ? argc - 1 : (int)(sizeof(defaultScripts) /
+                                          sizeof(defaultScripts[0]));
+  const char** scripts = argc > 1 ? argv + 1 : defaultScripts;
+
+  fprintf(stderr, "%-16s %-9s %14s %9s\n", "script", "backend",
+          "instructions", "seconds");
+
+  for ( int i = 0; i < count; i++ ) {
+    char* source = readFile(scripts[i]);
+    run(scripts[i], source, BACKEND_STACK);
+    run(scripts[i], source, BACKEND_REGISTER);
+    free(source);
+  }
+
+  return 0;
+}
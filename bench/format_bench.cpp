@@ -0,0 +1,108 @@
+/* Time how long lox::toString() takes to format numbers, against formatting
+ * them with a std::ostringstream each like it used to, and check that both
+ * give the same text.
+ *
+ * Usage: bench_format [count-of-numbers]
+ * Ten million numbers are formatted by default.
+ */
+#include "token.hpp"
+#include "types.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+/*---------------------------------------------------------------------------*/
+
+std::string streamed(double value)
+{
+  std::ostringstream os;
+  os << value;
+  return os.str();
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Whole numbers, fractions, and values printed in exponent form
+double nthNumber(size_t i)
+{
+  switch ( i % 4 ) {
+    case 0:
+      return static_cast<double>(i);
+    case 1:
+      return static_cast<double>(i) / 7.0;
+    case 2:
+      return -static_cast<double>(i) * 1e9;
+    default:
+      return 1.0 / static_cast<double>(i + 1);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+template <typename Format>
+double timeFormatting(size_t count, Format format)
+{
+  size_t length = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for ( size_t i = 0; i < count; ++i ) {
+    length += format(nthNumber(i)).size();
+  }
+  const std::chrono::duration<double> seconds =
+    std::chrono::steady_clock::now() - start;
+
+  // Keep the formatting from being optimized away
+  if ( length == 0 ) std::cerr << "nothing formatted\n";
+  return seconds.count();
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, const char* argv[])
+{
+  const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                : 10'000'000;
+
+  std::vector<double> special{ 0.0,
+                               -0.0,
+                               0.1 + 0.2,
+                               1e21,
+                               123456.0,
+                               1234567.0,
+                               1e-5,
+                               std::numeric_limits<double>::max(),
+                               std::numeric_limits<double>::denorm_min(),
+                               std::numeric_limits<double>::infinity(),
+                               -std::numeric_limits<double>::infinity(),
+                               std::nan("") };
+  for ( size_t i = 0; i < 100'000; ++i ) {
+    special.push_back(nthNumber(i));
+  }
+
+  size_t mismatches = 0;
+  for ( const auto value : special ) {
+    const auto text = lox::toString(value);
+    if ( text != streamed(value) ) {
+      std::cerr << std::format(
+        "mismatch: {} instead of {}\n", text, streamed(value));
+      ++mismatches;
+    }
+  }
+
+  const auto toChars = timeFormatting(
+    count, [](double value) { return lox::toString(value); });
+  const auto stream = timeFormatting(count, streamed);
+
+  std::cerr << std::format(
+    "{} numbers: lox::toString {:.3f}s, std::ostringstream {:.3f}s\n",
+    count,
+    toChars,
+    stream);
+
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
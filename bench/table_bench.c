@@ -0,0 +1,218 @@
+/* Insert/lookup throughput of the open addressing Table against a naive
+ * separately chained hash table using the same interned string keys.
+ *
+ * Usage: bench_table [number-of-keys]
+ */
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUP_ROUNDS 10
+
+/*---------------------------------------------------------------------------*/
+
+// One heap node per entry, buckets picked with a modulo: what a first cut of
+// a hash table usually looks like.
+typedef struct Node
+{
+  ObjString* key;
+  Value value;
+  struct Node* next;
+} Node;
+
+typedef struct
+{
+  int size;
+  int capacity;
+  Node** buckets;
+} ChainedTable;
+
+/*---------------------------------------------------------------------------*/
+
+static void initChained(ChainedTable* table)
+{
+  table->size = 0;
+  table->capacity = 8;
+  table->buckets = calloc((size_t)table->capacity, sizeof(Node*));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void freeChained(ChainedTable* table)
+{
+  for ( int i = 0; i < table->capacity; i++ ) {
+    Node* node = table->buckets[i];
+    while ( node != NULL ) {
+      Node* next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(table->buckets);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void growChained(ChainedTable* table)
+{
+  int capacity = table->capacity * 2;
+  Node** buckets = calloc((size_t)capacity, sizeof(Node*));
+  for ( int i = 0; i < table->capacity; i++ ) {
+    Node* node = table->buckets[i];
+    while ( node != NULL ) {
+      Node* next = node->next;
+      uint32_t index = node->key->hash % (uint32_t)capacity;
+      node->next = buckets[index];
+      buckets[index] = node;
+      node = next;
+    }
+  }
+  free(table->buckets);
+  table->buckets = buckets;
+  table->capacity = capacity;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void chainedSet(ChainedTable* table, ObjString* key, Value value)
+{
+  uint32_t index = key->hash % (uint32_t)table->capacity;
+  for ( Node* node = table->buckets[index]; node != NULL; node = node->next ) {
+    if ( node->key == key ) {
+      node->value = value;
+      return;
+    }
+  }
+
+  if ( table->size + 1 > table->capacity ) {
+    growChained(table);
+    index = key->hash % (uint32_t)table->capacity;
+  }
+
+  Node* node = malloc(sizeof(Node));
+  node->key = key;
+  node->value = value;
+  node->next = table->buckets[index];
+  table->buckets[index] = node;
+  table->size++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool chainedGet(ChainedTable* table, ObjString* key, Value* value)
+{
+  uint32_t index = key->hash % (uint32_t)table->capacity;
+  for ( Node* node = table->buckets[index]; node != NULL; node = node->next ) {
+    if ( node->key == key ) {
+      *value = node->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static double elapsed(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void report(const char* name, const char* op, int count, double seconds)
+{
+  printf(
+    "%-10s %-7s %10.2f Mops/s  (%.3f s)\n",
+    name,
+    op,
+    count / seconds / 1e6,
+    seconds);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main(int argc, const char* argv[])
+{
+  int count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  initVM();
+
+  // The keys are interned up front so both tables see identical inputs
+  ObjString** keys = malloc(sizeof(ObjString*) * (size_t)count);
+  for ( int i = 0; i < count; i++ ) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "key_%d", i);
+    keys[i] = copyString(buffer, length);
+  }
+
+  // Look keys up in a shuffled order, otherwise the chained table gets to walk
+  // its nodes in allocation order, which real programs never do
+  ObjString** probes = malloc(sizeof(ObjString*) * (size_t)count);
+  for ( int i = 0; i < count; i++ ) {
+    probes[i] = keys[i];
+  }
+  srand(42);
+  for ( int i = count - 1; i > 0; i-- ) {
+    int j = rand() % (i + 1);
+    ObjString* tmp = probes[i];
+    probes[i] = probes[j];
+    probes[j] = tmp;
+  }
+
+  // Accumulate the looked up values so the loops cannot be optimized away
+  double checksum = 0;
+  Value value;
+
+  Table table;
+  initTable(&table);
+
+  clock_t start = clock();
+  for ( int i = 0; i < count; i++ ) {
+    tableSet(&table, keys[i], NUMBER_VAL(i));
+  }
+  report("open", "insert", count, elapsed(start));
+
+  start = clock();
+  for ( int round = 0; round < LOOKUP_ROUNDS; round++ ) {
+    for ( int i = 0; i < count; i++ ) {
+      if ( tableGet(&table, probes[i], &value) ) checksum += AS_NUMBER(value);
+    }
+  }
+  report("open", "lookup", count * LOOKUP_ROUNDS, elapsed(start));
+
+  ChainedTable chained;
+  initChained(&chained);
+
+  start = clock();
+  for ( int i = 0; i < count; i++ ) {
+    chainedSet(&chained, keys[i], NUMBER_VAL(i));
+  }
+  report("chained", "insert", count, elapsed(start));
+
+  start = clock();
+  for ( int round = 0; round < LOOKUP_ROUNDS; round++ ) {
+    for ( int i = 0; i < count; i++ ) {
+      if ( chainedGet(&chained, probes[i], &value) ) {
+        checksum -= AS_NUMBER(value);
+      }
+    }
+  }
+  report("chained", "lookup", count * LOOKUP_ROUNDS, elapsed(start));
+
+  // Both tables hold the same values, so this should print 0
+  printf("checksum: %g\n", checksum);
+
+  freeChained(&chained);
+  freeTable(&table);
+  free(probes);
+  free(keys);
+  freeVM();
+
+  return 0;
+}
@@ -1,5 +1,8 @@
 #include "chunk.h"
+#include "jit.h"
 #include "memory.h"
+#include "object.h"
+#include "vm.h"
 
 #include <stdlib.h>
 
@@ -14,6 +17,12 @@ void initChunk(Chunk* chunk)
   chunk->code = NULL;
   chunk->lines = NULL;
   initValueArray(&chunk->constants);
+  chunk->format = CHUNK_STACK;
+  chunk->frameSize = 0;
+  chunk->mapped = false;
+  chunk->profile = NULL;
+  chunk->hotness = 0;
+  chunk->jit = NULL;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -43,7 +52,13 @@ void appendChunk(Chunk* chunk, uint8_t byte, int line)
  */
 int addConstant(Chunk* chunk, Value value)
 {
+  // Growing the constant pool may collect the value before it is stored
+  push(value);
   appendValueArray(&chunk->constants, value);
+  pop();
+
+  // The chunk belongs to a function that may already have been traced
+  writeBarrier(value);
   return chunk->constants.size - 1;
 }
 
@@ -53,8 +68,99 @@ int addConstant(Chunk* chunk, Value value)
  */
 void freeChunk(Chunk* chunk)
 {
-  FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+#ifdef JIT
+  freeJit(chunk->jit);
+#endif
+  FREE_ARRAY(InstructionProfile, chunk->profile, chunk->size);
+  if ( !chunk->mapped ) FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
   FREE_ARRAY(int, chunk->lines, chunk->capacity);
   freeValueArray(&chunk->constants);
   initChunk(chunk);
 }
+
+/*---------------------------------------------------------------------------*/
+
+/** Each upvalue of a closure adds an (isLocal, index) byte pair.
+ */
+static int closureLength(Chunk* chunk, int offset, int operands)
+{
+  Value function = chunk->constants.values[chunk->code[offset + operands]];
+  return operands + 1 + 2 * AS_FUNCTION(function)->upvalueCount;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the size in bytes of the instruction at offset, operands included.
+ */
+int instructionLength(Chunk* chunk, int offset)
+{
+  if ( chunk->code[offset] == OP_CLOSURE ) {
+    return closureLength(chunk, offset, 1);
+  }
+  return opcodeLength(chunk->code[offset]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int opcodeLength(uint8_t op)
+{
+  switch ( op ) {
+    case OP_CLOSURE:  // Without the upvalue operands
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_CALL:
+    case OP_SET_LOCAL_POP:
+      return 2;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_LOOP:
+    case OP_GET_LOCAL_CONSTANT_ADD:
+    case OP_GET_LOCAL_GET_LOCAL_ADD:
+    case OP_GET_LOCAL_GET_LOCAL:
+    case OP_GET_LOCAL_CONSTANT:
+    case OP_LESS_JUMP_IF_FALSE:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+int registerInstructionLength(Chunk* chunk, int offset)
+{
+  switch ( chunk->code[offset] ) {
+    case ROP_CLOSURE:
+      return closureLength(chunk, offset, 2);
+    case ROP_LOADNIL:
+    case ROP_LOADTRUE:
+    case ROP_LOADFALSE:
+    case ROP_PRINT:
+    case ROP_RETURN:
+    case ROP_CLOSE_UPVALUES:
+      return 2;
+    case ROP_LOADK:
+    case ROP_MOVE:
+    case ROP_GET_GLOBAL:
+    case ROP_DEFINE_GLOBAL:
+    case ROP_SET_GLOBAL:
+    case ROP_GET_UPVALUE:
+    case ROP_SET_UPVALUE:
+    case ROP_NOT:
+    case ROP_NEGATE:
+    case ROP_JUMP:
+    case ROP_LOOP:
+    case ROP_CALL:
+      return 3;
+    default:
+      // Three operands, or a register and a jump offset
+      return 4;
+  }
+}
@@ -10,9 +10,105 @@
 typedef enum
 {
   OP_CONSTANT,
+  OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
+  OP_POP,
+  OP_GET_LOCAL,
+  OP_SET_LOCAL,
+  OP_GET_GLOBAL,
+  OP_DEFINE_GLOBAL,
+  OP_SET_GLOBAL,
+  OP_GET_UPVALUE,
+  OP_SET_UPVALUE,
+  OP_EQUAL,
+  OP_GREATER,
+  OP_LESS,
+  OP_ADD,
+  OP_SUBTRACT,
+  OP_MULTIPLY,
+  OP_DIVIDE,
+  OP_NOT,
+  OP_NEGATE,
+  OP_PRINT,
+  OP_JUMP,
+  OP_JUMP_IF_FALSE,
+  OP_LOOP,
+  OP_CALL,
+  OP_CLOSURE,  // function constant, then (isLocal, index) per upvalue
+  OP_CLOSE_UPVALUE,
   OP_RETURN,
+  // Only produced by the peephole optimizer
+  OP_JUMP_IF_TRUE,
+  // Superinstructions, see the table in optimizer.c
+  OP_GET_LOCAL_CONSTANT_ADD,   // local slot, constant
+  OP_GET_LOCAL_GET_LOCAL_ADD,  // two local slots
+  OP_GET_LOCAL_GET_LOCAL,      // two local slots
+  OP_GET_LOCAL_CONSTANT,       // local slot, constant
+  OP_SET_LOCAL_POP,            // local slot
+  OP_LESS_JUMP_IF_FALSE,       // 16-bit forward offset
 } OpCode;
 
+// Three-address instructions for the register virtual machine. Registers are
+// the stack slots of the current frame, so register N of a function is its
+// Nth local. Operands follow the opcode, one byte each: A is the destination
+// register, B and C are source registers and K is a constant index. Jump
+// offsets are 16-bit, like the stack instructions'.
+typedef enum
+{
+  ROP_LOADK,          // A K       R[A] = K
+  ROP_LOADNIL,        // A         R[A] = nil
+  ROP_LOADTRUE,       // A         R[A] = true
+  ROP_LOADFALSE,      // A         R[A] = false
+  ROP_MOVE,           // A B       R[A] = R[B]
+  ROP_GET_GLOBAL,     // A K       R[A] = globals[K]
+  ROP_DEFINE_GLOBAL,  // A K       globals[K] = R[A] (new)
+  ROP_SET_GLOBAL,     // A K       globals[K] = R[A] (existing)
+  ROP_GET_UPVALUE,    // A U       R[A] = upvalues[U]
+  ROP_SET_UPVALUE,    // A U       upvalues[U] = R[A]
+  ROP_EQUAL,          // A B C     R[A] = R[B] == R[C]
+  ROP_EQUALK,         // A B K     R[A] = R[B] == K
+  ROP_GREATER,        // A B C     R[A] = R[B] > R[C]
+  ROP_GREATERK,       // A B K     R[A] = R[B] > K
+  ROP_LESS,           // A B C     R[A] = R[B] < R[C]
+  ROP_LESSK,          // A B K     R[A] = R[B] < K
+  ROP_ADD,            // A B C     R[A] = R[B] + R[C]
+  ROP_ADDK,           // A B K     R[A] = R[B] + K
+  ROP_SUBTRACT,       // A B C     R[A] = R[B] - R[C]
+  ROP_SUBTRACTK,      // A B K     R[A] = R[B] - K
+  ROP_MULTIPLY,       // A B C     R[A] = R[B] * R[C]
+  ROP_MULTIPLYK,      // A B K     R[A] = R[B] * K
+  ROP_DIVIDE,         // A B C     R[A] = R[B] / R[C]
+  ROP_DIVIDEK,        // A B K     R[A] = R[B] / K
+  ROP_NOT,            // A B       R[A] = !R[B]
+  ROP_NEGATE,         // A B       R[A] = -R[B]
+  ROP_PRINT,          // A         print R[A]
+  ROP_JUMP,           // off       ip += off
+  ROP_JUMP_IF_FALSE,  // A off     if R[A] is falsey: ip += off
+  ROP_JUMP_IF_TRUE,   // A off     if R[A] is truthy: ip += off
+  ROP_LOOP,           // off       ip -= off
+  ROP_CALL,           // A argc    R[A] = R[A](R[A+1], ..., R[A+argc])
+  ROP_CLOSURE,        // A K ...   R[A] = closure of K, upvalue pairs follow
+  ROP_CLOSE_UPVALUES, // A         close upvalues of R[A] and above
+  ROP_RETURN,         // A         return R[A]
+} RegisterOpCode;
+
+typedef enum
+{
+  CHUNK_STACK,     // OpCode instructions for run()
+  CHUNK_REGISTER,  // RegisterOpCode instructions for runRegisters()
+} ChunkFormat;
+
+// Counters for one instruction while profiling
+typedef struct
+{
+  uint64_t hits;     // times the instruction started
+  uint64_t samples;  // timer samples taken while it was running
+} InstructionProfile;
+
+// Machine code for a hot chunk, see jit.h
+typedef struct JitCode JitCode;
+
 // Bytecode is a series of instructions (as dynamic array)
 typedef struct
 {
@@ -21,6 +117,12 @@ typedef struct
   uint8_t* code;
   int* lines;  // source line numbers
   ValueArray constants;
+  ChunkFormat format;
+  int frameSize;  // registers used, or stack slots once verified
+  bool mapped;    // code points into a loaded image and is not freed
+  InstructionProfile* profile;  // indexed by offset, NULL until profiled
+  int hotness;   // calls and loop iterations, -1 once the JIT gives up
+  JitCode* jit;  // NULL until the chunk is hot enough to compile
 } Chunk;
 
 // Initialize a new chunk
@@ -33,4 +135,10 @@ int addConstant(Chunk* chunk, Value value);
 
 void freeChunk(Chunk* chunk);
 
+// Size in bytes of an instruction, operands included. OP_CLOSURE is followed
+// by one more byte pair per upvalue, instructionLength() accounts for those.
+int opcodeLength(uint8_t op);
+int instructionLength(Chunk* chunk, int offset);
+int registerInstructionLength(Chunk* chunk, int offset);
+
 #endif  // !clox_chunk_h
@@ -6,4 +6,51 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define UINT8_COUNT (UINT8_MAX + 1)
+
+// Represent Value as a NaN-boxed 64-bit double. Build with
+// YACLOX_NO_NAN_BOXING defined to fall back to a tagged union, which is much
+// easier to inspect from a debugger.
+#ifndef YACLOX_NO_NAN_BOXING
+#define NAN_BOXING
+#endif
+
+// Serve small allocations from per size class free lists instead of going to
+// malloc()/free() every time. Build with YACLOX_NO_POOL_ALLOCATOR defined to
+// use the system allocator for everything.
+#ifndef YACLOX_NO_POOL_ALLOCATOR
+#define POOL_ALLOCATOR
+#endif
+
+// Run the peephole optimizer over each chunk the compiler produces. Build
+// with YACLOX_NO_PEEPHOLE defined to run the bytecode exactly as emitted.
+#ifndef YACLOX_NO_PEEPHOLE
+#define PEEPHOLE_OPTIMIZER
+#endif
+
+// Let the VM count and sample the instructions it executes, see --profile.
+// Build with YACLOX_NO_PROFILER defined to drop the check from the dispatch
+// loops.
+#ifndef YACLOX_NO_PROFILER
+#define PROFILER
+#endif
+
+// Compile hot functions to x86-64 machine code, see jit.h. The build only
+// defines YACLOX_JIT on x86-64 Linux with NaN boxing, when asked to.
+#ifdef YACLOX_JIT
+#define JIT
+#endif
+
+// Dump each chunk once the compiler is done with it
+// #define DEBUG_PRINT_CODE
+
+// Print the stack and each instruction before it is executed
+// #define DEBUG_TRACE_EXECUTION
+
+// Run a full collection on every allocation to flush out missing roots
+// #define DEBUG_STRESS_GC
+
+// Log allocations, frees and collector phases
+// #define DEBUG_LOG_GC
+
 #endif  // !clox_common_h
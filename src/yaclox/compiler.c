@@ -0,0 +1,1129 @@
+#include "compiler.h"
+#include "common.h"
+#include "memory.h"
+#include "optimizer.h"
+#include "registers.h"
+#include "scanner.h"
+#include "verifier.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef DEBUG_PRINT_CODE
+#include "debug.h"
+#endif
+
+typedef struct
+{
+  Token current;
+  Token previous;
+  bool hadError;
+  bool panicMode;  // suppress cascading errors until the next statement
+} Parser;
+
+// Lox's precedence levels, from lowest to highest
+typedef enum
+{
+  PREC_NONE,
+  PREC_ASSIGNMENT,  // =
+  PREC_OR,          // or
+  PREC_AND,         // and
+  PREC_EQUALITY,    // == !=
+  PREC_COMPARISON,  // < > <= >=
+  PREC_TERM,        // + -
+  PREC_FACTOR,      // * /
+  PREC_UNARY,       // ! -
+  PREC_CALL,        // . ()
+  PREC_PRIMARY
+} Precedence;
+
+typedef void (*ParseFn)(bool canAssign);
+
+// A row in the Pratt parser table
+typedef struct
+{
+  ParseFn prefix;
+  ParseFn infix;
+  Precedence precedence;  // of the infix expression using this token
+} ParseRule;
+
+typedef struct
+{
+  Token name;
+  int depth;        // -1 while the variable's initializer is being compiled
+  bool isCaptured;  // a closure refers to it, close it when it goes away
+} Local;
+
+typedef struct
+{
+  uint8_t index;  // local slot or upvalue index in the enclosing function
+  bool isLocal;   // captures a local of the enclosing function directly
+} Upvalue;
+
+typedef enum
+{
+  TYPE_FUNCTION,
+  TYPE_SCRIPT
+} FunctionType;
+
+// Each function being compiled gets its own compiler. They form a stack
+// through the enclosing links, mirroring the nesting in the source.
+typedef struct Compiler
+{
+  struct Compiler* enclosing;
+  ObjFunction* function;
+  FunctionType type;
+
+  // Locals live in stack slots, in the order they are declared
+  Local locals[UINT8_COUNT];
+  int localCount;
+  Upvalue upvalues[UINT8_COUNT];
+  int scopeDepth;
+} Compiler;
+
+Parser parser;
+
+Compiler* current = NULL;
+
+/*---------------------------------------------------------------------------*/
+
+static Chunk* currentChunk(void)
+{
+  return &current->function->chunk;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void errorAt(Token* token, const char* message)
+{
+  if ( parser.panicMode ) return;
+  parser.panicMode = true;
+
+  fprintf(stderr, "[line %d] Error", token->line);
+
+  if ( token->type == TOKEN_EOF ) {
+    fprintf(stderr, " at end");
+  } else if ( token->type == TOKEN_ERROR ) {
+    // Nothing
+  } else {
+    fprintf(stderr, " at '%.*s'", token->length, token->start);
+  }
+
+  fprintf(stderr, ": %s\n", message);
+  parser.hadError = true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void error(const char* message)
+{
+  errorAt(&parser.previous, message);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void errorAtCurrent(const char* message)
+{
+  errorAt(&parser.current, message);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void advance(void)
+{
+  parser.previous = parser.current;
+
+  for ( ;; ) {
+    parser.current = scanToken();
+    if ( parser.current.type != TOKEN_ERROR ) break;
+
+    errorAtCurrent(parser.current.start);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void consume(TokenType type, const char* message)
+{
+  if ( parser.current.type == type ) {
+    advance();
+    return;
+  }
+
+  errorAtCurrent(message);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool check(TokenType type)
+{
+  return parser.current.type == type;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool match(TokenType type)
+{
+  if ( !check(type) ) return false;
+  advance();
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitByte(uint8_t byte)
+{
+  appendChunk(currentChunk(), byte, parser.previous.line);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitBytes(uint8_t byte1, uint8_t byte2)
+{
+  emitByte(byte1);
+  emitByte(byte2);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Emit a backward jump to the given loop start.
+ */
+static void emitLoop(int loopStart)
+{
+  emitByte(OP_LOOP);
+
+  int offset = currentChunk()->size - loopStart + 2;
+  if ( offset > UINT16_MAX ) error("Loop body too large.");
+
+  emitByte((uint8_t)((offset >> 8) & 0xff));
+  emitByte((uint8_t)(offset & 0xff));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Emit a forward jump with a placeholder offset, and return the offset of the
+ * placeholder so that patchJump() can fill it in later.
+ */
+static int emitJump(uint8_t instruction)
+{
+  emitByte(instruction);
+  emitByte(0xff);
+  emitByte(0xff);
+  return currentChunk()->size - 2;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitReturn(void)
+{
+  emitByte(OP_NIL);
+  emitByte(OP_RETURN);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint8_t makeConstant(Value value)
+{
+  int constant = addConstant(currentChunk(), value);
+  if ( constant > UINT8_MAX ) {
+    error("Too many constants in one chunk.");
+    return 0;
+  }
+
+  return (uint8_t)constant;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitConstant(Value value)
+{
+  emitBytes(OP_CONSTANT, makeConstant(value));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Backpatch a forward jump to land on the next instruction to be emitted.
+ */
+static void patchJump(int offset)
+{
+  // -2 to adjust for the bytecode for the jump offset itself
+  int jump = currentChunk()->size - offset - 2;
+
+  if ( jump > UINT16_MAX ) {
+    error("Too much code to jump over.");
+  }
+
+  currentChunk()->code[offset] = (uint8_t)((jump >> 8) & 0xff);
+  currentChunk()->code[offset + 1] = (uint8_t)(jump & 0xff);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void initCompiler(Compiler* compiler, FunctionType type)
+{
+  compiler->enclosing = current;
+  compiler->function = NULL;
+  compiler->type = type;
+  compiler->localCount = 0;
+  compiler->scopeDepth = 0;
+  compiler->function = newFunction();
+  current = compiler;
+
+  if ( type != TYPE_SCRIPT ) {
+    current->function->name =
+      copyString(parser.previous.start, parser.previous.length);
+    writeBarrier(OBJ_VAL(current->function->name));
+  }
+
+  // Slot zero holds the function being called
+  Local* local = &current->locals[current->localCount++];
+  local->depth = 0;
+  local->isCaptured = false;
+  local->name.start = "";
+  local->name.length = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static ObjFunction* endCompiler(void)
+{
+  emitReturn();
+  ObjFunction* function = current->function;
+
+  if ( !parser.hadError ) {
+#ifdef DEBUG_PRINT_CODE
+    const char* name =
+      function->name != NULL ? function->name->chars : "<script>";
+    disassembleChunk(currentChunk(), name);
+#endif
+
+#ifdef PEEPHOLE_OPTIMIZER
+    optimizeChunk(currentChunk());
+#ifdef DEBUG_PRINT_CODE
+    // Listing after the peephole pass, to compare with the one above
+    char optimized[64];
+    snprintf(optimized, sizeof(optimized), "%s (peephole)", name);
+    disassembleChunk(currentChunk(), optimized);
+#endif
+#endif
+
+    if ( vm.backend == BACKEND_REGISTER && !parser.hadError ) {
+      if ( emitRegisterCode(function) ) {
+#ifdef DEBUG_PRINT_CODE
+        char registers[64];
+        snprintf(registers, sizeof(registers), "%s (registers)", name);
+        disassembleChunk(currentChunk(), registers);
+#endif
+      } else {
+        error("Function too large for the register backend.");
+      }
+    }
+
+    if ( !parser.hadError && !verifyFunction(function) ) {
+      error("Compiled function failed verification.");
+    }
+  }
+
+  current = current->enclosing;
+  return function;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void beginScope(void)
+{
+  current->scopeDepth++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Leave a block scope and pop its locals off the stack. Captured locals
+ * are moved to the heap instead of being simply discarded.
+ */
+static void endScope(void)
+{
+  current->scopeDepth--;
+
+  while (
+    current->localCount > 0 &&
+    current->locals[current->localCount - 1].depth > current->scopeDepth ) {
+    if ( current->locals[current->localCount - 1].isCaptured ) {
+      emitByte(OP_CLOSE_UPVALUE);
+    } else {
+      emitByte(OP_POP);
+    }
+    current->localCount--;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void expression(void);
+static void statement(void);
+static void declaration(void);
+static ParseRule* getRule(TokenType type);
+static void parsePrecedence(Precedence precedence);
+
+/*---------------------------------------------------------------------------*/
+
+static uint8_t identifierConstant(Token* name)
+{
+  return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool identifiersEqual(Token* a, Token* b)
+{
+  if ( a->length != b->length ) return false;
+  return memcmp(a->start, b->start, (size_t)a->length) == 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the stack slot of a local variable, or -1 if it is not a local of
+ * the function being compiled.
+ */
+static int resolveLocal(Compiler* compiler, Token* name)
+{
+  // Walk backward so that inner variables shadow outer ones
+  for ( int i = compiler->localCount - 1; i >= 0; i-- ) {
+    Local* local = &compiler->locals[i];
+    if ( identifiersEqual(name, &local->name) ) {
+      if ( local->depth == -1 ) {
+        error("Can't read local variable in its own initializer.");
+      }
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal)
+{
+  int upvalueCount = compiler->function->upvalueCount;
+
+  // A closure captures each variable once, however often it is used
+  for ( int i = 0; i < upvalueCount; i++ ) {
+    Upvalue* upvalue = &compiler->upvalues[i];
+    if ( upvalue->index == index && upvalue->isLocal == isLocal ) {
+      return i;
+    }
+  }
+
+  if ( upvalueCount == UINT8_COUNT ) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+
+  compiler->upvalues[upvalueCount].isLocal = isLocal;
+  compiler->upvalues[upvalueCount].index = index;
+  return compiler->function->upvalueCount++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the upvalue index of a variable declared in an enclosing function,
+ * or -1 for a global. Each function in between captures it in turn.
+ */
+static int resolveUpvalue(Compiler* compiler, Token* name)
+{
+  if ( compiler->enclosing == NULL ) return -1;
+
+  int local = resolveLocal(compiler->enclosing, name);
+  if ( local != -1 ) {
+    compiler->enclosing->locals[local].isCaptured = true;
+    return addUpvalue(compiler, (uint8_t)local, true);
+  }
+
+  int upvalue = resolveUpvalue(compiler->enclosing, name);
+  if ( upvalue != -1 ) {
+    return addUpvalue(compiler, (uint8_t)upvalue, false);
+  }
+
+  return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void addLocal(Token name)
+{
+  if ( current->localCount == UINT8_COUNT ) {
+    error("Too many local variables in function.");
+    return;
+  }
+
+  Local* local = &current->locals[current->localCount++];
+  local->name = name;
+  local->depth = -1;
+  local->isCaptured = false;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void declareVariable(void)
+{
+  // Globals are late bound and not tracked by the compiler
+  if ( current->scopeDepth == 0 ) return;
+
+  Token* name = &parser.previous;
+  for ( int i = current->localCount - 1; i >= 0; i-- ) {
+    Local* local = &current->locals[i];
+    if ( local->depth != -1 && local->depth < current->scopeDepth ) {
+      break;
+    }
+
+    if ( identifiersEqual(name, &local->name) ) {
+      error("Already a variable with this name in this scope.");
+    }
+  }
+
+  addLocal(*name);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint8_t parseVariable(const char* errorMessage)
+{
+  consume(TOKEN_IDENTIFIER, errorMessage);
+
+  declareVariable();
+  if ( current->scopeDepth > 0 ) return 0;
+
+  return identifierConstant(&parser.previous);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void markInitialized(void)
+{
+  if ( current->scopeDepth == 0 ) return;
+  current->locals[current->localCount - 1].depth = current->scopeDepth;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A local variable is simply the value left on top of the stack, so defining
+ * one emits no code at all.
+ */
+static void defineVariable(uint8_t global)
+{
+  if ( current->scopeDepth > 0 ) {
+    markInitialized();
+    return;
+  }
+
+  emitBytes(OP_DEFINE_GLOBAL, global);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint8_t argumentList(void)
+{
+  uint8_t argCount = 0;
+  if ( !check(TOKEN_RIGHT_PAREN) ) {
+    do {
+      expression();
+      if ( argCount == 255 ) {
+        error("Can't have more than 255 arguments.");
+      }
+      argCount++;
+    } while ( match(TOKEN_COMMA) );
+  }
+
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+  return argCount;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The right operand is only evaluated if the left one is truthy.
+ */
+static void and_(bool canAssign)
+{
+  (void)canAssign;
+
+  int endJump = emitJump(OP_JUMP_IF_FALSE);
+
+  emitByte(OP_POP);
+  parsePrecedence(PREC_AND);
+
+  patchJump(endJump);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void binary(bool canAssign)
+{
+  (void)canAssign;
+
+  TokenType operatorType = parser.previous.type;
+  ParseRule* rule = getRule(operatorType);
+  parsePrecedence((Precedence)(rule->precedence + 1));
+
+  switch ( operatorType ) {
+    case TOKEN_BANG_EQUAL:
+      emitBytes(OP_EQUAL, OP_NOT);
+      break;
+    case TOKEN_EQUAL_EQUAL:
+      emitByte(OP_EQUAL);
+      break;
+    case TOKEN_GREATER:
+      emitByte(OP_GREATER);
+      break;
+    case TOKEN_GREATER_EQUAL:
+      emitBytes(OP_LESS, OP_NOT);
+      break;
+    case TOKEN_LESS:
+      emitByte(OP_LESS);
+      break;
+    case TOKEN_LESS_EQUAL:
+      emitBytes(OP_GREATER, OP_NOT);
+      break;
+    case TOKEN_PLUS:
+      emitByte(OP_ADD);
+      break;
+    case TOKEN_MINUS:
+      emitByte(OP_SUBTRACT);
+      break;
+    case TOKEN_STAR:
+      emitByte(OP_MULTIPLY);
+      break;
+    case TOKEN_SLASH:
+      emitByte(OP_DIVIDE);
+      break;
+    default:
+      return;  // Unreachable
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void call(bool canAssign)
+{
+  (void)canAssign;
+
+  uint8_t argCount = argumentList();
+  emitBytes(OP_CALL, argCount);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void literal(bool canAssign)
+{
+  (void)canAssign;
+
+  switch ( parser.previous.type ) {
+    case TOKEN_FALSE:
+      emitByte(OP_FALSE);
+      break;
+    case TOKEN_NIL:
+      emitByte(OP_NIL);
+      break;
+    case TOKEN_TRUE:
+      emitByte(OP_TRUE);
+      break;
+    default:
+      return;  // Unreachable
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void grouping(bool canAssign)
+{
+  (void)canAssign;
+
+  expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void number(bool canAssign)
+{
+  (void)canAssign;
+
+  double value = strtod(parser.previous.start, NULL);
+  emitConstant(NUMBER_VAL(value));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void or_(bool canAssign)
+{
+  (void)canAssign;
+
+  int elseJump = emitJump(OP_JUMP_IF_FALSE);
+  int endJump = emitJump(OP_JUMP);
+
+  patchJump(elseJump);
+  emitByte(OP_POP);
+
+  parsePrecedence(PREC_OR);
+  patchJump(endJump);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void string(bool canAssign)
+{
+  (void)canAssign;
+
+  // Trim the quotation marks
+  emitConstant(OBJ_VAL(
+    copyString(parser.previous.start + 1, parser.previous.length - 2)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void namedVariable(Token name, bool canAssign)
+{
+  uint8_t getOp, setOp;
+  int arg = resolveLocal(current, &name);
+  if ( arg != -1 ) {
+    getOp = OP_GET_LOCAL;
+    setOp = OP_SET_LOCAL;
+  } else if ( (arg = resolveUpvalue(current, &name)) != -1 ) {
+    getOp = OP_GET_UPVALUE;
+    setOp = OP_SET_UPVALUE;
+  } else {
+    arg = identifierConstant(&name);
+    getOp = OP_GET_GLOBAL;
+    setOp = OP_SET_GLOBAL;
+  }
+
+  if ( canAssign && match(TOKEN_EQUAL) ) {
+    expression();
+    emitBytes(setOp, (uint8_t)arg);
+  } else {
+    emitBytes(getOp, (uint8_t)arg);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void variable(bool canAssign)
+{
+  namedVariable(parser.previous, canAssign);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void unary(bool canAssign)
+{
+  (void)canAssign;
+
+  TokenType operatorType = parser.previous.type;
+
+  // Compile the operand
+  parsePrecedence(PREC_UNARY);
+
+  // Emit the operator instruction
+  switch ( operatorType ) {
+    case TOKEN_BANG:
+      emitByte(OP_NOT);
+      break;
+    case TOKEN_MINUS:
+      emitByte(OP_NEGATE);
+      break;
+    default:
+      return;  // Unreachable
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+// clang-format off
+ParseRule rules[] = {
+  [TOKEN_LEFT_PAREN]    = {grouping, call,   PREC_CALL},
+  [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_DOT]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_MINUS]         = {unary,    binary, PREC_TERM},
+  [TOKEN_PLUS]          = {NULL,     binary, PREC_TERM},
+  [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_SLASH]         = {NULL,     binary, PREC_FACTOR},
+  [TOKEN_STAR]          = {NULL,     binary, PREC_FACTOR},
+  [TOKEN_BANG]          = {unary,    NULL,   PREC_NONE},
+  [TOKEN_BANG_EQUAL]    = {NULL,     binary, PREC_EQUALITY},
+  [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_EQUAL_EQUAL]   = {NULL,     binary, PREC_EQUALITY},
+  [TOKEN_GREATER]       = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_GREATER_EQUAL] = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_LESS]          = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_LESS_EQUAL]    = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_IDENTIFIER]    = {variable, NULL,   PREC_NONE},
+  [TOKEN_STRING]        = {string,   NULL,   PREC_NONE},
+  [TOKEN_NUMBER]        = {number,   NULL,   PREC_NONE},
+  [TOKEN_AND]           = {NULL,     and_,   PREC_AND},
+  [TOKEN_CLASS]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_ELSE]          = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_FALSE]         = {literal,  NULL,   PREC_NONE},
+  [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_FUN]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_NIL]           = {literal,  NULL,   PREC_NONE},
+  [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
+  [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_SUPER]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_THIS]          = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_TRUE]          = {literal,  NULL,   PREC_NONE},
+  [TOKEN_VAR]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
+};
+// clang-format on
+
+/*---------------------------------------------------------------------------*/
+
+/** Parse any expression at the given precedence level or higher.
+ */
+static void parsePrecedence(Precedence precedence)
+{
+  advance();
+  ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+  if ( prefixRule == NULL ) {
+    error("Expect expression.");
+    return;
+  }
+
+  // Only a low precedence expression may be the target of an assignment
+  bool canAssign = precedence <= PREC_ASSIGNMENT;
+  prefixRule(canAssign);
+
+  while ( precedence <= getRule(parser.current.type)->precedence ) {
+    advance();
+    ParseFn infixRule = getRule(parser.previous.type)->infix;
+    infixRule(canAssign);
+  }
+
+  if ( canAssign && match(TOKEN_EQUAL) ) {
+    error("Invalid assignment target.");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static ParseRule* getRule(TokenType type)
+{
+  return &rules[type];
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void expression(void)
+{
+  parsePrecedence(PREC_ASSIGNMENT);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void block(void)
+{
+  while ( !check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF) ) {
+    declaration();
+  }
+
+  consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile a function body into its own chunk, with a fresh compiler. The
+ * finished function is a constant of the enclosing chunk, which creates a
+ * closure from it at runtime.
+ */
+static void function(FunctionType type)
+{
+  Compiler compiler;
+  initCompiler(&compiler, type);
+  beginScope();
+
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+  if ( !check(TOKEN_RIGHT_PAREN) ) {
+    do {
+      current->function->arity++;
+      if ( current->function->arity > 255 ) {
+        errorAtCurrent("Can't have more than 255 parameters.");
+      }
+      uint8_t constant = parseVariable("Expect parameter name.");
+      defineVariable(constant);
+    } while ( match(TOKEN_COMMA) );
+  }
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+  consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+  block();
+
+  // No endScope(): the whole frame is discarded when the function returns
+  ObjFunction* function = endCompiler();
+  emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+
+  // Tell the VM where to find each variable the closure captures
+  for ( int i = 0; i < function->upvalueCount; i++ ) {
+    emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+    emitByte(compiler.upvalues[i].index);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void funDeclaration(void)
+{
+  uint8_t global = parseVariable("Expect function name.");
+  // A function may refer to itself, so it is usable before its body ends
+  markInitialized();
+  function(TYPE_FUNCTION);
+  defineVariable(global);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void varDeclaration(void)
+{
+  uint8_t global = parseVariable("Expect variable name.");
+
+  if ( match(TOKEN_EQUAL) ) {
+    expression();
+  } else {
+    emitByte(OP_NIL);
+  }
+  consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
+
+  defineVariable(global);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void expressionStatement(void)
+{
+  expression();
+  consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+  emitByte(OP_POP);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void forStatement(void)
+{
+  // Variables declared in the initializer are scoped to the loop
+  beginScope();
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+  if ( match(TOKEN_SEMICOLON) ) {
+    // No initializer
+  } else if ( match(TOKEN_VAR) ) {
+    varDeclaration();
+  } else {
+    expressionStatement();
+  }
+
+  int loopStart = currentChunk()->size;
+  int exitJump = -1;
+  if ( !match(TOKEN_SEMICOLON) ) {
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+
+    // Jump out of the loop if the condition is false
+    exitJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);  // Condition
+  }
+
+  // The increment clause is compiled before the body but runs after it: jump
+  // over it, run the body, then loop back to it
+  if ( !match(TOKEN_RIGHT_PAREN) ) {
+    int bodyJump = emitJump(OP_JUMP);
+    int incrementStart = currentChunk()->size;
+    expression();
+    emitByte(OP_POP);
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+
+    emitLoop(loopStart);
+    loopStart = incrementStart;
+    patchJump(bodyJump);
+  }
+
+  statement();
+  emitLoop(loopStart);
+
+  if ( exitJump != -1 ) {
+    patchJump(exitJump);
+    emitByte(OP_POP);  // Condition
+  }
+
+  endScope();
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void ifStatement(void)
+{
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+  expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+  int thenJump = emitJump(OP_JUMP_IF_FALSE);
+  emitByte(OP_POP);
+  statement();
+
+  int elseJump = emitJump(OP_JUMP);
+
+  patchJump(thenJump);
+  emitByte(OP_POP);
+
+  if ( match(TOKEN_ELSE) ) statement();
+  patchJump(elseJump);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void printStatement(void)
+{
+  expression();
+  consume(TOKEN_SEMICOLON, "Expect ';' after value.");
+  emitByte(OP_PRINT);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void returnStatement(void)
+{
+  if ( current->type == TYPE_SCRIPT ) {
+    error("Can't return from top-level code.");
+  }
+
+  if ( match(TOKEN_SEMICOLON) ) {
+    emitReturn();
+  } else {
+    expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+    emitByte(OP_RETURN);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void whileStatement(void)
+{
+  int loopStart = currentChunk()->size;
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+  expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+  int exitJump = emitJump(OP_JUMP_IF_FALSE);
+  emitByte(OP_POP);
+  statement();
+  emitLoop(loopStart);
+
+  patchJump(exitJump);
+  emitByte(OP_POP);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Skip tokens until a statement boundary to get out of panic mode.
+ */
+static void synchronize(void)
+{
+  parser.panicMode = false;
+
+  while ( parser.current.type != TOKEN_EOF ) {
+    if ( parser.previous.type == TOKEN_SEMICOLON ) return;
+    switch ( parser.current.type ) {
+      case TOKEN_CLASS:
+      case TOKEN_FUN:
+      case TOKEN_VAR:
+      case TOKEN_FOR:
+      case TOKEN_IF:
+      case TOKEN_WHILE:
+      case TOKEN_PRINT:
+      case TOKEN_RETURN:
+        return;
+
+      default:;  // Do nothing
+    }
+
+    advance();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void declaration(void)
+{
+  if ( match(TOKEN_FUN) ) {
+    funDeclaration();
+  } else if ( match(TOKEN_VAR) ) {
+    varDeclaration();
+  } else {
+    statement();
+  }
+
+  if ( parser.panicMode ) synchronize();
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void statement(void)
+{
+  if ( match(TOKEN_PRINT) ) {
+    printStatement();
+  } else if ( match(TOKEN_FOR) ) {
+    forStatement();
+  } else if ( match(TOKEN_IF) ) {
+    ifStatement();
+  } else if ( match(TOKEN_RETURN) ) {
+    returnStatement();
+  } else if ( match(TOKEN_WHILE) ) {
+    whileStatement();
+  } else if ( match(TOKEN_LEFT_BRACE) ) {
+    beginScope();
+    block();
+    endScope();
+  } else {
+    expressionStatement();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile the source in a single pass: tokens are pulled from the scanner on
+ * demand and bytecode is emitted as soon as each construct is recognized,
+ * without building an intermediate syntax tree.
+ */
+ObjFunction* compile(const char* source)
+{
+  initScanner(source);
+  Compiler compiler;
+  initCompiler(&compiler, TYPE_SCRIPT);
+
+  parser.hadError = false;
+  parser.panicMode = false;
+
+  advance();
+
+  while ( !match(TOKEN_EOF) ) {
+    declaration();
+  }
+
+  ObjFunction* function = endCompiler();
+  return parser.hadError ? NULL : function;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void markCompilerRoots(void)
+{
+  Compiler* compiler = current;
+  while ( compiler != NULL ) {
+    markObject((Obj*)compiler->function);
+    compiler = compiler->enclosing;
+  }
+}
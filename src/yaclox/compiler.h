@@ -0,0 +1,12 @@
+#ifndef clox_compiler_h
+#define clox_compiler_h
+
+#include "object.h"
+
+// Compile a whole script into a function. Return NULL on a compile error.
+ObjFunction* compile(const char* source);
+
+// Functions being compiled are reachable only from the compiler
+void markCompilerRoots(void);
+
+#endif  // !clox_compiler_h
@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 
+#include "object.h"
+
 /*---------------------------------------------------------------------------*/
 
 static int simpleInstruction(const char* name, int offset)
@@ -23,6 +25,214 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset)
 
 /*---------------------------------------------------------------------------*/
 
+static int byteInstruction(const char* name, Chunk* chunk, int offset)
+{
+  uint8_t slot = chunk->code[offset + 1];
+  printf("%-16s %4d\n", name, slot);
+  return offset + 2;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int localConstantInstruction(const char* name, Chunk* chunk, int offset)
+{
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constantIdx = chunk->code[offset + 2];
+  printf("%-16s %4d %4d '", name, slot, constantIdx);
+  printValue(chunk->constants.values[constantIdx]);
+  printf("'\n");
+  return offset + 3;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int twoLocalInstruction(const char* name, Chunk* chunk, int offset)
+{
+  printf("%-16s %4d %4d\n", name, chunk->code[offset + 1],
+         chunk->code[offset + 2]);
+  return offset + 3;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Print a jump with both its source offset and its resolved target.
+ */
+static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
+{
+  uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
+  jump |= chunk->code[offset + 2];
+  printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+  return offset + 3;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Print a closure followed by one line for each variable it captures. The
+ * register form has the destination register before the constant.
+ */
+static int closureInstruction(const char* name, Chunk* chunk, int offset,
+                              int registers)
+{
+  printf("%-16s", name);
+  for ( int i = 1; i <= registers; i++ ) {
+    printf(" r%d", chunk->code[offset + i]);
+  }
+  offset += registers + 1;
+  uint8_t constantIdx = chunk->code[offset++];
+  printf(" %4d ", constantIdx);
+  printValue(chunk->constants.values[constantIdx]);
+  printf("\n");
+
+  ObjFunction* function = AS_FUNCTION(chunk->constants.values[constantIdx]);
+  for ( int j = 0; j < function->upvalueCount; j++ ) {
+    int isLocal = chunk->code[offset++];
+    int index = chunk->code[offset++];
+    printf("%04d    |                     %s %d\n", offset - 2,
+           isLocal ? "local" : "upvalue", index);
+  }
+
+  return offset;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int registerInstruction(const char* name, Chunk* chunk, int offset,
+                               int registers)
+{
+  printf("%-16s", name);
+  for ( int i = 1; i <= registers; i++ ) {
+    printf(" r%d", chunk->code[offset + i]);
+  }
+  printf("\n");
+  return offset + 1 + registers;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Print an instruction whose last operand is a constant index.
+ */
+static int registerConstantInstruction(const char* name, Chunk* chunk,
+                                       int offset, int registers)
+{
+  printf("%-16s", name);
+  for ( int i = 1; i <= registers; i++ ) {
+    printf(" r%d", chunk->code[offset + i]);
+  }
+  uint8_t constantIdx = chunk->code[offset + registers + 1];
+  printf(" %4d '", constantIdx);
+  printValue(chunk->constants.values[constantIdx]);
+  printf("'\n");
+  return offset + registers + 2;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int registerJumpInstruction(const char* name, int sign, Chunk* chunk,
+                                   int offset, bool tested)
+{
+  int length = tested ? 4 : 3;
+  uint16_t jump = (uint16_t)(chunk->code[offset + length - 2] << 8);
+  jump |= chunk->code[offset + length - 1];
+
+  printf("%-16s", name);
+  if ( tested ) printf(" r%d", chunk->code[offset + 1]);
+  printf(" %4d -> %d\n", offset, offset + length + sign * jump);
+  return offset + length;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int disassembleRegisterInstruction(Chunk* chunk, int offset)
+{
+  uint8_t instruction = chunk->code[offset];
+  switch ( instruction ) {
+    case ROP_LOADK:
+      return registerConstantInstruction("ROP_LOADK", chunk, offset, 1);
+    case ROP_LOADNIL:
+      return registerInstruction("ROP_LOADNIL", chunk, offset, 1);
+    case ROP_LOADTRUE:
+      return registerInstruction("ROP_LOADTRUE", chunk, offset, 1);
+    case ROP_LOADFALSE:
+      return registerInstruction("ROP_LOADFALSE", chunk, offset, 1);
+    case ROP_MOVE:
+      return registerInstruction("ROP_MOVE", chunk, offset, 2);
+    case ROP_GET_GLOBAL:
+      return registerConstantInstruction("ROP_GET_GLOBAL", chunk, offset, 1);
+    case ROP_DEFINE_GLOBAL:
+      return registerConstantInstruction(
+        "ROP_DEFINE_GLOBAL", chunk, offset, 1);
+    case ROP_SET_GLOBAL:
+      return registerConstantInstruction("ROP_SET_GLOBAL", chunk, offset, 1);
+    case ROP_GET_UPVALUE:
+      printf("%-16s r%d %4d\n", "ROP_GET_UPVALUE", chunk->code[offset + 1],
+             chunk->code[offset + 2]);
+      return offset + 3;
+    case ROP_SET_UPVALUE:
+      printf("%-16s r%d %4d\n", "ROP_SET_UPVALUE", chunk->code[offset + 1],
+             chunk->code[offset + 2]);
+      return offset + 3;
+    case ROP_EQUAL:
+      return registerInstruction("ROP_EQUAL", chunk, offset, 3);
+    case ROP_EQUALK:
+      return registerConstantInstruction("ROP_EQUALK", chunk, offset, 2);
+    case ROP_GREATER:
+      return registerInstruction("ROP_GREATER", chunk, offset, 3);
+    case ROP_GREATERK:
+      return registerConstantInstruction("ROP_GREATERK", chunk, offset, 2);
+    case ROP_LESS:
+      return registerInstruction("ROP_LESS", chunk, offset, 3);
+    case ROP_LESSK:
+      return registerConstantInstruction("ROP_LESSK", chunk, offset, 2);
+    case ROP_ADD:
+      return registerInstruction("ROP_ADD", chunk, offset, 3);
+    case ROP_ADDK:
+      return registerConstantInstruction("ROP_ADDK", chunk, offset, 2);
+    case ROP_SUBTRACT:
+      return registerInstruction("ROP_SUBTRACT", chunk, offset, 3);
+    case ROP_SUBTRACTK:
+      return registerConstantInstruction("ROP_SUBTRACTK", chunk, offset, 2);
+    case ROP_MULTIPLY:
+      return registerInstruction("ROP_MULTIPLY", chunk, offset, 3);
+    case ROP_MULTIPLYK:
+      return registerConstantInstruction("ROP_MULTIPLYK", chunk, offset, 2);
+    case ROP_DIVIDE:
+      return registerInstruction("ROP_DIVIDE", chunk, offset, 3);
+    case ROP_DIVIDEK:
+      return registerConstantInstruction("ROP_DIVIDEK", chunk, offset, 2);
+    case ROP_NOT:
+      return registerInstruction("ROP_NOT", chunk, offset, 2);
+    case ROP_NEGATE:
+      return registerInstruction("ROP_NEGATE", chunk, offset, 2);
+    case ROP_PRINT:
+      return registerInstruction("ROP_PRINT", chunk, offset, 1);
+    case ROP_JUMP:
+      return registerJumpInstruction("ROP_JUMP", 1, chunk, offset, false);
+    case ROP_JUMP_IF_FALSE:
+      return registerJumpInstruction(
+        "ROP_JUMP_IF_FALSE", 1, chunk, offset, true);
+    case ROP_JUMP_IF_TRUE:
+      return registerJumpInstruction(
+        "ROP_JUMP_IF_TRUE", 1, chunk, offset, true);
+    case ROP_LOOP:
+      return registerJumpInstruction("ROP_LOOP", -1, chunk, offset, false);
+    case ROP_CALL:
+      printf("%-16s r%d %4d\n", "ROP_CALL", chunk->code[offset + 1],
+             chunk->code[offset + 2]);
+      return offset + 3;
+    case ROP_CLOSURE:
+      return closureInstruction("ROP_CLOSURE", chunk, offset, 1);
+    case ROP_CLOSE_UPVALUES:
+      return registerInstruction("ROP_CLOSE_UPVALUES", chunk, offset, 1);
+    case ROP_RETURN:
+      return registerInstruction("ROP_RETURN", chunk, offset, 1);
+    default:
+      printf("Unknown opcode %d\n", instruction);
+      return offset + 1;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Disassemble all of the instructions in the entire chunk.
  */
 void disassembleChunk(Chunk* chunk, const char* name)
@@ -45,12 +255,85 @@ int disassembleInstruction(Chunk* chunk, int offset)
     printf("%4d ", chunk->lines[offset]);
   }
 
+  if ( chunk->format == CHUNK_REGISTER ) {
+    return disassembleRegisterInstruction(chunk, offset);
+  }
+
   uint8_t instruction = chunk->code[offset];
   switch ( instruction ) {
     case OP_CONSTANT:
       return constantInstruction("OP_CONSTANT", chunk, offset);
+    case OP_NIL:
+      return simpleInstruction("OP_NIL", offset);
+    case OP_TRUE:
+      return simpleInstruction("OP_TRUE", offset);
+    case OP_FALSE:
+      return simpleInstruction("OP_FALSE", offset);
+    case OP_POP:
+      return simpleInstruction("OP_POP", offset);
+    case OP_GET_LOCAL:
+      return byteInstruction("OP_GET_LOCAL", chunk, offset);
+    case OP_SET_LOCAL:
+      return byteInstruction("OP_SET_LOCAL", chunk, offset);
+    case OP_GET_GLOBAL:
+      return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+    case OP_DEFINE_GLOBAL:
+      return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+    case OP_SET_GLOBAL:
+      return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+    case OP_GET_UPVALUE:
+      return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+    case OP_SET_UPVALUE:
+      return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+    case OP_EQUAL:
+      return simpleInstruction("OP_EQUAL", offset);
+    case OP_GREATER:
+      return simpleInstruction("OP_GREATER", offset);
+    case OP_LESS:
+      return simpleInstruction("OP_LESS", offset);
+    case OP_ADD:
+      return simpleInstruction("OP_ADD", offset);
+    case OP_SUBTRACT:
+      return simpleInstruction("OP_SUBTRACT", offset);
+    case OP_MULTIPLY:
+      return simpleInstruction("OP_MULTIPLY", offset);
+    case OP_DIVIDE:
+      return simpleInstruction("OP_DIVIDE", offset);
+    case OP_NOT:
+      return simpleInstruction("OP_NOT", offset);
+    case OP_NEGATE:
+      return simpleInstruction("OP_NEGATE", offset);
+    case OP_PRINT:
+      return simpleInstruction("OP_PRINT", offset);
+    case OP_JUMP:
+      return jumpInstruction("OP_JUMP", 1, chunk, offset);
+    case OP_JUMP_IF_FALSE:
+      return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+    case OP_LOOP:
+      return jumpInstruction("OP_LOOP", -1, chunk, offset);
+    case OP_CALL:
+      return byteInstruction("OP_CALL", chunk, offset);
+    case OP_CLOSURE:
+      return closureInstruction("OP_CLOSURE", chunk, offset, 0);
+    case OP_CLOSE_UPVALUE:
+      return simpleInstruction("OP_CLOSE_UPVALUE", offset);
     case OP_RETURN:
       return simpleInstruction("OP_RETURN", offset);
+    case OP_JUMP_IF_TRUE:
+      return jumpInstruction("OP_JUMP_IF_TRUE", 1, chunk, offset);
+    case OP_GET_LOCAL_CONSTANT_ADD:
+      return localConstantInstruction(
+        "OP_GET_LOCAL_CONSTANT_ADD", chunk, offset);
+    case OP_GET_LOCAL_GET_LOCAL_ADD:
+      return twoLocalInstruction("OP_GET_LOCAL_GET_LOCAL_ADD", chunk, offset);
+    case OP_GET_LOCAL_GET_LOCAL:
+      return twoLocalInstruction("OP_GET_LOCAL_GET_LOCAL", chunk, offset);
+    case OP_GET_LOCAL_CONSTANT:
+      return localConstantInstruction("OP_GET_LOCAL_CONSTANT", chunk, offset);
+    case OP_SET_LOCAL_POP:
+      return byteInstruction("OP_SET_LOCAL_POP", chunk, offset);
+    case OP_LESS_JUMP_IF_FALSE:
+      return jumpInstruction("OP_LESS_JUMP_IF_FALSE", 1, chunk, offset);
     default:
       printf("Unknown opcode %d\n", instruction);
       return offset + 1;
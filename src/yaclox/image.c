@@ -0,0 +1,569 @@
+// mmap() and friends are POSIX, not C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "image.h"
+#include "memory.h"
+#include "table.h"
+#include "verifier.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Image layout, every integer little-endian:
+ *
+ *   "YACL" u16 version u16 0
+ *   u32 stringCount     { u32 length, bytes }
+ *   u32 functionCount   { function }, the script first
+ *
+ * function:
+ *   u32 name (string index + 1, 0 for the script) u16 arity u16 upvalueCount
+ *   u8 format u16 frameSize
+ *   u32 codeSize        bytes
+ *   u32 runCount        { u32 line, u32 count }, the line table run-length
+ *                       encoded
+ *   u32 constantCount   { u8 tag, payload }
+ *
+ * The code bytes are used in place from the mapped file.
+ */
+
+static const char IMAGE_MAGIC[4] = {'Y', 'A', 'C', 'L'};
+
+typedef enum
+{
+  CONST_NIL,
+  CONST_FALSE,
+  CONST_TRUE,
+  CONST_NUMBER,    // u64 bits of the double
+  CONST_STRING,    // u32 string index
+  CONST_FUNCTION,  // u32 function index
+} ConstantTag;
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct
+{
+  FILE* file;
+  ObjFunction** functions;
+  int functionCount;
+  int functionCapacity;
+  ObjString** strings;
+  int stringCount;
+  int stringCapacity;
+  Table stringIndex;  // string -> index in strings
+} Writer;
+
+/*---------------------------------------------------------------------------*/
+
+static void writeU8(Writer* w, uint8_t value)
+{
+  fputc(value, w->file);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void writeU16(Writer* w, uint16_t value)
+{
+  writeU8(w, (uint8_t)(value & 0xff));
+  writeU8(w, (uint8_t)(value >> 8));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void writeU32(Writer* w, uint32_t value)
+{
+  writeU16(w, (uint16_t)(value & 0xffff));
+  writeU16(w, (uint16_t)(value >> 16));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void writeU64(Writer* w, uint64_t value)
+{
+  writeU32(w, (uint32_t)(value & 0xffffffff));
+  writeU32(w, (uint32_t)(value >> 32));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void addString(Writer* w, ObjString* string)
+{
+  Value index;
+  if ( tableGet(&w->stringIndex, string, &index) ) return;
+
+  if ( w->stringCapacity < w->stringCount + 1 ) {
+    int oldCapacity = w->stringCapacity;
+    w->stringCapacity = GROW_CAPACITY(oldCapacity);
+    w->strings =
+      GROW_ARRAY(ObjString*, w->strings, oldCapacity, w->stringCapacity);
+  }
+  tableSet(&w->stringIndex, string, NUMBER_VAL(w->stringCount));
+  w->strings[w->stringCount++] = string;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Number every function and string reachable from a function, the function
+ * itself first.
+ */
+static void collect(Writer* w, ObjFunction* function)
+{
+  if ( w->functionCapacity < w->functionCount + 1 ) {
+    int oldCapacity = w->functionCapacity;
+    w->functionCapacity = GROW_CAPACITY(oldCapacity);
+    w->functions =
+      GROW_ARRAY(ObjFunction*, w->functions, oldCapacity, w->functionCapacity);
+  }
+  w->functions[w->functionCount++] = function;
+
+  if ( function->name != NULL ) addString(w, function->name);
+
+  ValueArray* constants = &function->chunk.constants;
+  for ( int i = 0; i < constants->size; i++ ) {
+    Value value = constants->values[i];
+    if ( IS_STRING(value) ) {
+      addString(w, AS_STRING(value));
+    } else if ( IS_FUNCTION(value) ) {
+      collect(w, AS_FUNCTION(value));
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint32_t stringIndex(Writer* w, ObjString* string)
+{
+  Value index = NIL_VAL;
+  tableGet(&w->stringIndex, string, &index);
+  return (uint32_t)AS_NUMBER(index);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint32_t functionIndex(Writer* w, ObjFunction* function)
+{
+  // Scripts have few functions, a linear search is fine
+  int i = 0;
+  while ( w->functions[i] != function ) i++;
+  return (uint32_t)i;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void writeConstant(Writer* w, Value value)
+{
+  if ( IS_NIL(value) ) {
+    writeU8(w, CONST_NIL);
+  } else if ( IS_BOOL(value) ) {
+    writeU8(w, AS_BOOL(value) ? CONST_TRUE : CONST_FALSE);
+  } else if ( IS_NUMBER(value) ) {
+    double number = AS_NUMBER(value);
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    writeU8(w, CONST_NUMBER);
+    writeU64(w, bits);
+  } else if ( IS_STRING(value) ) {
+    writeU8(w, CONST_STRING);
+    writeU32(w, stringIndex(w, AS_STRING(value)));
+  } else {
+    writeU8(w, CONST_FUNCTION);
+    writeU32(w, functionIndex(w, AS_FUNCTION(value)));
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void writeFunction(Writer* w, ObjFunction* function)
+{
+  Chunk* chunk = &function->chunk;
+
+  writeU32(w, function->name == NULL ? 0 : stringIndex(w, function->name) + 1);
+  writeU16(w, (uint16_t)function->arity);
+  writeU16(w, (uint16_t)function->upvalueCount);
+  writeU8(w, (uint8_t)chunk->format);
+  writeU16(w, (uint16_t)chunk->frameSize);
+
+  writeU32(w, (uint32_t)chunk->size);
+  fwrite(chunk->code, sizeof(uint8_t), (size_t)chunk->size, w->file);
+
+  uint32_t runCount = 0;
+  for ( int i = 0; i < chunk->size; i++ ) {
+    if ( i == 0 || chunk->lines[i] != chunk->lines[i - 1] ) runCount++;
+  }
+  writeU32(w, runCount);
+  for ( int start = 0; start < chunk->size; ) {
+    int end = start;
+    while ( end < chunk->size && chunk->lines[end] == chunk->lines[start] ) {
+      end++;
+    }
+    writeU32(w, (uint32_t)chunk->lines[start]);
+    writeU32(w, (uint32_t)(end - start));
+    start = end;
+  }
+
+  writeU32(w, (uint32_t)chunk->constants.size);
+  for ( int i = 0; i < chunk->constants.size; i++ ) {
+    writeConstant(w, chunk->constants.values[i]);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool writeImage(ObjFunction* function, const char* path)
+{
+  FILE* file = fopen(path, "wb");
+  if ( file == NULL ) return false;
+
+  // Growing the writer's arrays may start a collection
+  push(OBJ_VAL(function));
+
+  Writer w;
+  w.file = file;
+  w.functions = NULL;
+  w.functionCount = 0;
+  w.functionCapacity = 0;
+  w.strings = NULL;
+  w.stringCount = 0;
+  w.stringCapacity = 0;
+  initTable(&w.stringIndex);
+
+  collect(&w, function);
+
+  fwrite(IMAGE_MAGIC, sizeof(char), sizeof(IMAGE_MAGIC), file);
+  writeU16(&w, IMAGE_VERSION);
+  writeU16(&w, 0);
+
+  writeU32(&w, (uint32_t)w.stringCount);
+  for ( int i = 0; i < w.stringCount; i++ ) {
+    writeU32(&w, (uint32_t)w.strings[i]->length);
+    fwrite(w.strings[i]->chars, sizeof(char), (size_t)w.strings[i]->length,
+           file);
+  }
+
+  writeU32(&w, (uint32_t)w.functionCount);
+  for ( int i = 0; i < w.functionCount; i++ ) {
+    writeFunction(&w, w.functions[i]);
+  }
+
+  freeTable(&w.stringIndex);
+  FREE_ARRAY(ObjString*, w.strings, w.stringCapacity);
+  FREE_ARRAY(ObjFunction*, w.functions, w.functionCapacity);
+  pop();
+
+  bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool isImage(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if ( file == NULL ) return false;
+
+  char magic[sizeof(IMAGE_MAGIC)];
+  bool result = fread(magic, sizeof(char), sizeof(magic), file) ==
+                  sizeof(magic) &&
+                memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+  fclose(file);
+  return result;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Map a whole file read-only. Without mmap() the file is read into memory
+ * instead.
+ */
+static uint8_t* mapFile(const char* path, size_t* size)
+{
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  if ( fd < 0 ) return NULL;
+
+  struct stat info;
+  if ( fstat(fd, &info) != 0 || info.st_size == 0 ) {
+    close(fd);
+    return NULL;
+  }
+
+  *size = (size_t)info.st_size;
+  void* data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return data == MAP_FAILED ? NULL : (uint8_t*)data;
+#else
+  FILE* file = fopen(path, "rb");
+  if ( file == NULL ) return NULL;
+
+  fseek(file, 0L, SEEK_END);
+  *size = (size_t)ftell(file);
+  rewind(file);
+
+  uint8_t* data = (uint8_t*)malloc(*size);
+  if ( data != NULL && fread(data, 1, *size, file) < *size ) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  return data;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+void unloadImage(void)
+{
+  if ( vm.image == NULL ) return;
+
+#ifndef _WIN32
+  munmap(vm.image, vm.imageSize);
+#else
+  free(vm.image);
+#endif
+  vm.image = NULL;
+  vm.imageSize = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct
+{
+  const uint8_t* current;
+  const uint8_t* end;
+  bool hadError;  // set by any read past the end, which then returns zeroes
+} Reader;
+
+/*---------------------------------------------------------------------------*/
+
+static const uint8_t* readBytes(Reader* r, size_t count)
+{
+  if ( r->hadError || (size_t)(r->end - r->current) < count ) {
+    r->hadError = true;
+    return NULL;
+  }
+
+  const uint8_t* bytes = r->current;
+  r->current += count;
+  return bytes;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static uint32_t readU(Reader* r, int size)
+{
+  const uint8_t* bytes = readBytes(r, (size_t)size);
+  if ( bytes == NULL ) return 0;
+
+  uint32_t value = 0;
+  for ( int i = size - 1; i >= 0; i-- ) value = (value << 8) | bytes[i];
+  return value;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Read a count of items that each take at least minSize bytes, rejecting
+ * counts the rest of the image cannot hold.
+ */
+static int readCount(Reader* r, size_t minSize)
+{
+  uint32_t count = readU(r, 4);
+  if ( count > (size_t)(r->end - r->current) / minSize ) r->hadError = true;
+  return r->hadError ? 0 : (int)count;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Read one constant. Strings and functions are looked up in the table of
+ * every object in the image: the strings first, then the functions.
+ */
+static Value readConstant(Reader* r, ValueArray* objects, int stringCount)
+{
+  uint8_t tag = (uint8_t)readU(r, 1);
+  switch ( tag ) {
+    case CONST_NIL:
+      return NIL_VAL;
+    case CONST_FALSE:
+      return BOOL_VAL(false);
+    case CONST_TRUE:
+      return BOOL_VAL(true);
+    case CONST_NUMBER: {
+      uint64_t bits = readU(r, 4);
+      bits |= (uint64_t)readU(r, 4) << 32;
+      double number;
+      memcpy(&number, &bits, sizeof(number));
+      return NUMBER_VAL(number);
+    }
+    case CONST_STRING:
+    case CONST_FUNCTION: {
+      uint32_t index = readU(r, 4);
+      uint32_t first = tag == CONST_STRING ? 0 : (uint32_t)stringCount;
+      uint32_t last = tag == CONST_STRING ? (uint32_t)stringCount
+                                          : (uint32_t)objects->size;
+      if ( index >= last - first ) break;
+      return objects->values[first + index];
+    }
+  }
+
+  r->hadError = true;
+  return NIL_VAL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void readFunction(Reader* r, ObjFunction* function, ValueArray* objects,
+                         int stringCount)
+{
+  Chunk* chunk = &function->chunk;
+
+  uint32_t name = readU(r, 4);
+  if ( name > (uint32_t)stringCount ) r->hadError = true;
+  if ( name > 0 && !r->hadError ) {
+    function->name = AS_STRING(objects->values[name - 1]);
+    writeBarrier(OBJ_VAL(function->name));
+  }
+  function->arity = (int)readU(r, 2);
+  function->upvalueCount = (int)readU(r, 2);
+  chunk->format = (ChunkFormat)readU(r, 1);
+  chunk->frameSize = (int)readU(r, 2);
+  if ( function->arity > 255 || function->upvalueCount > UINT8_COUNT ||
+       chunk->format > CHUNK_REGISTER ) {
+    r->hadError = true;
+  }
+
+  int size = readCount(r, 1);
+  const uint8_t* code = readBytes(r, (size_t)size);
+  if ( r->hadError || size == 0 ) {
+    r->hadError = true;
+    return;
+  }
+
+  // Only the line table is decoded, the code stays in the mapping
+  chunk->lines = ALLOCATE(int, size);
+  chunk->code = (uint8_t*)code;
+  chunk->size = size;
+  chunk->capacity = size;
+  chunk->mapped = true;
+
+  int runCount = readCount(r, 8);
+  int offset = 0;
+  for ( int i = 0; i < runCount && !r->hadError; i++ ) {
+    int line = (int)readU(r, 4);
+    uint32_t count = readU(r, 4);
+    if ( count > (uint32_t)(size - offset) ) {
+      r->hadError = true;
+      break;
+    }
+    for ( uint32_t j = 0; j < count; j++ ) chunk->lines[offset++] = line;
+  }
+  if ( offset != size ) r->hadError = true;
+
+  int constantCount = readCount(r, 1);
+  for ( int i = 0; i < constantCount && !r->hadError; i++ ) {
+    Value value = readConstant(r, objects, stringCount);
+    if ( !r->hadError ) addConstant(chunk, value);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+ObjFunction* loadImage(const char* path)
+{
+  if ( vm.image != NULL ) {
+    fprintf(stderr, "An image is already loaded.\n");
+    return NULL;
+  }
+
+  size_t size;
+  uint8_t* data = mapFile(path, &size);
+  if ( data == NULL ) {
+    fprintf(stderr, "Could not open image \"%s\".\n", path);
+    return NULL;
+  }
+  vm.image = data;
+  vm.imageSize = size;
+
+  Reader r;
+  r.current = data;
+  r.end = data + size;
+  r.hadError = false;
+
+  const uint8_t* magic = readBytes(&r, sizeof(IMAGE_MAGIC));
+  if ( magic == NULL || memcmp(magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ) {
+    fprintf(stderr, "\"%s\" is not a yaclox image.\n", path);
+    unloadImage();
+    return NULL;
+  }
+
+  uint32_t version = readU(&r, 2);
+  readU(&r, 2);
+  if ( !r.hadError && version != IMAGE_VERSION ) {
+    fprintf(stderr, "Image \"%s\" has version %u, expected %d.\n", path,
+            (unsigned)version, IMAGE_VERSION);
+    unloadImage();
+    return NULL;
+  }
+
+  // Every string and function is kept in the constants of a scratch function
+  // on the stack, so none is collected before the script reaches it
+  ObjFunction* holder = newFunction();
+  push(OBJ_VAL(holder));
+  ValueArray* objects = &holder->chunk.constants;
+
+  int stringCount = readCount(&r, 4);
+  for ( int i = 0; i < stringCount && !r.hadError; i++ ) {
+    int length = readCount(&r, 1);
+    const char* chars = (const char*)readBytes(&r, (size_t)length);
+    if ( !r.hadError ) {
+      addConstant(&holder->chunk, OBJ_VAL(copyString(chars, length)));
+    }
+  }
+
+  // The smallest function has a one byte body, one line run and no constants
+  int functionCount = readCount(&r, 32);
+  if ( functionCount == 0 ) r.hadError = true;
+  for ( int i = 0; i < functionCount && !r.hadError; i++ ) {
+    addConstant(&holder->chunk, OBJ_VAL(newFunction()));
+  }
+
+  for ( int i = 0; i < functionCount && !r.hadError; i++ ) {
+    ObjFunction* function = AS_FUNCTION(objects->values[stringCount + i]);
+    readFunction(&r, function, objects, stringCount);
+
+    // A register function can only call register functions
+    ObjFunction* script = AS_FUNCTION(objects->values[stringCount]);
+    if ( function->chunk.format != script->chunk.format ) r.hadError = true;
+  }
+
+  // The script is called with no arguments and has nothing to capture
+  if ( !r.hadError ) {
+    ObjFunction* script = AS_FUNCTION(objects->values[stringCount]);
+    if ( script->arity != 0 || script->upvalueCount != 0 ) r.hadError = true;
+  }
+
+  // The VM trusts its bytecode, so nothing from the file runs unverified.
+  // Verification also recomputes the frame size of stack chunks.
+  for ( int i = 0; i < functionCount && !r.hadError; i++ ) {
+    ObjFunction* function = AS_FUNCTION(objects->values[stringCount + i]);
+    if ( !verifyFunction(function) ) r.hadError = true;
+  }
+
+  ObjFunction* script = NULL;
+  if ( !r.hadError && r.current == r.end ) {
+    script = AS_FUNCTION(objects->values[stringCount]);
+  } else {
+    // Nothing reads the code of the functions left for the collector
+    fprintf(stderr, "Image \"%s\" is malformed.\n", path);
+    unloadImage();
+  }
+
+  pop();
+  return script;
+}
@@ -0,0 +1,24 @@
+#ifndef clox_image_h
+#define clox_image_h
+
+#include "object.h"
+
+// Bumped whenever the layout or any opcode changes: an image only runs on a
+// VM built with the same instruction set.
+#define IMAGE_VERSION 2
+
+// Write the compiled script and every function nested in it to a bytecode
+// image. Return false if the file cannot be written.
+bool writeImage(ObjFunction* function, const char* path);
+
+// Whether the file starts with the image magic number.
+bool isImage(const char* path);
+
+// Map an image into memory and rebuild its functions, whose code points into
+// the mapping. Return the script function, or NULL after reporting the error.
+// Only one image can be loaded at a time; it stays mapped until freeVM().
+ObjFunction* loadImage(const char* path);
+
+void unloadImage(void);
+
+#endif  // !clox_image_h
@@ -0,0 +1,780 @@
+// mmap() and mprotect() are POSIX, MAP_ANONYMOUS is only in the default set
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include "memory.h"
+#include "table.h"
+#include "verifier.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * A baseline template JIT: each instruction becomes a fixed sequence of
+ * x86-64 instructions. The stack depth before every instruction is known
+ * statically (see stackDepths()), so an operand stack slot is just an offset
+ * from frame->slots, nothing is kept in registers from one instruction to the
+ * next, and the interpreter can take over at any instruction boundary.
+ *
+ * Arithmetic and comparisons check that their operands are numbers. When a
+ * check fails the code leaves before the instruction has changed anything,
+ * and the interpreter executes it instead: strings, runtime errors and so on
+ * are all its business. So are calls, returns and anything else that is not
+ * compiled.
+ */
+
+// x86-64 general purpose registers, in encoding order
+typedef enum
+{
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+} Register;
+
+// What the compiled code keeps in the callee saved registers
+#define SLOTS RBX    // frame->slots
+#define COUNT R12    // instructions executed, added to vm.instructionCount
+#define NIL   R13    // NIL_VAL, FALSE_VAL is the next value up
+#define QUIET R14    // QNAN, to tell numbers from everything else
+#define FALSE R15    // FALSE_VAL, setting the low bit makes TRUE_VAL
+
+// The low nibble of jcc and setcc opcodes
+typedef enum
+{
+  CC_E = 0x4,
+  CC_BE = 0x6,
+  CC_A = 0x7,
+} Condition;
+
+// x86-64 opcodes of the instructions that take a register and a register or
+// memory operand
+#define X86_ADD   0x01
+#define X86_OR    0x09
+#define X86_AND   0x21
+#define X86_SUB   0x29
+#define X86_XOR   0x31
+#define X86_CMP   0x39
+#define X86_STORE 0x89  // mov into the register or memory operand
+#define X86_LOAD  0x8B  // mov from it
+#define X86_LEA   0x8D
+
+// Scalar double instructions: prefix, then 0x0F and the opcode
+#define SSE_MOVSD_LOAD  0xF2, 0x10
+#define SSE_MOVSD_STORE 0xF2, 0x11
+#define SSE_ADDSD       0xF2, 0x58
+#define SSE_MULSD       0xF2, 0x59
+#define SSE_SUBSD       0xF2, 0x5C
+#define SSE_DIVSD       0xF2, 0x5E
+#define SSE_UCOMISD     0x66, 0x2E
+
+// Entered with the frame's slots and the machine code of the instruction to
+// start at; returns the offset of the instruction to resume at, shifted left,
+// with the low bit set if a type guard failed.
+typedef int (*JitEntry)(Value* slots, const uint8_t* start);
+
+/*---------------------------------------------------------------------------*/
+
+// A rel32 operand still to be filled in
+typedef struct
+{
+  int site;    // where the operand is in the machine code
+  int target;  // bytecode offset jumped to, or the stub index
+  bool toStub;
+} Fixup;
+
+// Out of line code that leaves for the interpreter when a guard fails
+typedef struct
+{
+  int offset;  // bytecode offset of the guarded instruction
+  int depth;
+  int start;   // machine code offset, once emitted
+} Stub;
+
+typedef struct
+{
+  uint8_t* code;
+  int size;
+  int capacity;
+  bool hadError;  // out of memory
+
+  int* entries;
+  Fixup* fixups;
+  int fixupCount;
+  Stub* stubs;
+  int stubCount;
+  int epilogue;
+
+  // The instruction being compiled
+  int offset;
+  int depth;
+  int stub;  // its guard stub, -1 until a guard needs one
+} Assembler;
+
+/*---------------------------------------------------------------------------*/
+
+static void emit(Assembler* a, uint8_t byte)
+{
+  if ( a->hadError ) return;
+
+  if ( a->size == a->capacity ) {
+    int capacity = GROW_CAPACITY(a->capacity);
+    uint8_t* code = (uint8_t*)realloc(a->code, (size_t)capacity);
+    if ( code == NULL ) {
+      a->hadError = true;
+      return;
+    }
+    a->code = code;
+    a->capacity = capacity;
+  }
+
+  a->code[a->size++] = byte;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emit32(Assembler* a, uint32_t value)
+{
+  for ( int i = 0; i < 4; i++ ) emit(a, (uint8_t)(value >> (8 * i)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emit64(Assembler* a, uint64_t value)
+{
+  for ( int i = 0; i < 8; i++ ) emit(a, (uint8_t)(value >> (8 * i)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void patch32(Assembler* a, int site, int target)
+{
+  uint32_t relative = (uint32_t)(target - (site + 4));
+  for ( int i = 0; i < 4; i++ ) {
+    a->code[site + i] = (uint8_t)(relative >> (8 * i));
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** REX prefix for an instruction with operands reg and rm, left out when
+ * neither a 64-bit operation nor a high register asks for one.
+ */
+static void emitRex(Assembler* a, bool wide, int reg, int rm)
+{
+  int rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+  if ( rex != 0x40 ) emit(a, (uint8_t)rex);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** ModRM byte for two register operands.
+ */
+static void emitDirect(Assembler* a, int reg, int rm)
+{
+  emit(a, (uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** ModRM byte and displacement for [base + disp]. Only bases that need no SIB
+ * byte (everything but RSP and R12) are ever used.
+ */
+static void emitMemory(Assembler* a, int reg, int base, int disp)
+{
+  emit(a, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+  emit32(a, (uint32_t)disp);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A 64-bit instruction between a register and [base + disp].
+ */
+static void memoryOp(Assembler* a, uint8_t op, int reg, int base, int disp)
+{
+  emitRex(a, true, reg, base);
+  emit(a, op);
+  emitMemory(a, reg, base, disp);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A 64-bit instruction with two register operands: op dst, src.
+ */
+static void registerOp(Assembler* a, uint8_t op, int dst, int src)
+{
+  emitRex(a, true, src, dst);
+  emit(a, op);
+  emitDirect(a, src, dst);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void sseOp(Assembler* a, uint8_t prefix, uint8_t op, int xmm,
+                  int disp)
+{
+  emit(a, prefix);
+  emit(a, 0x0F);
+  emit(a, op);
+  emitMemory(a, xmm, SLOTS, disp);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void moveImmediate(Assembler* a, int reg, uint64_t value)
+{
+  emitRex(a, true, 0, reg);
+  emit(a, (uint8_t)(0xB8 + (reg & 7)));
+  emit64(a, value);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void push64(Assembler* a, int reg)
+{
+  emitRex(a, false, 0, reg);
+  emit(a, (uint8_t)(0x50 + (reg & 7)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void pop64(Assembler* a, int reg)
+{
+  emitRex(a, false, 0, reg);
+  emit(a, (uint8_t)(0x58 + (reg & 7)));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Call a C function. The prologue leaves the stack 16-byte aligned, and
+ * everything the compiled code needs is in callee saved registers.
+ */
+static void callFunction(Assembler* a, uint64_t address)
+{
+  moveImmediate(a, RAX, address);
+  emit(a, 0xFF);
+  emitDirect(a, 2, RAX);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A conditional jump to a bytecode offset, or an unconditional one if cc is
+ * negative.
+ */
+static void jumpTo(Assembler* a, int cc, int target, bool toStub)
+{
+  if ( cc < 0 ) {
+    emit(a, 0xE9);
+  } else {
+    emit(a, 0x0F);
+    emit(a, (uint8_t)(0x80 + cc));
+  }
+
+  Fixup* fixup = &a->fixups[a->fixupCount++];
+  fixup->site = a->size;
+  fixup->target = target;
+  fixup->toStub = toStub;
+  emit32(a, 0);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Leave for the interpreter when cc holds, before the current instruction
+ * has changed anything.
+ */
+static void guard(Assembler* a, Condition cc)
+{
+  if ( a->stub == -1 ) {
+    a->stub = a->stubCount++;
+    a->stubs[a->stub].offset = a->offset;
+    a->stubs[a->stub].depth = a->depth;
+  }
+
+  jumpTo(a, (int)cc, a->stub, true);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Guard that the value in reg is a number.
+ */
+static void guardNumber(Assembler* a, int reg)
+{
+  registerOp(a, X86_STORE, RCX, reg);
+  registerOp(a, X86_AND, RCX, QUIET);
+  registerOp(a, X86_CMP, RCX, QUIET);
+  guard(a, CC_E);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Guard that both stack slots hold numbers.
+ */
+static void guardNumbers(Assembler* a, int left, int right)
+{
+  memoryOp(a, X86_LOAD, RAX, SLOTS, left * 8);
+  guardNumber(a, RAX);
+  memoryOp(a, X86_LOAD, RAX, SLOTS, right * 8);
+  guardNumber(a, RAX);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Count the instruction. Done once its guards have passed and before
+ * anything that sets the flags a branch needs.
+ */
+static void countInstruction(Assembler* a)
+{
+  emitRex(a, true, 0, COUNT);
+  emit(a, 0xFF);
+  emitDirect(a, 0, COUNT);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void copySlot(Assembler* a, int from, int to)
+{
+  memoryOp(a, X86_LOAD, RAX, SLOTS, from * 8);
+  memoryOp(a, X86_STORE, RAX, SLOTS, to * 8);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void storeValue(Assembler* a, int slot, Value value)
+{
+  moveImmediate(a, RAX, value);
+  memoryOp(a, X86_STORE, RAX, SLOTS, slot * 8);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Turn the flag in al into a Value and store it.
+ */
+static void storeBool(Assembler* a, int slot)
+{
+  emit(a, 0x0F);  // movzx eax, al
+  emit(a, 0xB6);
+  emitDirect(a, RAX, RAX);
+  registerOp(a, X86_OR, RAX, FALSE);
+  memoryOp(a, X86_STORE, RAX, SLOTS, slot * 8);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void setIf(Assembler* a, Condition cc)
+{
+  emit(a, 0x0F);
+  emit(a, (uint8_t)(0x90 + cc));
+  emitDirect(a, 0, RAX);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compare the value in rax against nil and false: below or equal means it is
+ * one of them.
+ */
+static void compareFalsey(Assembler* a)
+{
+  registerOp(a, X86_SUB, RAX, NIL);
+  emitRex(a, true, 0, RAX);  // cmp rax, 1
+  emit(a, 0x83);
+  emitDirect(a, 7, RAX);
+  emit(a, 1);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Leave for the interpreter at the current instruction with the stack top
+ * where the interpreter expects it.
+ */
+static void emitExit(Assembler* a, int offset, int depth, bool deopt)
+{
+  memoryOp(a, X86_LEA, RAX, SLOTS, depth * 8);
+  moveImmediate(a, RCX, (uint64_t)(uintptr_t)&vm.stackTop);
+  memoryOp(a, X86_STORE, RAX, RCX, 0);
+  emit(a, 0xB8);  // mov eax, imm32
+  emit32(a, (uint32_t)(offset << 1 | (deopt ? 1 : 0)));
+  emit(a, 0xE9);
+  emit32(a, 0);
+  if ( !a->hadError ) patch32(a, a->size - 4, a->epilogue);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** a op b on the two numbers on top of the stack, leaving the result in
+ * place of a.
+ */
+static void arithmetic(Assembler* a, uint8_t prefix, uint8_t op)
+{
+  int left = a->depth - 2;
+  int right = a->depth - 1;
+  guardNumbers(a, left, right);
+  countInstruction(a);
+  sseOp(a, SSE_MOVSD_LOAD, 0, left * 8);
+  sseOp(a, prefix, op, 0, right * 8);
+  sseOp(a, SSE_MOVSD_STORE, 0, left * 8);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compare the two numbers on top of the stack and store whether a < b (or
+ * a > b) in place of a. Unordered operands, NaN among them, compare false.
+ */
+static void comparison(Assembler* a, bool less)
+{
+  int left = a->depth - 2;
+  int right = a->depth - 1;
+  guardNumbers(a, left, right);
+  countInstruction(a);
+  sseOp(a, SSE_MOVSD_LOAD, 0, (less ? right : left) * 8);
+  sseOp(a, SSE_UCOMISD, 0, (less ? left : right) * 8);
+  setIf(a, CC_A);
+  storeBool(a, left);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int jumpTarget(uint8_t* code, int offset, bool backward)
+{
+  int jump = (code[1] << 8) | code[2];
+  return offset + 3 + (backward ? -jump : jump);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void compileInstruction(Assembler* a, Chunk* chunk)
+{
+  uint8_t* code = &chunk->code[a->offset];
+  Value* constants = chunk->constants.values;
+  int depth = a->depth;
+  int top = depth - 1;
+
+  switch ( code[0] ) {
+    case OP_CONSTANT:
+      countInstruction(a);
+      storeValue(a, depth, constants[code[1]]);
+      break;
+    case OP_NIL:
+      countInstruction(a);
+      storeValue(a, depth, NIL_VAL);
+      break;
+    case OP_TRUE:
+      countInstruction(a);
+      storeValue(a, depth, TRUE_VAL);
+      break;
+    case OP_FALSE:
+      countInstruction(a);
+      storeValue(a, depth, FALSE_VAL);
+      break;
+    case OP_POP:
+      countInstruction(a);
+      break;
+    case OP_GET_LOCAL:
+      countInstruction(a);
+      copySlot(a, code[1], depth);
+      break;
+    case OP_SET_LOCAL:
+      countInstruction(a);
+      copySlot(a, top, code[1]);
+      break;
+    case OP_GET_GLOBAL: {
+      // Looked up straight into the new stack slot
+      moveImmediate(a, RDI, (uint64_t)(uintptr_t)&vm.globals);
+      moveImmediate(a, RSI, (uint64_t)(uintptr_t)AS_OBJ(constants[code[1]]));
+      memoryOp(a, X86_LEA, RDX, SLOTS, depth * 8);
+      callFunction(a, (uint64_t)(uintptr_t)tableGet);
+      emit(a, 0x84);  // test al, al
+      emitDirect(a, RAX, RAX);
+      guard(a, CC_E);
+      countInstruction(a);
+      break;
+    }
+    case OP_GET_UPVALUE: {
+      // Slot zero holds the running closure
+      countInstruction(a);
+      memoryOp(a, X86_LOAD, RAX, SLOTS, 0);
+      moveImmediate(a, RCX, ~(SIGN_BIT | QNAN));
+      registerOp(a, X86_AND, RAX, RCX);
+      memoryOp(a, X86_LOAD, RAX, RAX, (int)offsetof(ObjClosure, upvalues));
+      memoryOp(a, X86_LOAD, RAX, RAX, code[1] * 8);
+      memoryOp(a, X86_LOAD, RAX, RAX, (int)offsetof(ObjUpvalue, location));
+      memoryOp(a, X86_LOAD, RAX, RAX, 0);
+      memoryOp(a, X86_STORE, RAX, SLOTS, depth * 8);
+      break;
+    }
+    case OP_EQUAL:
+      countInstruction(a);
+      memoryOp(a, X86_LOAD, RDI, SLOTS, (top - 1) * 8);
+      memoryOp(a, X86_LOAD, RSI, SLOTS, top * 8);
+      callFunction(a, (uint64_t)(uintptr_t)valuesEqual);
+      storeBool(a, top - 1);
+      break;
+    case OP_GREATER:
+      comparison(a, false);
+      break;
+    case OP_LESS:
+      comparison(a, true);
+      break;
+    case OP_ADD:
+      arithmetic(a, SSE_ADDSD);
+      break;
+    case OP_SUBTRACT:
+      arithmetic(a, SSE_SUBSD);
+      break;
+    case OP_MULTIPLY:
+      arithmetic(a, SSE_MULSD);
+      break;
+    case OP_DIVIDE:
+      arithmetic(a, SSE_DIVSD);
+      break;
+    case OP_NOT:
+      countInstruction(a);
+      memoryOp(a, X86_LOAD, RAX, SLOTS, top * 8);
+      compareFalsey(a);
+      setIf(a, CC_BE);
+      storeBool(a, top);
+      break;
+    case OP_NEGATE:
+      memoryOp(a, X86_LOAD, RAX, SLOTS, top * 8);
+      guardNumber(a, RAX);
+      countInstruction(a);
+      moveImmediate(a, RCX, SIGN_BIT);
+      registerOp(a, X86_XOR, RAX, RCX);
+      memoryOp(a, X86_STORE, RAX, SLOTS, top * 8);
+      break;
+    case OP_JUMP:
+      countInstruction(a);
+      jumpTo(a, -1, jumpTarget(code, a->offset, false), false);
+      break;
+    case OP_LOOP:
+      countInstruction(a);
+      jumpTo(a, -1, jumpTarget(code, a->offset, true), false);
+      break;
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+      countInstruction(a);
+      memoryOp(a, X86_LOAD, RAX, SLOTS, top * 8);
+      compareFalsey(a);
+      jumpTo(a, code[0] == OP_JUMP_IF_FALSE ? CC_BE : CC_A,
+             jumpTarget(code, a->offset, false), false);
+      break;
+    case OP_GET_LOCAL_CONSTANT_ADD: {
+      Value constant = constants[code[2]];
+      if ( !IS_NUMBER(constant) ) {
+        emitExit(a, a->offset, depth, false);
+        break;
+      }
+      memoryOp(a, X86_LOAD, RAX, SLOTS, code[1] * 8);
+      guardNumber(a, RAX);
+      countInstruction(a);
+      storeValue(a, depth, constant);
+      sseOp(a, SSE_MOVSD_LOAD, 0, code[1] * 8);
+      sseOp(a, SSE_ADDSD, 0, depth * 8);
+      sseOp(a, SSE_MOVSD_STORE, 0, depth * 8);
+      break;
+    }
+    case OP_GET_LOCAL_GET_LOCAL_ADD:
+      guardNumbers(a, code[1], code[2]);
+      countInstruction(a);
+      sseOp(a, SSE_MOVSD_LOAD, 0, code[1] * 8);
+      sseOp(a, SSE_ADDSD, 0, code[2] * 8);
+      sseOp(a, SSE_MOVSD_STORE, 0, depth * 8);
+      break;
+    case OP_GET_LOCAL_GET_LOCAL:
+      countInstruction(a);
+      copySlot(a, code[1], depth);
+      copySlot(a, code[2], depth + 1);
+      break;
+    case OP_GET_LOCAL_CONSTANT:
+      countInstruction(a);
+      copySlot(a, code[1], depth);
+      storeValue(a, depth + 1, constants[code[2]]);
+      break;
+    case OP_SET_LOCAL_POP:
+      countInstruction(a);
+      copySlot(a, top, code[1]);
+      break;
+    case OP_LESS_JUMP_IF_FALSE:
+      comparison(a, true);
+      // rax still holds the Value just stored
+      registerOp(a, X86_CMP, RAX, FALSE);
+      jumpTo(a, CC_E, jumpTarget(code, a->offset, false), false);
+      break;
+    default:
+      // Calls, returns, globals that change and everything else that needs
+      // the interpreter
+      emitExit(a, a->offset, depth, false);
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Enter at the machine code for one instruction: save the callee saved
+ * registers and load the ones the compiled code relies on.
+ */
+static void emitPrologue(Assembler* a)
+{
+  push64(a, RBX);
+  push64(a, R12);
+  push64(a, R13);
+  push64(a, R14);
+  push64(a, R15);
+  registerOp(a, X86_STORE, SLOTS, RDI);
+  emitRex(a, false, COUNT, COUNT);  // xor r12d, r12d
+  emit(a, 0x31);
+  emitDirect(a, COUNT, COUNT);
+  moveImmediate(a, NIL, NIL_VAL);
+  moveImmediate(a, QUIET, QNAN);
+  moveImmediate(a, FALSE, FALSE_VAL);
+  emit(a, 0xFF);  // jmp rsi
+  emitDirect(a, 4, RSI);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitEpilogue(Assembler* a)
+{
+  a->epilogue = a->size;
+  moveImmediate(a, RCX, (uint64_t)(uintptr_t)&vm.instructionCount);
+  memoryOp(a, X86_ADD, COUNT, RCX, 0);
+  pop64(a, R15);
+  pop64(a, R14);
+  pop64(a, R13);
+  pop64(a, R12);
+  pop64(a, RBX);
+  emit(a, 0xC3);  // ret
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Copy the finished code into pages of its own, which are made executable
+ * once they are no longer writable.
+ */
+static uint8_t* mapCode(Assembler* a)
+{
+  void* pages = mmap(NULL, (size_t)a->size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ( pages == MAP_FAILED ) return NULL;
+
+  memcpy(pages, a->code, (size_t)a->size);
+  if ( mprotect(pages, (size_t)a->size, PROT_READ | PROT_EXEC) != 0 ) {
+    munmap(pages, (size_t)a->size);
+    return NULL;
+  }
+
+  return (uint8_t*)pages;
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool compileJit(ObjFunction* function)
+{
+  Chunk* chunk = &function->chunk;
+  size_t size = (size_t)chunk->size;
+
+  Assembler a;
+  a.code = NULL;
+  a.size = 0;
+  a.capacity = 0;
+  a.hadError = false;
+  a.entries = (int*)malloc(sizeof(int) * size);
+  // No instruction needs more than four jumps, or more than one stub
+  a.fixups = (Fixup*)malloc(sizeof(Fixup) * 4 * size);
+  a.fixupCount = 0;
+  a.stubs = (Stub*)malloc(sizeof(Stub) * size);
+  a.stubCount = 0;
+
+  int* depths = (int*)malloc(sizeof(int) * size);
+  bool ok = a.entries != NULL && a.fixups != NULL && a.stubs != NULL &&
+            depths != NULL && stackDepths(function, depths);
+
+  if ( ok ) {
+    for ( int i = 0; i < chunk->size; i++ ) a.entries[i] = -1;
+    emitPrologue(&a);
+    emitEpilogue(&a);
+
+    for ( int offset = 0; offset < chunk->size;
+          offset += instructionLength(chunk, offset) ) {
+      if ( depths[offset] == -1 ) continue;  // unreachable
+
+      a.entries[offset] = a.size;
+      a.offset = offset;
+      a.depth = depths[offset];
+      a.stub = -1;
+      compileInstruction(&a, chunk);
+    }
+
+    for ( int i = 0; i < a.stubCount; i++ ) {
+      a.stubs[i].start = a.size;
+      emitExit(&a, a.stubs[i].offset, a.stubs[i].depth, true);
+    }
+
+    ok = !a.hadError;
+  }
+
+  if ( ok ) {
+    for ( int i = 0; i < a.fixupCount; i++ ) {
+      Fixup* fixup = &a.fixups[i];
+      int target = fixup->toStub ? a.stubs[fixup->target].start
+                                 : a.entries[fixup->target];
+      patch32(&a, fixup->site, target);
+    }
+  }
+
+  uint8_t* code = ok ? mapCode(&a) : NULL;
+  if ( code != NULL ) {
+    JitCode* jit = (JitCode*)malloc(sizeof(JitCode));
+    if ( jit != NULL ) {
+      jit->code = code;
+      jit->size = (size_t)a.size;
+      jit->entries = a.entries;
+      jit->entryCount = chunk->size;
+      jit->deopts = 0;
+      chunk->jit = jit;
+      a.entries = NULL;
+    } else {
+      munmap(code, (size_t)a.size);
+    }
+  }
+
+  free(depths);
+  free(a.stubs);
+  free(a.fixups);
+  free(a.entries);
+  free(a.code);
+  return chunk->jit != NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void runJit(CallFrame* frame)
+{
+  Chunk* chunk = &frame->closure->function->chunk;
+  JitCode* jit = chunk->jit;
+  int start = jit->entries[frame->ip - chunk->code];
+  if ( start == -1 ) return;
+
+  // C99 has no conversion from an object pointer to a function pointer
+  JitEntry enter;
+  memcpy(&enter, &jit->code, sizeof(enter));
+
+  int exit = enter(frame->slots, jit->code + start);
+  frame->ip = chunk->code + (exit >> 1);
+
+  if ( (exit & 1) != 0 && ++jit->deopts > JIT_MAX_DEOPTS ) {
+    // The guards keep failing, so the interpreter runs this function better
+    freeJit(jit);
+    chunk->jit = NULL;
+    chunk->hotness = -1;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void freeJit(JitCode* jit)
+{
+  if ( jit == NULL ) return;
+
+  munmap(jit->code, jit->size);
+  free(jit->entries);
+  free(jit);
+}
@@ -0,0 +1,37 @@
+#ifndef clox_jit_h
+#define clox_jit_h
+
+#include "vm.h"
+
+// Calls plus loop iterations before a function is compiled
+#define JIT_THRESHOLD 1000
+
+// Type guard failures a function survives before its machine code is thrown
+// away for good
+#define JIT_MAX_DEOPTS 100
+
+// Machine code for one stack chunk. Every operand stack slot lives at a fixed
+// place in the frame, so the code can be entered at any instruction and left
+// at any instruction with nothing but the frame to hand back.
+struct JitCode
+{
+  uint8_t* code;  // mapped executable pages
+  size_t size;
+  int* entries;   // machine code offset of each instruction, -1 elsewhere
+  int entryCount;
+  int deopts;     // type guard failures so far
+};
+
+// Translate a stack function to x86-64 machine code. Return false, and leave
+// the function to the interpreter, if it cannot be compiled.
+bool compileJit(ObjFunction* function);
+
+// Run the frame's machine code from the frame's ip up to the first
+// instruction the interpreter has to execute, which is where ip and the
+// stack top are left. Instructions the machine code does not implement,
+// calls and returns among them, and failed type guards end up there.
+void runJit(CallFrame* frame);
+
+void freeJit(JitCode* jit);
+
+#endif  // !clox_jit_h
@@ -1,26 +1,186 @@
 #include "common.h"
-#include "chunk.h"
-#include "debug.h"
+#include "compiler.h"
+#include "image.h"
+#include "pool.h"
+#include "profiler.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+
+static void repl(void)
+{
+  char line[1024];
+  for ( ;; ) {
+    printf("> ");
+
+    if ( !fgets(line, sizeof(line), stdin) ) {
+      printf("\n");
+      break;
+    }
+
+    interpret(line);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static char* readFile(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if ( file == NULL ) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    exit(74);
+  }
+
+  fseek(file, 0L, SEEK_END);
+  size_t fileSize = (size_t)ftell(file);
+  rewind(file);
+
+  char* buffer = (char*)malloc(fileSize + 1);
+  if ( buffer == NULL ) {
+    fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+    exit(74);
+  }
+
+  size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+  if ( bytesRead < fileSize ) {
+    fprintf(stderr, "Could not read file \"%s\".\n", path);
+    exit(74);
+  }
+
+  buffer[bytesRead] = '\0';
+
+  fclose(file);
+  return buffer;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static InterpretResult runFile(const char* path)
+{
+  if ( isImage(path) ) {
+    ObjFunction* function = loadImage(path);
+    if ( function == NULL ) exit(74);
+
+    vm.backend = function->chunk.format == CHUNK_REGISTER ? BACKEND_REGISTER
+                                                          : BACKEND_STACK;
+    return interpretFunction(function);
+  }
+
+  char* source = readFile(path);
+  InterpretResult result = interpret(source);
+  free(source);
+  return result;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile a script into a bytecode image without running it.
+ */
+static void compileFile(const char* path, const char* imagePath)
+{
+  char* source = readFile(path);
+  ObjFunction* function = compile(source);
+  free(source);
+  if ( function == NULL ) exit(65);
+
+  if ( !writeImage(function, imagePath) ) {
+    fprintf(stderr, "Could not write image \"%s\".\n", imagePath);
+    exit(74);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: yaclox [--register] [--stats] [--pool-stats] "
+                  "[--profile] [--compile image] [path]\n");
+  exit(64);
+}
 
 /*---------------------------------------------------------------------------*/
 
 int main(int argc, const char* argv[])
 {
-  Chunk chunk;
-  initChunk(&chunk);
+  bool poolStats = false;
+  bool runStats = false;
+  bool profile = false;
+  Backend backend = BACKEND_STACK;
+  const char* imagePath = NULL;
+  const char* path = NULL;
+
+  for ( int i = 1; i < argc; i++ ) {
+    if ( strcmp(argv[i], "--pool-stats") == 0 ) {
+      poolStats = true;
+    } else if ( strcmp(argv[i], "--stats") == 0 ) {
+      runStats = true;
+    } else if ( strcmp(argv[i], "--profile") == 0 ) {
+      profile = true;
+    } else if ( strcmp(argv[i], "--register") == 0 ) {
+      backend = BACKEND_REGISTER;
+    } else if ( strcmp(argv[i], "--compile") == 0 && i + 1 < argc ) {
+      imagePath = argv[++i];
+    } else if ( path == NULL ) {
+      path = argv[i];
+    } else {
+      usage();
+    }
+  }
+
+  initVM();
+  vm.backend = backend;
+
+  if ( imagePath != NULL ) {
+    if ( path == NULL ) usage();
+    compileFile(path, imagePath);
+    freeVM();
+    return 0;
+  }
+
+#ifdef PROFILER
+  if ( profile ) startProfiler();
+#else
+  if ( profile ) fprintf(stderr, "yaclox was built without the profiler.\n");
+#endif
+
+  clock_t start = clock();
+  InterpretResult result = INTERPRET_OK;
+  if ( path == NULL ) {
+    repl();
+  } else {
+    result = runFile(path);
+  }
 
-  // Add a constant to the chunk's constant pool
-  int constant = addConstant(&chunk, 1.2);
-  appendChunk(&chunk, OP_CONSTANT, 123);
+  if ( runStats ) {
+    fprintf(stderr, "%s backend: %llu instructions, %.3f s\n",
+            vm.backend == BACKEND_REGISTER ? "register" : "stack",
+            (unsigned long long)vm.instructionCount,
+            (double)(clock() - start) / CLOCKS_PER_SEC);
+  }
 
-  // Write the one-byte constant index operand
-  appendChunk(&chunk, (uint8_t)constant, 123);
+#ifdef PROFILER
+  if ( profile ) {
+    stopProfiler();
+    printProfile();
+  }
+#endif
 
-  appendChunk(&chunk, OP_RETURN, 123);
+#ifdef POOL_ALLOCATOR
+  if ( poolStats ) printPoolStats();
+#else
+  (void)poolStats;
+#endif
 
-  disassembleChunk(&chunk, "test chunk");
+  freeVM();
 
-  freeChunk(&chunk);
+  if ( result == INTERPRET_COMPILE_ERROR ) exit(65);
+  if ( result == INTERPRET_RUNTIME_ERROR ) exit(70);
 
   return 0;
 }
@@ -1,7 +1,25 @@
 #include "memory.h"
+#include "compiler.h"
+#include "object.h"
+#include "pool.h"
+#include "vm.h"
 
 #include <stdlib.h>
 
+#ifdef DEBUG_LOG_GC
+#include <stdio.h>
+#endif
+
+// The heap may grow to this factor of the live size before the next cycle
+#define GC_HEAP_GROW_FACTOR 2
+
+// Objects traced or swept per incremental step. A step runs on each growing
+// allocation while a cycle is in progress, so this bounds the pause.
+#define GC_STEP_WORK 64
+
+static void gcStep(void);
+static void startCycle(void);
+
 /*---------------------------------------------------------------------------*/
 
 /* The single function used for memory management.
@@ -13,9 +31,31 @@
   | Non‑zero | Smaller than oldSize | Shrink existing allocation. |
   | Non‑zero | Larger than oldSize  | Grow existing allocation.   |
   | cmp A, B | a                    | A > B (unsigned)            |
+
+  Every call is accounted in vm.bytesAllocated, and growing allocations are
+  what drives the incremental collector forward. Small blocks come from the
+  size class pool when POOL_ALLOCATOR is enabled.
  */
 void* reallocate(void* ptr, size_t oldSize, size_t newSize)
 {
+  vm.bytesAllocated += newSize - oldSize;
+
+  if ( newSize > oldSize ) {
+#ifdef DEBUG_STRESS_GC
+    collectGarbage();
+#else
+    if ( vm.gcPhase != GC_IDLE ) {
+      gcStep();
+    } else if ( vm.bytesAllocated > vm.nextGC ) {
+      startCycle();
+      gcStep();
+    }
+#endif
+  }
+
+#ifdef POOL_ALLOCATOR
+  return poolReallocate(ptr, oldSize, newSize);
+#else
   if ( newSize == 0 ) {
     free(ptr);
     return NULL;
@@ -26,4 +66,264 @@ void* reallocate(void* ptr, size_t oldSize, size_t newSize)
     exit(1);
   }
   return res;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Shade a white object gray by marking it and pushing it on the worklist.
+ *
+ * Gray objects are reached but not yet traced. The gray stack is allocated
+ * with the system allocator so that growing it cannot recurse into the GC.
+ */
+void markObject(Obj* object)
+{
+  if ( object == NULL ) return;
+  if ( isMarked(object) ) return;
+
+#ifdef DEBUG_LOG_GC
+  printf("%p mark ", (void*)object);
+  printValue(OBJ_VAL(object));
+  printf("\n");
+#endif
+
+  object->mark = vm.currentMark;
+
+  if ( vm.grayCapacity < vm.grayCount + 1 ) {
+    vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
+    vm.grayStack = (Obj**)realloc(
+      vm.grayStack, sizeof(Obj*) * (size_t)vm.grayCapacity);
+    if ( vm.grayStack == NULL ) exit(1);
+  }
+
+  vm.grayStack[vm.grayCount++] = object;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void markValue(Value value)
+{
+  if ( IS_OBJ(value) ) markObject(AS_OBJ(value));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void markArray(ValueArray* array)
+{
+  for ( int i = 0; i < array->size; i++ ) {
+    markValue(array->values[i]);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Turn a gray object black by marking everything it references.
+ */
+static void blackenObject(Obj* object)
+{
+#ifdef DEBUG_LOG_GC
+  printf("%p blacken ", (void*)object);
+  printValue(OBJ_VAL(object));
+  printf("\n");
+#endif
+
+  switch ( object->type ) {
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      markObject((Obj*)closure->function);
+      for ( int i = 0; i < closure->upvalueCount; i++ ) {
+        markObject((Obj*)closure->upvalues[i]);
+      }
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      markObject((Obj*)function->name);
+      markArray(&function->chunk.constants);
+      break;
+    }
+    case OBJ_UPVALUE:
+      // An open upvalue's slot is a root already
+      markValue(((ObjUpvalue*)object)->closed);
+      break;
+    case OBJ_NATIVE:
+    case OBJ_STRING:
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void freeObject(Obj* object)
+{
+#ifdef DEBUG_LOG_GC
+  printf("%p free type %d\n", (void*)object, object->type);
+#endif
+
+  switch ( object->type ) {
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
+      FREE(ObjClosure, object);
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      freeChunk(&function->chunk);
+      FREE(ObjFunction, object);
+      break;
+    }
+    case OBJ_NATIVE:
+      FREE(ObjNative, object);
+      break;
+    case OBJ_STRING: {
+      ObjString* string = (ObjString*)object;
+      FREE_ARRAY(char, string->chars, string->length + 1);
+      FREE(ObjString, object);
+      break;
+    }
+    case OBJ_UPVALUE:
+      FREE(ObjUpvalue, object);
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Mark everything the VM can reach directly.
+ */
+static void markRoots(void)
+{
+  for ( Value* slot = vm.stack; slot < vm.stackTop; slot++ ) {
+    markValue(*slot);
+  }
+
+  for ( int i = 0; i < vm.frameCount; i++ ) {
+    markObject((Obj*)vm.frames[i].closure);
+  }
+
+  for ( ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL;
+        upvalue = upvalue->next ) {
+    markObject((Obj*)upvalue);
+  }
+
+  markTable(&vm.globals);
+  markCompilerRoots();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Start a new cycle.
+ *
+ * Flipping the current mark turns every object white at once, without walking
+ * the heap. New objects get the current mark, so they are born black.
+ */
+static void startCycle(void)
+{
+#ifdef DEBUG_LOG_GC
+  printf("-- gc begin (%zu bytes)\n", vm.bytesAllocated);
+#endif
+
+  vm.currentMark = !vm.currentMark;
+  vm.gcPhase = GC_MARK;
+  markRoots();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Finish marking once the roots hold nothing left to trace.
+ *
+ * The mutator writes to the stack and to the VM tables without a barrier, so
+ * the roots are scanned again when the gray worklist runs out. If that finds
+ * new gray objects, they are traced a few at a time like the others and the
+ * roots are scanned once more after them. Each scan only grays objects that
+ * were white, so this ends, and no pause is longer than one scan of the roots.
+ */
+static void remark(void)
+{
+  markRoots();
+  if ( vm.grayCount > 0 ) return;
+
+  vm.gcPhase = GC_SWEEP_STRINGS;
+  vm.sweepString = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Do a bounded amount of marking or sweeping work.
+ */
+static void gcStep(void)
+{
+  int work = GC_STEP_WORK;
+
+  if ( vm.gcPhase == GC_MARK ) {
+    while ( vm.grayCount > 0 && work-- > 0 ) {
+      blackenObject(vm.grayStack[--vm.grayCount]);
+    }
+    if ( vm.grayCount == 0 ) remark();
+    return;
+  }
+
+  // Interned strings are weak references, so the dead ones leave the table
+  // before any object is freed. Until then they are skipped by lookups.
+  if ( vm.gcPhase == GC_SWEEP_STRINGS ) {
+    vm.sweepString = tableRemoveWhite(&vm.strings, vm.sweepString, work);
+    if ( vm.sweepString >= vm.strings.capacity ) {
+      vm.gcPhase = GC_SWEEP;
+      vm.sweepLink = &vm.objects;
+    }
+    return;
+  }
+
+  // Objects allocated since the sweep started sit in front of sweepLink and
+  // are black anyway, so they are never visited here.
+  while ( *vm.sweepLink != NULL && work-- > 0 ) {
+    Obj* object = *vm.sweepLink;
+    if ( isMarked(object) ) {
+      vm.sweepLink = &object->next;
+    } else {
+      *vm.sweepLink = object->next;
+      freeObject(object);
+    }
+  }
+
+  if ( *vm.sweepLink == NULL ) {
+    vm.gcPhase = GC_IDLE;
+    vm.sweepLink = NULL;
+    vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc end (%zu bytes, next at %zu)\n", vm.bytesAllocated, vm.nextGC);
+#endif
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void collectGarbage(void)
+{
+  if ( vm.gcPhase == GC_IDLE ) startCycle();
+  while ( vm.gcPhase != GC_IDLE ) {
+    gcStep();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Walk the VM's list of objects and free all of them.
+ */
+void freeObjects(void)
+{
+  Obj* object = vm.objects;
+  while ( object != NULL ) {
+    Obj* next = object->next;
+    freeObject(object);
+    object = next;
+  }
+  vm.objects = NULL;
+
+  free(vm.grayStack);
+  vm.grayStack = NULL;
+  vm.grayCount = 0;
+  vm.grayCapacity = 0;
 }
@@ -2,17 +2,60 @@
 #define clox_memory_h
 
 #include "common.h"
+#include "object.h"
+#include "vm.h"
+
+#define ALLOCATE(type, count)                                              \
+  (type*)reallocate(NULL, 0, sizeof(type) * (size_t)(count))
+
+#define FREE(type, ptr) reallocate(ptr, sizeof(type), 0)
 
 #define GROW_CAPACITY(cap) ((cap) < 8 ? 8 : (cap) * 2)
 
-#define GROW_ARRAY(type, ptr, oldSize, newSize)                              \
-  (type*)reallocate(ptr, sizeof(type) * (oldSize), sizeof(type) * (newSize))
+#define GROW_ARRAY(type, ptr, oldSize, newSize)                        \
+  (type*)reallocate(ptr, sizeof(type) * (size_t)(oldSize),             \
+                    sizeof(type) * (size_t)(newSize))
 
-#define FREE_ARRAY(type, ptr, oldSize)         \
-  reallocate(ptr, sizeof(type) * (oldSize), 0)
+#define FREE_ARRAY(type, ptr, oldSize)                 \
+  reallocate(ptr, sizeof(type) * (size_t)(oldSize), 0)
 
 // The single function used for all dynamic memory management: allocating,
 // freeing and changing the size of an existing allocation.
 void* reallocate(void* ptr, size_t oldSize, size_t newSize);
 
+void markObject(Obj* object);
+void markValue(Value value);
+
+// Run a whole collection cycle to completion
+void collectGarbage(void);
+
+// Free every object still owned by the VM
+void freeObjects(void);
+
+/*---------------------------------------------------------------------------*/
+
+// Is the object gray or black in the current cycle?
+static inline bool isMarked(Obj* object)
+{
+  return object->mark == vm.currentMark;
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Is the object white once marking is over, so only waiting to be freed?
+static inline bool isDead(Obj* object)
+{
+  return vm.gcPhase == GC_SWEEP_STRINGS && !isMarked(object);
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Dijkstra style write barrier. Every store of a reference into a heap object
+// must go through it, otherwise the collector could miss an object that was
+// moved into an already traced (black) object while a cycle is in progress.
+static inline void writeBarrier(Value value)
+{
+  if ( vm.gcPhase == GC_MARK ) markValue(value);
+}
+
 #endif  // !clox_memory_h
@@ -0,0 +1,192 @@
+#include "object.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ALLOCATE_OBJ(type, objectType)                                     \
+  (type*)allocateObject(sizeof(type), objectType)
+
+/*---------------------------------------------------------------------------*/
+
+/** Allocate an object of the given size and initialize its header.
+ *
+ * The new object is linked into the VM's list of objects so that it can be
+ * found and freed later. It starts out black: an object allocated in the
+ * middle of a collection cycle survives that cycle, and references later
+ * stored into it go through writeBarrier().
+ */
+static Obj* allocateObject(size_t size, ObjType type)
+{
+  Obj* object = (Obj*)reallocate(NULL, 0, size);
+  object->type = type;
+  object->mark = vm.currentMark;
+
+  object->next = vm.objects;
+  vm.objects = object;
+
+#ifdef DEBUG_LOG_GC
+  printf("%p allocate %zu for %d\n", (void*)object, size, type);
+#endif
+
+  return object;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Wrap a function in a closure whose upvalues are not captured yet.
+ */
+ObjClosure* newClosure(ObjFunction* function)
+{
+  ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
+  for ( int i = 0; i < function->upvalueCount; i++ ) {
+    upvalues[i] = NULL;
+  }
+
+  ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+  closure->function = function;
+  closure->upvalues = upvalues;
+  closure->upvalueCount = function->upvalueCount;
+  return closure;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Create a blank function, the compiler fills in its chunk.
+ */
+ObjFunction* newFunction(void)
+{
+  ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
+  function->arity = 0;
+  function->upvalueCount = 0;
+  function->name = NULL;
+  initChunk(&function->chunk);
+  return function;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ObjNative* newNative(NativeFn function)
+{
+  ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
+  native->function = function;
+  return native;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Create a new string object and intern it.
+ *
+ * The strings table is used as a hash set: only keys matter, values are nil.
+ */
+static ObjString* allocateString(char* chars, int length, uint32_t hash)
+{
+  ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+  string->length = length;
+  string->chars = chars;
+  string->hash = hash;
+
+  // Keep the new string reachable in case growing the table triggers the GC
+  push(OBJ_VAL(string));
+  tableSet(&vm.strings, string, NIL_VAL);
+  pop();
+
+  return string;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** FNV-1a hash function.
+ */
+static uint32_t hashString(const char* key, int length)
+{
+  uint32_t hash = 2166136261u;
+  for ( int i = 0; i < length; i++ ) {
+    hash ^= (uint8_t)key[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Create a string object which claims ownership of the given characters.
+ *
+ * If the string is already interned, the given characters are freed and the
+ * existing string is returned instead.
+ */
+ObjString* takeString(char* chars, int length)
+{
+  uint32_t hash = hashString(chars, length);
+  ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+  if ( interned != NULL ) {
+    FREE_ARRAY(char, chars, length + 1);
+    return interned;
+  }
+
+  return allocateString(chars, length, hash);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Create a string object from a copy of the given characters, or return the
+ * interned string with the same characters if there is one.
+ */
+ObjString* copyString(const char* chars, int length)
+{
+  uint32_t hash = hashString(chars, length);
+  ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+  if ( interned != NULL ) return interned;
+
+  char* heapChars = ALLOCATE(char, length + 1);
+  memcpy(heapChars, chars, (size_t)length);
+  heapChars[length] = '\0';
+  return allocateString(heapChars, length, hash);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ObjUpvalue* newUpvalue(Value* slot)
+{
+  ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
+  upvalue->closed = NIL_VAL;
+  upvalue->location = slot;
+  upvalue->next = NULL;
+  return upvalue;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void printFunction(ObjFunction* function)
+{
+  if ( function->name == NULL ) {
+    printf("<script>");
+    return;
+  }
+  printf("<fn %s>", function->name->chars);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void printObject(Value value)
+{
+  switch ( OBJ_TYPE(value) ) {
+    case OBJ_CLOSURE:
+      printFunction(AS_CLOSURE(value)->function);
+      break;
+    case OBJ_FUNCTION:
+      printFunction(AS_FUNCTION(value));
+      break;
+    case OBJ_NATIVE:
+      printf("<native fn>");
+      break;
+    case OBJ_STRING:
+      printf("%s", AS_CSTRING(value));
+      break;
+    case OBJ_UPVALUE:
+      printf("upvalue");
+      break;
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef clox_object_h
+#define clox_object_h
+
+#include "chunk.h"
+#include "common.h"
+#include "value.h"
+
+#define OBJ_TYPE(value) (AS_OBJ(value)->type)
+
+#define IS_CLOSURE(value)  isObjType(value, OBJ_CLOSURE)
+#define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
+#define IS_NATIVE(value)   isObjType(value, OBJ_NATIVE)
+#define IS_STRING(value)   isObjType(value, OBJ_STRING)
+
+#define AS_CLOSURE(value)  ((ObjClosure*)AS_OBJ(value))
+#define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
+#define AS_NATIVE(value)   (((ObjNative*)AS_OBJ(value))->function)
+#define AS_STRING(value)   ((ObjString*)AS_OBJ(value))
+#define AS_CSTRING(value)  (((ObjString*)AS_OBJ(value))->chars)
+
+typedef enum
+{
+  OBJ_CLOSURE,
+  OBJ_FUNCTION,
+  OBJ_NATIVE,
+  OBJ_STRING,
+  OBJ_UPVALUE,
+} ObjType;
+
+// Common header shared by every heap allocated object
+struct Obj
+{
+  ObjType type;
+  bool mark;         // see VM.currentMark
+  struct Obj* next;  // intrusive list of all allocated objects
+};
+
+// Each function owns the chunk its body was compiled into
+struct ObjFunction
+{
+  Obj obj;
+  int arity;
+  int upvalueCount;
+  Chunk chunk;
+  ObjString* name;  // NULL for the top-level script
+};
+
+typedef Value (*NativeFn)(int argCount, Value* args);
+
+typedef struct
+{
+  Obj obj;
+  NativeFn function;
+} ObjNative;
+
+struct ObjString
+{
+  Obj obj;
+  int length;
+  char* chars;
+  uint32_t hash;  // computed once when the string is created
+};
+
+// A variable captured by a closure. While the variable's frame is active the
+// upvalue is open and points at its stack slot; when the frame returns the
+// value moves into the upvalue itself.
+typedef struct ObjUpvalue
+{
+  Obj obj;
+  Value* location;  // the stack slot while open, &closed once closed
+  Value closed;
+  struct ObjUpvalue* next;  // open upvalues, sorted by stack slot (top first)
+} ObjUpvalue;
+
+// A function together with the variables it captured. Every function is
+// wrapped in one at runtime, even when it captures nothing.
+typedef struct
+{
+  Obj obj;
+  ObjFunction* function;
+  ObjUpvalue** upvalues;
+  int upvalueCount;
+} ObjClosure;
+
+ObjClosure* newClosure(ObjFunction* function);
+ObjFunction* newFunction(void);
+ObjNative* newNative(NativeFn function);
+ObjString* takeString(char* chars, int length);
+ObjString* copyString(const char* chars, int length);
+ObjUpvalue* newUpvalue(Value* slot);
+void printObject(Value value);
+
+// Not a macro since value would be evaluated twice
+static inline bool isObjType(Value value, ObjType type)
+{
+  return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
+
+#endif  // !clox_object_h
@@ -0,0 +1,586 @@
+#include "optimizer.h"
+#include "memory.h"
+
+#include <string.h>
+
+// A decoded instruction. Jumps refer to their destination by instruction
+// index rather than byte offset, so instructions can be rewritten or deleted
+// freely and the offsets are only worked out again when re-encoding.
+typedef struct
+{
+  uint8_t op;
+  uint8_t operand;   // slot, constant index or argument count
+  uint8_t operand2;  // second operand of a superinstruction
+  int target;        // jump destination, as an instruction index
+  int offset;        // byte offset in the original chunk
+  int line;
+  bool dead;
+} Instruction;
+
+typedef struct
+{
+  Chunk* chunk;
+  Instruction* code;
+  int count;
+  bool* isTarget;  // whether any live jump lands on each instruction
+  int* work;       // scratch space for the reachability walk
+} Optimizer;
+
+// A frequent instruction sequence and the superinstruction it is fused into.
+// The byte operands of the sequence become the operands of the
+// superinstruction, in order. Only the last instruction may be a jump.
+typedef struct
+{
+  uint8_t sequence[3];
+  int length;
+  uint8_t fused;
+} Superinstruction;
+
+// The most frequent sequences in --profile runs over bench/lox. Longer
+// sequences come first so that they win over their prefixes.
+static const Superinstruction superinstructions[] = {
+  {{OP_GET_LOCAL, OP_CONSTANT, OP_ADD}, 3, OP_GET_LOCAL_CONSTANT_ADD},
+  {{OP_GET_LOCAL, OP_GET_LOCAL, OP_ADD}, 3, OP_GET_LOCAL_GET_LOCAL_ADD},
+  {{OP_GET_LOCAL, OP_GET_LOCAL}, 2, OP_GET_LOCAL_GET_LOCAL},
+  {{OP_GET_LOCAL, OP_CONSTANT}, 2, OP_GET_LOCAL_CONSTANT},
+  {{OP_SET_LOCAL, OP_POP}, 2, OP_SET_LOCAL_POP},
+  {{OP_LESS, OP_JUMP_IF_FALSE}, 2, OP_LESS_JUMP_IF_FALSE},
+};
+
+#define SUPERINSTRUCTION_COUNT \
+  (int)(sizeof(superinstructions) / sizeof(superinstructions[0]))
+
+/*---------------------------------------------------------------------------*/
+
+static int lengthOf(Optimizer* opt, Instruction* instr)
+{
+  // Closures are never rewritten, their original bytes are still valid
+  if ( instr->op == OP_CLOSURE ) {
+    return instructionLength(opt->chunk, instr->offset);
+  }
+  return opcodeLength(instr->op);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool isJump(uint8_t op)
+{
+  return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE ||
+         op == OP_LESS_JUMP_IF_FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool isFalsey(Value value)
+{
+  return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the next live instruction after the given one (or count).
+ */
+static int nextLive(Optimizer* opt, int index)
+{
+  do {
+    index++;
+  } while ( index < opt->count && opt->code[index].dead );
+  return index;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A jump to a deleted instruction lands on whatever follows it.
+ */
+static int resolve(Optimizer* opt, int index)
+{
+  while ( index < opt->count && opt->code[index].dead ) index++;
+  return index;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return whether the instruction pushes a value known at compile time.
+ */
+static bool literalValue(Optimizer* opt, Instruction* instr, Value* value)
+{
+  switch ( instr->op ) {
+    case OP_CONSTANT:
+      *value = opt->chunk->constants.values[instr->operand];
+      return true;
+    case OP_NIL:
+      *value = NIL_VAL;
+      return true;
+    case OP_TRUE:
+      *value = BOOL_VAL(true);
+      return true;
+    case OP_FALSE:
+      *value = BOOL_VAL(false);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Find a number in the constant table or add it. Return -1 if the table is
+ * full. Numbers are compared bitwise so that 0 and -0 stay distinct.
+ */
+static int numberConstant(Chunk* chunk, double number)
+{
+  ValueArray* constants = &chunk->constants;
+  for ( int i = 0; i < constants->size; i++ ) {
+    Value value = constants->values[i];
+    if ( !IS_NUMBER(value) ) continue;
+
+    double other = AS_NUMBER(value);
+    if ( memcmp(&other, &number, sizeof(double)) == 0 ) return i;
+  }
+
+  if ( constants->size >= UINT8_COUNT ) return -1;
+  return addConstant(chunk, NUMBER_VAL(number));
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void decode(Optimizer* opt)
+{
+  Chunk* chunk = opt->chunk;
+
+  // Instruction index starting at each byte offset
+  int* indexAt = ALLOCATE(int, chunk->size);
+
+  for ( int offset = 0; offset < chunk->size; ) {
+    Instruction* instr = &opt->code[opt->count];
+    indexAt[offset] = opt->count++;
+
+    instr->op = chunk->code[offset];
+    instr->operand = 0;
+    instr->operand2 = 0;
+    instr->target = -1;
+    instr->offset = offset;
+    instr->line = chunk->lines[offset];
+    instr->dead = false;
+
+    int length = instructionLength(chunk, offset);
+    if ( length == 2 ) {
+      instr->operand = chunk->code[offset + 1];
+    } else if ( isJump(instr->op) || instr->op == OP_LOOP ) {
+      int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+      instr->target = offset + 3 + (instr->op == OP_LOOP ? -jump : jump);
+    }
+
+    offset += length;
+  }
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* instr = &opt->code[i];
+    if ( instr->target < 0 ) continue;
+
+    instr->target = indexAt[instr->target];
+    // Backward jumps are only an encoding detail
+    if ( instr->op == OP_LOOP ) instr->op = OP_JUMP;
+  }
+
+  FREE_ARRAY(int, indexAt, chunk->size);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void markTargets(Optimizer* opt)
+{
+  memset(opt->isTarget, 0, sizeof(bool) * (size_t)opt->count);
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* instr = &opt->code[i];
+    if ( instr->dead || !isJump(instr->op) ) continue;
+
+    instr->target = resolve(opt, instr->target);
+    opt->isTarget[instr->target] = true;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Retarget jumps that land on other jumps to the final destination. A
+ * conditional jump can also be threaded through another conditional jump,
+ * since the condition is still on top of the stack.
+ */
+static bool threadJumps(Optimizer* opt)
+{
+  bool changed = false;
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* instr = &opt->code[i];
+    if ( instr->dead || !isJump(instr->op) ) continue;
+
+    int target = instr->target;
+    // Bounded, so a cycle of jumps cannot hang the compiler
+    for ( int hops = 0; hops < opt->count; hops++ ) {
+      Instruction* dest = &opt->code[target];
+      int next;
+
+      if ( dest->op == OP_JUMP ) {
+        next = dest->target;
+      } else if ( instr->op != OP_JUMP && dest->op == instr->op ) {
+        next = dest->target;
+      } else if ( instr->op != OP_JUMP && isJump(dest->op) ) {
+        // The opposite condition never jumps, so skip past it
+        next = nextLive(opt, target);
+      } else {
+        break;
+      }
+
+      if ( next == target || next >= opt->count ) break;
+      // Conditional jumps can only go forward
+      if ( instr->op != OP_JUMP && next <= i ) break;
+
+      // Code only shrinks, so a distance that fits now fits after encoding
+      int distance = opt->code[next].offset - (instr->offset + 3);
+      if ( distance > UINT16_MAX || -distance > UINT16_MAX ) break;
+
+      target = next;
+    }
+
+    if ( target != instr->target ) {
+      instr->target = target;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool foldBinary(Optimizer* opt, Instruction* a, uint8_t op, Value b)
+{
+  Value value = opt->chunk->constants.values[a->operand];
+
+  if ( op == OP_EQUAL ) {
+    a->op = valuesEqual(value, b) ? OP_TRUE : OP_FALSE;
+    return true;
+  }
+
+  if ( !IS_NUMBER(value) || !IS_NUMBER(b) ) return false;
+
+  double x = AS_NUMBER(value);
+  double y = AS_NUMBER(b);
+  double result;
+  switch ( op ) {
+    case OP_GREATER:
+      a->op = x > y ? OP_TRUE : OP_FALSE;
+      return true;
+    case OP_LESS:
+      a->op = x < y ? OP_TRUE : OP_FALSE;
+      return true;
+    case OP_ADD:
+      result = x + y;
+      break;
+    case OP_SUBTRACT:
+      result = x - y;
+      break;
+    case OP_MULTIPLY:
+      result = x * y;
+      break;
+    case OP_DIVIDE:
+      result = x / y;
+      break;
+    default:
+      return false;
+  }
+
+  int constant = numberConstant(opt->chunk, result);
+  if ( constant < 0 ) return false;
+
+  a->operand = (uint8_t)constant;
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Fold operations on constants and fuse common instruction sequences. Only
+ * the first instruction of a sequence may be a jump target.
+ */
+static bool foldSequences(Optimizer* opt)
+{
+  bool changed = false;
+  Value* constants = opt->chunk->constants.values;
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* a = &opt->code[i];
+    if ( a->dead ) continue;
+
+    int j = nextLive(opt, i);
+    if ( j >= opt->count || opt->isTarget[j] ) continue;
+    Instruction* b = &opt->code[j];
+
+    // Unary operator on a constant
+    if ( a->op == OP_CONSTANT && b->op == OP_NEGATE &&
+         IS_NUMBER(constants[a->operand]) ) {
+      int constant =
+        numberConstant(opt->chunk, -AS_NUMBER(constants[a->operand]));
+      if ( constant >= 0 ) {
+        a->operand = (uint8_t)constant;
+        b->dead = changed = true;
+      }
+      continue;
+    }
+
+    Value literal;
+    bool isLiteral = literalValue(opt, a, &literal);
+
+    if ( isLiteral && b->op == OP_NOT ) {
+      a->op = isFalsey(literal) ? OP_TRUE : OP_FALSE;
+      b->dead = changed = true;
+      continue;
+    }
+
+    // Branch on a condition known at compile time
+    if ( isLiteral &&
+         (b->op == OP_JUMP_IF_FALSE || b->op == OP_JUMP_IF_TRUE) ) {
+      if ( isFalsey(literal) == (b->op == OP_JUMP_IF_FALSE) ) {
+        b->op = OP_JUMP;
+      } else {
+        b->dead = true;
+      }
+      changed = true;
+      continue;
+    }
+
+    // A value pushed only to be popped again
+    if ( (isLiteral || a->op == OP_GET_LOCAL) && b->op == OP_POP ) {
+      a->dead = b->dead = changed = true;
+      continue;
+    }
+
+    // Testing the negation of a condition is testing the condition, as long
+    // as the value left on the stack is only ever popped
+    if ( a->op == OP_NOT &&
+         (b->op == OP_JUMP_IF_FALSE || b->op == OP_JUMP_IF_TRUE) ) {
+      int fallthrough = nextLive(opt, j);
+      if ( fallthrough < opt->count && opt->code[fallthrough].op == OP_POP &&
+           opt->code[b->target].op == OP_POP ) {
+        a->op = b->op == OP_JUMP_IF_FALSE ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE;
+        a->target = b->target;
+        b->dead = changed = true;
+      }
+      continue;
+    }
+
+    int k = nextLive(opt, j);
+    if ( k >= opt->count || opt->isTarget[k] ) continue;
+    Instruction* c = &opt->code[k];
+
+    // Binary operator on two constants
+    if ( a->op == OP_CONSTANT && b->op == OP_CONSTANT ) {
+      if ( foldBinary(opt, a, c->op, constants[b->operand]) ) {
+        b->dead = c->dead = changed = true;
+      }
+    }
+  }
+
+  return changed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Fuse the sequence starting at instruction i if it matches the given
+ * superinstruction. Only the first instruction may be a jump target.
+ */
+static bool fuse(Optimizer* opt, int i, const Superinstruction* super)
+{
+  int parts[3];
+  parts[0] = i;
+  for ( int n = 1; n < super->length; n++ ) {
+    parts[n] = nextLive(opt, parts[n - 1]);
+    if ( parts[n] >= opt->count || opt->isTarget[parts[n]] ) return false;
+  }
+  for ( int n = 0; n < super->length; n++ ) {
+    if ( opt->code[parts[n]].op != super->sequence[n] ) return false;
+  }
+
+  Instruction* first = &opt->code[i];
+  uint8_t operands[2];
+  int operandCount = 0;
+  for ( int n = 0; n < super->length; n++ ) {
+    Instruction* part = &opt->code[parts[n]];
+    if ( isJump(part->op) ) {
+      first->target = part->target;
+    } else if ( opcodeLength(part->op) == 2 ) {
+      operands[operandCount++] = part->operand;
+    }
+    if ( n > 0 ) part->dead = true;
+  }
+
+  first->op = super->fused;
+  if ( operandCount > 0 ) first->operand = operands[0];
+  if ( operandCount > 1 ) first->operand2 = operands[1];
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Replace frequent sequences with superinstructions, saving a dispatch per
+ * instruction fused away. This runs last: the other rewrites only know the
+ * plain instructions.
+ */
+static void fuseSuperinstructions(Optimizer* opt)
+{
+  for ( int i = 0; i < opt->count; i++ ) {
+    if ( opt->code[i].dead ) continue;
+
+    for ( int s = 0; s < SUPERINSTRUCTION_COUNT; s++ ) {
+      if ( fuse(opt, i, &superinstructions[s]) ) break;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Delete every instruction that no path from the entry point reaches, such
+ * as the code after a return or after an unconditional jump.
+ */
+static bool removeUnreachable(Optimizer* opt)
+{
+  bool* reachable = opt->isTarget;
+  memset(reachable, 0, sizeof(bool) * (size_t)opt->count);
+
+  int workCount = 0;
+  opt->work[workCount++] = resolve(opt, 0);
+
+  while ( workCount > 0 ) {
+    int i = opt->work[--workCount];
+    if ( i >= opt->count || reachable[i] ) continue;
+    reachable[i] = true;
+
+    Instruction* instr = &opt->code[i];
+    if ( isJump(instr->op) ) opt->work[workCount++] = instr->target;
+    if ( instr->op != OP_RETURN && instr->op != OP_JUMP ) {
+      opt->work[workCount++] = nextLive(opt, i);
+    }
+  }
+
+  bool changed = false;
+  for ( int i = 0; i < opt->count; i++ ) {
+    if ( !opt->code[i].dead && !reachable[i] ) {
+      opt->code[i].dead = changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A jump to the very next instruction does nothing. Conditional jumps leave
+ * the condition on the stack either way, so they can go too.
+ */
+static bool removeJumpsToNext(Optimizer* opt)
+{
+  bool changed = false;
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* instr = &opt->code[i];
+    if ( instr->dead || !isJump(instr->op) ) continue;
+
+    if ( resolve(opt, instr->target) == nextLive(opt, i) ) {
+      instr->dead = changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Write the live instructions back over the chunk's code and line table.
+ */
+static void encode(Optimizer* opt)
+{
+  Chunk* chunk = opt->chunk;
+  int* newOffset = opt->work;
+
+  int size = 0;
+  for ( int i = 0; i < opt->count; i++ ) {
+    if ( opt->code[i].dead ) continue;
+    newOffset[i] = size;
+    size += lengthOf(opt, &opt->code[i]);
+  }
+
+  for ( int i = 0; i < opt->count; i++ ) {
+    Instruction* instr = &opt->code[i];
+    if ( instr->dead ) continue;
+
+    int offset = newOffset[i];
+    int length = lengthOf(opt, instr);
+    uint8_t* code = &chunk->code[offset];
+
+    if ( instr->op == OP_CLOSURE ) {
+      // Code only moves toward the start, nothing after it is overwritten yet
+      memmove(code, &chunk->code[instr->offset], (size_t)length);
+    } else if ( isJump(instr->op) ) {
+      code[0] = instr->op;
+      int jump = newOffset[instr->target] - (offset + 3);
+      if ( jump < 0 ) {
+        code[0] = OP_LOOP;
+        jump = -jump;
+      }
+      code[1] = (uint8_t)((jump >> 8) & 0xff);
+      code[2] = (uint8_t)(jump & 0xff);
+    } else {
+      code[0] = instr->op;
+      if ( length > 1 ) code[1] = instr->operand;
+      if ( length > 2 ) code[2] = instr->operand2;
+    }
+
+    for ( int n = 0; n < length; n++ ) {
+      chunk->lines[offset + n] = instr->line;
+    }
+  }
+
+  chunk->size = size;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Decode the chunk, apply every rewrite until none of them makes progress,
+ * and encode the result back into the chunk.
+ */
+void optimizeChunk(Chunk* chunk)
+{
+  if ( chunk->size == 0 ) return;
+
+  // Encoding shrinks the chunk, the work arrays keep their original size
+  int size = chunk->size;
+  Optimizer opt;
+  opt.chunk = chunk;
+  opt.count = 0;
+  // Every instruction is at least one byte long
+  opt.code = ALLOCATE(Instruction, size);
+  opt.isTarget = ALLOCATE(bool, size);
+  // Each instruction pushes at most two successors during the walk
+  opt.work = ALLOCATE(int, 2 * size + 1);
+
+  decode(&opt);
+
+  bool changed;
+  do {
+    markTargets(&opt);
+    changed = threadJumps(&opt);
+    markTargets(&opt);
+    changed |= foldSequences(&opt);
+    changed |= removeUnreachable(&opt);
+    changed |= removeJumpsToNext(&opt);
+  } while ( changed );
+
+  markTargets(&opt);
+  fuseSuperinstructions(&opt);
+  markTargets(&opt);
+  encode(&opt);
+
+  FREE_ARRAY(int, opt.work, 2 * size + 1);
+  FREE_ARRAY(bool, opt.isTarget, size);
+  FREE_ARRAY(Instruction, opt.code, size);
+}
@@ -0,0 +1,10 @@
+#ifndef clox_optimizer_h
+#define clox_optimizer_h
+
+#include "chunk.h"
+
+// Rewrite a finished chunk in place with peephole optimizations. The chunk
+// never grows, and its line table and jump offsets are kept consistent.
+void optimizeChunk(Chunk* chunk);
+
+#endif  // !clox_optimizer_h
@@ -0,0 +1,212 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Blocks are carved out of slabs of this size
+#define SLAB_SIZE (64 * 1024)
+
+#define CLASS_INDEX(size) (((size) - 1) / POOL_GRANULE)
+
+#define IS_POOLED(size) ((size) > 0 && (size) <= POOL_MAX_SIZE)
+
+// A free block stores the link to the next free block of its class in place
+typedef struct FreeBlock
+{
+  struct FreeBlock* next;
+} FreeBlock;
+
+// Slab header, padded so that blocks after it stay 16-byte aligned
+typedef union Slab
+{
+  union Slab* next;
+  char align[POOL_GRANULE];
+} Slab;
+
+typedef struct
+{
+  FreeBlock* freeList;  // blocks that were freed and can be reused
+  char* bump;           // untouched space left in the newest slab
+  char* bumpEnd;
+
+  // Statistics
+  size_t slabs;
+  size_t inUse;
+  size_t peakInUse;
+  size_t allocations;
+} SizeClass;
+
+typedef struct
+{
+  SizeClass classes[POOL_CLASSES];
+  Slab* slabs;  // all slabs, for freePool()
+  size_t largeAllocations;
+} Pool;
+
+static Pool pool;
+
+/*---------------------------------------------------------------------------*/
+
+/** Give a size class a fresh slab to bump allocate from.
+ */
+static void addSlab(SizeClass* sizeClass)
+{
+  Slab* slab = (Slab*)malloc(SLAB_SIZE);
+  if ( slab == NULL ) exit(1);
+
+  slab->next = pool.slabs;
+  pool.slabs = slab;
+
+  sizeClass->bump = (char*)(slab + 1);
+  sizeClass->bumpEnd = (char*)slab + SLAB_SIZE;
+  sizeClass->slabs++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Allocate a block from the class that fits the given size.
+ *
+ * Recently freed blocks are reused first since they are likely still in the
+ * cache, otherwise the block is bumped off the class's newest slab.
+ */
+static void* allocateBlock(size_t size)
+{
+  size_t index = CLASS_INDEX(size);
+  size_t blockSize = (index + 1) * POOL_GRANULE;
+  SizeClass* sizeClass = &pool.classes[index];
+
+  void* block;
+  if ( sizeClass->freeList != NULL ) {
+    block = sizeClass->freeList;
+    sizeClass->freeList = sizeClass->freeList->next;
+  } else {
+    if ( sizeClass->bump + blockSize > sizeClass->bumpEnd ) {
+      addSlab(sizeClass);
+    }
+    block = sizeClass->bump;
+    sizeClass->bump += blockSize;
+  }
+
+  sizeClass->allocations++;
+  if ( ++sizeClass->inUse > sizeClass->peakInUse ) {
+    sizeClass->peakInUse = sizeClass->inUse;
+  }
+  return block;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void freeBlock(void* ptr, size_t size)
+{
+  SizeClass* sizeClass = &pool.classes[CLASS_INDEX(size)];
+
+  FreeBlock* block = (FreeBlock*)ptr;
+  block->next = sizeClass->freeList;
+  sizeClass->freeList = block;
+  sizeClass->inUse--;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Allocate, free or resize memory, serving small sizes from the pool.
+ *
+ * This relies on reallocate()'s callers always passing the exact size of the
+ * existing allocation, which is what identifies the size class it came from.
+ */
+void* poolReallocate(void* ptr, size_t oldSize, size_t newSize)
+{
+  bool oldPooled = ptr != NULL && IS_POOLED(oldSize);
+  bool newPooled = IS_POOLED(newSize);
+
+  if ( ptr != NULL && !oldPooled && !newPooled ) {
+    // Large to large (or large freed)
+    if ( newSize == 0 ) {
+      free(ptr);
+      return NULL;
+    }
+
+    void* res = realloc(ptr, newSize);
+    if ( res == NULL ) exit(1);
+    return res;
+  }
+
+  // Resizing within the same class is free
+  if ( oldPooled && newPooled && CLASS_INDEX(oldSize) == CLASS_INDEX(newSize) ) {
+    return ptr;
+  }
+
+  void* res = NULL;
+  if ( newSize > 0 ) {
+    if ( newPooled ) {
+      res = allocateBlock(newSize);
+    } else {
+      res = malloc(newSize);
+      if ( res == NULL ) exit(1);
+      pool.largeAllocations++;
+    }
+
+    if ( ptr != NULL ) {
+      memcpy(res, ptr, oldSize < newSize ? oldSize : newSize);
+    }
+  }
+
+  if ( ptr != NULL ) {
+    if ( oldPooled ) {
+      freeBlock(ptr, oldSize);
+    } else {
+      free(ptr);
+    }
+  }
+
+  return res;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void freePool(void)
+{
+  Slab* slab = pool.slabs;
+  while ( slab != NULL ) {
+    Slab* next = slab->next;
+    free(slab);
+    slab = next;
+  }
+
+  memset(&pool, 0, sizeof(pool));
+}
+
+/*---------------------------------------------------------------------------*/
+
+void printPoolStats(void)
+{
+  fprintf(stderr, "== pool stats ==\n");
+  fprintf(
+    stderr,
+    "%5s %6s %8s %10s %10s %12s\n",
+    "size",
+    "slabs",
+    "blocks",
+    "in use",
+    "peak",
+    "allocations");
+
+  for ( int i = 0; i < POOL_CLASSES; i++ ) {
+    SizeClass* sizeClass = &pool.classes[i];
+    if ( sizeClass->slabs == 0 ) continue;
+
+    size_t blockSize = (size_t)(i + 1) * POOL_GRANULE;
+    size_t blocks = sizeClass->slabs * ((SLAB_SIZE - sizeof(Slab)) / blockSize);
+    fprintf(
+      stderr,
+      "%5zu %6zu %8zu %10zu %10zu %12zu\n",
+      blockSize,
+      sizeClass->slabs,
+      blocks,
+      sizeClass->inUse,
+      sizeClass->peakInUse,
+      sizeClass->allocations);
+  }
+
+  fprintf(stderr, "large allocations: %zu\n", pool.largeAllocations);
+}
@@ -0,0 +1,21 @@
+#ifndef clox_pool_h
+#define clox_pool_h
+
+#include "common.h"
+
+// Size classes are multiples of POOL_GRANULE bytes up to POOL_MAX_SIZE.
+// Anything bigger falls through to the system allocator.
+#define POOL_GRANULE  16
+#define POOL_CLASSES  16
+#define POOL_MAX_SIZE (POOL_GRANULE * POOL_CLASSES)
+
+// Same contract as reallocate(), minus the garbage collector bookkeeping
+void* poolReallocate(void* ptr, size_t oldSize, size_t newSize);
+
+// Release every slab back to the system
+void freePool(void);
+
+// Print per size class occupancy to stderr
+void printPoolStats(void);
+
+#endif  // !clox_pool_h
@@ -0,0 +1,225 @@
+// sigaction() and setitimer() are POSIX, not C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "profiler.h"
+#include "debug.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+// CPU time between two samples
+#define SAMPLE_INTERVAL_US 1000
+
+/*---------------------------------------------------------------------------*/
+
+#ifndef _WIN32
+static volatile sig_atomic_t sampleDue = 0;
+static struct sigaction previousAction;
+#endif
+
+// The instruction that started last, which the next sample is charged to
+static InstructionProfile* running = NULL;
+static uint64_t totalHits = 0;
+static uint64_t totalSamples = 0;
+
+/*---------------------------------------------------------------------------*/
+
+#ifndef _WIN32
+static void onSample(int signal)
+{
+  (void)signal;
+  sampleDue = 1;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+void startProfiler(void)
+{
+  vm.profiling = true;
+  running = NULL;
+  totalHits = 0;
+  totalSamples = 0;
+
+#ifndef _WIN32
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onSample;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGPROF, &action, &previousAction);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = SAMPLE_INTERVAL_US;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+void stopProfiler(void)
+{
+  vm.profiling = false;
+  running = NULL;
+
+#ifndef _WIN32
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  sigaction(SIGPROF, &previousAction, NULL);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+void profileInstruction(Chunk* chunk, int offset)
+{
+#ifndef _WIN32
+  // The previous instruction was running when the timer fired. Its chunk is
+  // still alive, nothing has been allocated since it started.
+  if ( sampleDue ) {
+    sampleDue = 0;
+    if ( running != NULL ) {
+      running->samples++;
+      totalSamples++;
+    }
+  }
+#endif
+
+  if ( chunk->profile == NULL ) {
+    chunk->profile = ALLOCATE(InstructionProfile, chunk->size);
+    memset(chunk->profile, 0, sizeof(InstructionProfile) * (size_t)chunk->size);
+  }
+
+  running = &chunk->profile[offset];
+  running->hits++;
+  totalHits++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static double percentOf(uint64_t part, uint64_t total)
+{
+  return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct
+{
+  int line;
+  uint64_t hits;
+  uint64_t samples;
+} LineProfile;
+
+/*---------------------------------------------------------------------------*/
+
+static int compareLines(const void* a, const void* b)
+{
+  int left = ((const LineProfile*)a)->line;
+  int right = ((const LineProfile*)b)->line;
+  return (left > right) - (left < right);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void printFunctionProfile(ObjFunction* function)
+{
+  Chunk* chunk = &function->chunk;
+
+  uint64_t hits = 0;
+  uint64_t samples = 0;
+  for ( int i = 0; i < chunk->size; i++ ) {
+    hits += chunk->profile[i].hits;
+    samples += chunk->profile[i].samples;
+  }
+
+  printf("== %s == %llu instructions, %.1f%% of the time\n",
+         function->name == NULL ? "<script>" : function->name->chars,
+         (unsigned long long)hits, percentOf(samples, totalSamples));
+  printf("      hits   time\n");
+
+  for ( int offset = 0; offset < chunk->size; ) {
+    InstructionProfile* profile = &chunk->profile[offset];
+    if ( profile->hits == 0 ) {
+      printf("                 ");
+    } else {
+      printf("%10llu %5.1f%% ", (unsigned long long)profile->hits,
+             percentOf(profile->samples, totalSamples));
+    }
+    offset = disassembleInstruction(chunk, offset);
+  }
+  printf("\n");
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The report itself must not start a collection, so its scratch memory does
+ * not go through reallocate().
+ */
+void printProfile(void)
+{
+  printf("== profile == %llu instructions, %llu samples of %d us\n\n",
+         (unsigned long long)totalHits, (unsigned long long)totalSamples,
+         SAMPLE_INTERVAL_US);
+
+  int lineCount = 0;
+  for ( Obj* object = vm.objects; object != NULL; object = object->next ) {
+    if ( object->type != OBJ_FUNCTION ) continue;
+
+    ObjFunction* function = (ObjFunction*)object;
+    if ( function->chunk.profile == NULL ) continue;
+
+    printFunctionProfile(function);
+    lineCount += function->chunk.size;
+  }
+
+  // Merge the instructions of every function by source line
+  LineProfile* lines = (LineProfile*)malloc(sizeof(LineProfile) *
+                                            (size_t)(lineCount + 1));
+  if ( lines == NULL ) return;
+
+  lineCount = 0;
+  for ( Obj* object = vm.objects; object != NULL; object = object->next ) {
+    if ( object->type != OBJ_FUNCTION ) continue;
+
+    Chunk* chunk = &((ObjFunction*)object)->chunk;
+    if ( chunk->profile == NULL ) continue;
+
+    for ( int i = 0; i < chunk->size; i++ ) {
+      if ( chunk->profile[i].hits == 0 ) continue;
+      lines[lineCount].line = chunk->lines[i];
+      lines[lineCount].hits = chunk->profile[i].hits;
+      lines[lineCount].samples = chunk->profile[i].samples;
+      lineCount++;
+    }
+  }
+  qsort(lines, (size_t)lineCount, sizeof(LineProfile), compareLines);
+
+  printf("== lines ==\n");
+  printf("line       hits   time\n");
+  for ( int i = 0; i < lineCount; ) {
+    LineProfile total = lines[i++];
+    while ( i < lineCount && lines[i].line == total.line ) {
+      total.hits += lines[i].hits;
+      total.samples += lines[i].samples;
+      i++;
+    }
+    printf("%4d %10llu %5.1f%%\n", total.line,
+           (unsigned long long)total.hits,
+           percentOf(total.samples, totalSamples));
+  }
+
+  free(lines);
+}
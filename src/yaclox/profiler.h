@@ -0,0 +1,19 @@
+#ifndef clox_profiler_h
+#define clox_profiler_h
+
+#include "chunk.h"
+
+// Count every instruction the VM executes from now on, and sample where the
+// CPU time goes with an interval timer where the platform has one.
+void startProfiler(void);
+void stopProfiler(void);
+
+// Called by the VM before it executes the instruction at offset.
+void profileInstruction(Chunk* chunk, int offset);
+
+// Print the disassembly of every function that ran, annotated with hit
+// counts and each instruction's share of the samples, then the same totals
+// per source line.
+void printProfile(void);
+
+#endif  // !clox_profiler_h
@@ -0,0 +1,540 @@
+#include "registers.h"
+#include "memory.h"
+#include "verifier.h"
+
+#include <string.h>
+
+// Where the value of a stack slot currently lives. Translation keeps a
+// virtual copy of the operand stack: pushing a constant or a local does not
+// emit anything, the instruction consuming the value reads it straight from
+// the constant table or the local's register instead.
+typedef enum
+{
+  SLOT_REGISTER,  // in the register of the same number
+  SLOT_LOCAL,     // same value as another register, which holds a local
+  SLOT_CONSTANT,  // constant table entry
+  SLOT_NIL,
+  SLOT_TRUE,
+  SLOT_FALSE,
+} SlotKind;
+
+typedef struct
+{
+  SlotKind kind;
+  uint8_t index;  // register of SLOT_LOCAL, constant of SLOT_CONSTANT
+} Slot;
+
+typedef struct
+{
+  Chunk* source;
+  Chunk out;
+  int line;  // line of the stack instruction being translated
+
+  Slot slots[UINT8_COUNT];
+  int depth;
+
+  int* depthAt;     // stack depth before each instruction, -1 if unreachable
+  bool* isTarget;   // per offset: some jump lands here
+  int* offsetMap;   // per offset: where its register code starts
+  int* jumpFrom;    // offsets of emitted jump operands to patch
+  int* jumpTo;      // stack offsets those jumps go to
+  int jumpCount;
+
+  int lastDest;  // offset of the destination operand of the last instruction
+  bool tooLarge;
+} Translator;
+
+/*---------------------------------------------------------------------------*/
+
+static int jumpTarget(Chunk* chunk, int offset)
+{
+  int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+  return chunk->code[offset] == OP_LOOP ? offset + 3 - jump
+                                        : offset + 3 + jump;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Mark the instructions that some reachable jump lands on. Return the
+ * largest stack depth, which is the number of registers the function needs.
+ */
+static int findTargets(Translator* t)
+{
+  Chunk* chunk = t->source;
+  int maxDepth = 0;
+
+  for ( int offset = 0; offset < chunk->size;
+        offset += instructionLength(chunk, offset) ) {
+    if ( t->depthAt[offset] == -1 ) continue;  // Unreachable
+    if ( t->depthAt[offset] > maxDepth ) maxDepth = t->depthAt[offset];
+
+    uint8_t op = chunk->code[offset];
+    if ( op == OP_JUMP || op == OP_LOOP || op == OP_JUMP_IF_FALSE ||
+         op == OP_JUMP_IF_TRUE || op == OP_LESS_JUMP_IF_FALSE ) {
+      t->isTarget[jumpTarget(chunk, offset)] = true;
+    }
+  }
+
+  return maxDepth;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emitByte(Translator* t, int byte)
+{
+  appendChunk(&t->out, (uint8_t)byte, t->line);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emit2(Translator* t, RegisterOpCode op, int a)
+{
+  t->lastDest = -1;
+  emitByte(t, op);
+  emitByte(t, a);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emit3(Translator* t, RegisterOpCode op, int a, int b)
+{
+  t->lastDest = -1;
+  emitByte(t, op);
+  emitByte(t, a);
+  emitByte(t, b);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void emit4(Translator* t, RegisterOpCode op, int a, int b, int c)
+{
+  t->lastDest = -1;
+  emitByte(t, op);
+  emitByte(t, a);
+  emitByte(t, b);
+  emitByte(t, c);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Emit a jump whose offset is patched once all the code is laid out. The
+ * register operand, if any, comes before the offset.
+ */
+static void emitJump(Translator* t, RegisterOpCode op, int reg, int target)
+{
+  t->lastDest = -1;
+  emitByte(t, op);
+  if ( reg >= 0 ) emitByte(t, reg);
+
+  t->jumpFrom[t->jumpCount] = t->out.size;
+  t->jumpTo[t->jumpCount++] = target;
+  emitByte(t, 0xff);
+  emitByte(t, 0xff);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Emit code that stores the value of a slot into a register.
+ */
+static void load(Translator* t, int reg, Slot slot)
+{
+  switch ( slot.kind ) {
+    case SLOT_REGISTER:
+      if ( slot.index != reg ) emit3(t, ROP_MOVE, reg, slot.index);
+      break;
+    case SLOT_LOCAL:
+      emit3(t, ROP_MOVE, reg, slot.index);
+      break;
+    case SLOT_CONSTANT:
+      emit3(t, ROP_LOADK, reg, slot.index);
+      break;
+    case SLOT_NIL:
+      emit2(t, ROP_LOADNIL, reg);
+      break;
+    case SLOT_TRUE:
+      emit2(t, ROP_LOADTRUE, reg);
+      break;
+    case SLOT_FALSE:
+      emit2(t, ROP_LOADFALSE, reg);
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Make sure the value of stack slot i is in register i.
+ */
+static void materialize(Translator* t, int i)
+{
+  if ( t->slots[i].kind == SLOT_REGISTER ) return;
+
+  load(t, i, t->slots[i]);
+  t->slots[i].kind = SLOT_REGISTER;
+  t->slots[i].index = (uint8_t)i;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Control flow merges expect every value in its own register.
+ */
+static void materializeAll(Translator* t)
+{
+  for ( int i = 0; i < t->depth; i++ ) materialize(t, i);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return a register holding the value of stack slot i, without a copy when
+ * it is a local.
+ */
+static int operand(Translator* t, int i)
+{
+  if ( t->slots[i].kind == SLOT_LOCAL ) return t->slots[i].index;
+
+  materialize(t, i);
+  return i;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void pushSlot(Translator* t, SlotKind kind, int index)
+{
+  t->slots[t->depth].kind = kind;
+  t->slots[t->depth].index = (uint8_t)index;
+  t->depth++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Replace the top two slots with the result of a binary operation. A
+ * constant right operand is read straight from the constant table.
+ */
+static void binary(Translator* t, RegisterOpCode op, RegisterOpCode opK)
+{
+  int dest = t->depth - 2;
+  Slot right = t->slots[t->depth - 1];
+  int left = operand(t, dest);
+
+  if ( right.kind == SLOT_CONSTANT ) {
+    emit4(t, opK, dest, left, right.index);
+  } else {
+    emit4(t, op, dest, left, operand(t, t->depth - 1));
+  }
+  t->lastDest = t->out.size - 3;
+
+  t->depth--;
+  t->slots[dest].kind = SLOT_REGISTER;
+  t->slots[dest].index = (uint8_t)dest;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void unary(Translator* t, RegisterOpCode op)
+{
+  int dest = t->depth - 1;
+  emit3(t, op, dest, operand(t, dest));
+  t->lastDest = t->out.size - 2;
+
+  t->slots[dest].kind = SLOT_REGISTER;
+  t->slots[dest].index = (uint8_t)dest;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Assign the top of the stack to a local's register.
+ */
+static void setLocal(Translator* t, int reg)
+{
+  // Values read from the local earlier must keep the old value
+  for ( int i = reg + 1; i < t->depth - 1; i++ ) {
+    if ( t->slots[i].kind == SLOT_LOCAL && t->slots[i].index == reg ) {
+      materialize(t, i);
+    }
+  }
+
+  int top = t->depth - 1;
+  Slot value = t->slots[top];
+  if ( value.kind == SLOT_REGISTER && t->lastDest >= 0 &&
+       t->out.code[t->lastDest] == top ) {
+    // The value was just computed: compute it into the local instead
+    t->out.code[t->lastDest] = (uint8_t)reg;
+    t->lastDest = -1;
+  } else if ( !(value.kind == SLOT_LOCAL && value.index == reg) ) {
+    load(t, reg, value);
+  }
+
+  t->slots[reg].kind = SLOT_REGISTER;
+  t->slots[reg].index = (uint8_t)reg;
+  t->slots[top].kind = SLOT_LOCAL;
+  t->slots[top].index = (uint8_t)reg;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void translateInstruction(Translator* t, int offset)
+{
+  uint8_t* code = &t->source->code[offset];
+
+  switch ( code[0] ) {
+    case OP_CONSTANT:
+      pushSlot(t, SLOT_CONSTANT, code[1]);
+      break;
+    case OP_NIL:
+      pushSlot(t, SLOT_NIL, 0);
+      break;
+    case OP_TRUE:
+      pushSlot(t, SLOT_TRUE, 0);
+      break;
+    case OP_FALSE:
+      pushSlot(t, SLOT_FALSE, 0);
+      break;
+    case OP_POP:
+      t->depth--;
+      break;
+    case OP_GET_LOCAL:
+      materialize(t, code[1]);
+      pushSlot(t, SLOT_LOCAL, code[1]);
+      break;
+    case OP_SET_LOCAL:
+      setLocal(t, code[1]);
+      break;
+    case OP_GET_GLOBAL:
+      emit3(t, ROP_GET_GLOBAL, t->depth, code[1]);
+      t->lastDest = t->out.size - 2;
+      pushSlot(t, SLOT_REGISTER, t->depth);
+      break;
+    case OP_DEFINE_GLOBAL:
+      emit3(t, ROP_DEFINE_GLOBAL, operand(t, t->depth - 1), code[1]);
+      t->depth--;
+      break;
+    case OP_SET_GLOBAL:
+      emit3(t, ROP_SET_GLOBAL, operand(t, t->depth - 1), code[1]);
+      break;
+    case OP_GET_UPVALUE:
+      emit3(t, ROP_GET_UPVALUE, t->depth, code[1]);
+      t->lastDest = t->out.size - 2;
+      pushSlot(t, SLOT_REGISTER, t->depth);
+      break;
+    case OP_SET_UPVALUE:
+      emit3(t, ROP_SET_UPVALUE, operand(t, t->depth - 1), code[1]);
+      break;
+    case OP_EQUAL:
+      binary(t, ROP_EQUAL, ROP_EQUALK);
+      break;
+    case OP_GREATER:
+      binary(t, ROP_GREATER, ROP_GREATERK);
+      break;
+    case OP_LESS:
+      binary(t, ROP_LESS, ROP_LESSK);
+      break;
+    case OP_ADD:
+      binary(t, ROP_ADD, ROP_ADDK);
+      break;
+    case OP_SUBTRACT:
+      binary(t, ROP_SUBTRACT, ROP_SUBTRACTK);
+      break;
+    case OP_MULTIPLY:
+      binary(t, ROP_MULTIPLY, ROP_MULTIPLYK);
+      break;
+    case OP_DIVIDE:
+      binary(t, ROP_DIVIDE, ROP_DIVIDEK);
+      break;
+    case OP_NOT:
+      unary(t, ROP_NOT);
+      break;
+    case OP_NEGATE:
+      unary(t, ROP_NEGATE);
+      break;
+    case OP_PRINT:
+      emit2(t, ROP_PRINT, operand(t, t->depth - 1));
+      t->depth--;
+      break;
+    case OP_JUMP:
+    case OP_LOOP: {
+      materializeAll(t);
+      int target = jumpTarget(t->source, offset);
+      emitJump(t, target > offset ? ROP_JUMP : ROP_LOOP, -1, target);
+      break;
+    }
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+      materializeAll(t);
+      emitJump(
+        t,
+        code[0] == OP_JUMP_IF_FALSE ? ROP_JUMP_IF_FALSE : ROP_JUMP_IF_TRUE,
+        t->depth - 1,
+        jumpTarget(t->source, offset));
+      break;
+    case OP_CALL: {
+      // Arguments go in consecutive registers right after the callee
+      materializeAll(t);
+      int callee = t->depth - code[1] - 1;
+      emit3(t, ROP_CALL, callee, code[1]);
+      t->depth = callee + 1;
+      break;
+    }
+    case OP_CLOSURE: {
+      // Captured locals must be in their registers, which the upvalues
+      // point at until the variables are closed
+      materializeAll(t);
+      int length = instructionLength(t->source, offset);
+      emit3(t, ROP_CLOSURE, t->depth, code[1]);
+      for ( int i = 2; i < length; i++ ) emitByte(t, code[i]);
+      pushSlot(t, SLOT_REGISTER, t->depth);
+      break;
+    }
+    case OP_CLOSE_UPVALUE:
+      materializeAll(t);
+      emit2(t, ROP_CLOSE_UPVALUES, t->depth - 1);
+      t->depth--;
+      break;
+    case OP_RETURN:
+      emit2(t, ROP_RETURN, operand(t, t->depth - 1));
+      t->depth--;
+      break;
+    // Superinstructions translate like the sequences they stand for
+    case OP_GET_LOCAL_CONSTANT_ADD:
+      materialize(t, code[1]);
+      emit4(t, ROP_ADDK, t->depth, code[1], code[2]);
+      t->lastDest = t->out.size - 3;
+      pushSlot(t, SLOT_REGISTER, t->depth);
+      break;
+    case OP_GET_LOCAL_GET_LOCAL_ADD:
+      materialize(t, code[1]);
+      materialize(t, code[2]);
+      emit4(t, ROP_ADD, t->depth, code[1], code[2]);
+      t->lastDest = t->out.size - 3;
+      pushSlot(t, SLOT_REGISTER, t->depth);
+      break;
+    case OP_GET_LOCAL_GET_LOCAL:
+      materialize(t, code[1]);
+      pushSlot(t, SLOT_LOCAL, code[1]);
+      materialize(t, code[2]);
+      pushSlot(t, SLOT_LOCAL, code[2]);
+      break;
+    case OP_GET_LOCAL_CONSTANT:
+      materialize(t, code[1]);
+      pushSlot(t, SLOT_LOCAL, code[1]);
+      pushSlot(t, SLOT_CONSTANT, code[2]);
+      break;
+    case OP_SET_LOCAL_POP:
+      setLocal(t, code[1]);
+      t->depth--;
+      break;
+    case OP_LESS_JUMP_IF_FALSE:
+      binary(t, ROP_LESS, ROP_LESSK);
+      materializeAll(t);
+      emitJump(
+        t, ROP_JUMP_IF_FALSE, t->depth - 1, jumpTarget(t->source, offset));
+      break;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Fill in the jump offsets now that every target has a register offset.
+ */
+static bool patchJumps(Translator* t)
+{
+  for ( int i = 0; i < t->jumpCount; i++ ) {
+    int from = t->jumpFrom[i];
+    int to = t->offsetMap[t->jumpTo[i]];
+
+    // Offsets are relative to the end of the instruction
+    int jump = to - (from + 2);
+    if ( jump < 0 ) jump = -jump;
+    if ( jump > UINT16_MAX ) return false;
+
+    t->out.code[from] = (uint8_t)((jump >> 8) & 0xff);
+    t->out.code[from + 1] = (uint8_t)(jump & 0xff);
+  }
+
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Translate the chunk one stack instruction at a time, keeping track of
+ * where each stack slot's value lives, then swap the new code in.
+ */
+bool emitRegisterCode(ObjFunction* function)
+{
+  Chunk* chunk = &function->chunk;
+  if ( chunk->format == CHUNK_REGISTER ) return true;
+
+  Translator t;
+  t.source = chunk;
+  initChunk(&t.out);
+  t.line = 0;
+  t.jumpCount = 0;
+  t.lastDest = -1;
+
+  t.depthAt = ALLOCATE(int, chunk->size);
+  t.isTarget = ALLOCATE(bool, chunk->size);
+  t.offsetMap = ALLOCATE(int, chunk->size);
+  t.jumpFrom = ALLOCATE(int, chunk->size);
+  t.jumpTo = ALLOCATE(int, chunk->size);
+  memset(t.isTarget, 0, sizeof(bool) * (size_t)chunk->size);
+
+  // The verifier works out the stack depths and checks that every path into
+  // an instruction agrees on them
+  bool ok = stackDepths(function, t.depthAt);
+  int frameSize = ok ? findTargets(&t) : 0;
+  ok = ok && frameSize <= UINT8_COUNT;
+
+  t.depth = function->arity + 1;
+  for ( int i = 0; i < t.depth; i++ ) {
+    t.slots[i].kind = SLOT_REGISTER;
+    t.slots[i].index = (uint8_t)i;
+  }
+
+  bool fallsThrough = true;
+  for ( int offset = 0; ok && offset < chunk->size;
+        offset += instructionLength(chunk, offset) ) {
+    if ( t.depthAt[offset] == -1 ) continue;  // Unreachable
+
+    if ( t.isTarget[offset] || !fallsThrough ) {
+      if ( fallsThrough ) materializeAll(&t);
+
+      // Everything is in its register on every path into a jump target
+      t.depth = t.depthAt[offset];
+      for ( int i = 0; i < t.depth; i++ ) {
+        t.slots[i].kind = SLOT_REGISTER;
+        t.slots[i].index = (uint8_t)i;
+      }
+      t.lastDest = -1;
+    }
+
+    t.offsetMap[offset] = t.out.size;
+    t.line = chunk->lines[offset];
+    translateInstruction(&t, offset);
+
+    uint8_t op = chunk->code[offset];
+    fallsThrough = op != OP_RETURN && op != OP_JUMP && op != OP_LOOP;
+  }
+
+  ok = ok && patchJumps(&t);
+
+  FREE_ARRAY(int, t.jumpTo, chunk->size);
+  FREE_ARRAY(int, t.jumpFrom, chunk->size);
+  FREE_ARRAY(int, t.offsetMap, chunk->size);
+  FREE_ARRAY(bool, t.isTarget, chunk->size);
+  FREE_ARRAY(int, t.depthAt, chunk->size);
+
+  if ( !ok ) {
+    freeChunk(&t.out);
+    return false;
+  }
+
+  // Keep the constants, take over the new code and line table
+  FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+  FREE_ARRAY(int, chunk->lines, chunk->capacity);
+  freeValueArray(&t.out.constants);
+  chunk->code = t.out.code;
+  chunk->lines = t.out.lines;
+  chunk->size = t.out.size;
+  chunk->capacity = t.out.capacity;
+  chunk->format = CHUNK_REGISTER;
+  chunk->frameSize = frameSize;
+  return true;
+}
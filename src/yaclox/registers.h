@@ -0,0 +1,12 @@
+#ifndef clox_registers_h
+#define clox_registers_h
+
+#include "object.h"
+
+// Register compiler backend: translate the function's finished stack chunk
+// into CHUNK_REGISTER code in place. Return false, leaving the chunk
+// untouched, if it does not verify (see stackDepths()), the function needs
+// more than 256 registers or a jump grows out of range.
+bool emitRegisterCode(ObjFunction* function);
+
+#endif  // !clox_registers_h
@@ -0,0 +1,226 @@
+#include "table.h"
+#include "memory.h"
+#include "object.h"
+
+#include <string.h>
+
+// Grow the table when it is more than 3/4 full, tombstones included
+#define TABLE_MAX_LOAD 0.75
+
+/*---------------------------------------------------------------------------*/
+
+void initTable(Table* table)
+{
+  table->size = 0;
+  table->capacity = 0;
+  table->entries = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void freeTable(Table* table)
+{
+  FREE_ARRAY(Entry, table->entries, table->capacity);
+  initTable(table);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Find the bucket for a given key.
+ *
+ * Return the bucket holding the key if it is present. Otherwise return the
+ * bucket where the key should be inserted: the first tombstone passed while
+ * probing if any, so that tombstones get reused, or else the empty bucket that
+ * ended the probe sequence.
+ *
+ * Keys are interned strings, so comparing them is a pointer comparison and the
+ * hash never has to be recomputed.
+ */
+static Entry* findEntry(Entry* entries, int capacity, ObjString* key)
+{
+  uint32_t mask = (uint32_t)capacity - 1;
+  uint32_t index = key->hash & mask;
+  Entry* tombstone = NULL;
+
+  for ( ;; ) {
+    Entry* entry = &entries[index];
+    if ( entry->key == NULL ) {
+      if ( IS_NIL(entry->value) ) {
+        // Empty entry
+        return tombstone != NULL ? tombstone : entry;
+      } else {
+        // We found a tombstone
+        if ( tombstone == NULL ) tombstone = entry;
+      }
+    } else if ( entry->key == key ) {
+      // We found the key
+      return entry;
+    }
+
+    index = (index + 1) & mask;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Look up a key and store its value in the output parameter if found.
+ */
+bool tableGet(Table* table, ObjString* key, Value* value)
+{
+  if ( table->size == 0 ) return false;
+
+  Entry* entry = findEntry(table->entries, table->capacity, key);
+  if ( entry->key == NULL ) return false;
+
+  *value = entry->value;
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Rehash all live entries into a new bucket array.
+ *
+ * Tombstones are dropped along the way, so the size is recounted.
+ */
+static void adjustCapacity(Table* table, int capacity)
+{
+  Entry* entries = ALLOCATE(Entry, capacity);
+  for ( int i = 0; i < capacity; i++ ) {
+    entries[i].key = NULL;
+    entries[i].value = NIL_VAL;
+  }
+
+  table->size = 0;
+  for ( int i = 0; i < table->capacity; i++ ) {
+    Entry* entry = &table->entries[i];
+    if ( entry->key == NULL || isDead((Obj*)entry->key) ) continue;
+
+    Entry* dest = findEntry(entries, capacity, entry->key);
+    dest->key = entry->key;
+    dest->value = entry->value;
+    table->size++;
+  }
+
+  FREE_ARRAY(Entry, table->entries, table->capacity);
+  table->entries = entries;
+  table->capacity = capacity;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Add the given key/value pair to the table, overwriting any existing value.
+ *
+ * Return true if a new entry was added.
+ */
+bool tableSet(Table* table, ObjString* key, Value value)
+{
+  if ( table->size + 1 > table->capacity * TABLE_MAX_LOAD ) {
+    // GROW_CAPACITY() keeps the capacity a power of two
+    int capacity = GROW_CAPACITY(table->capacity);
+    adjustCapacity(table, capacity);
+  }
+
+  Entry* entry = findEntry(table->entries, table->capacity, key);
+  bool isNewKey = entry->key == NULL;
+  // A reused tombstone is already accounted for in size
+  if ( isNewKey && IS_NIL(entry->value) ) table->size++;
+
+  entry->key = key;
+  entry->value = value;
+  return isNewKey;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Remove a key from the table, leaving a tombstone in its bucket so that
+ * probe sequences passing through it are not broken.
+ */
+bool tableDelete(Table* table, ObjString* key)
+{
+  if ( table->size == 0 ) return false;
+
+  Entry* entry = findEntry(table->entries, table->capacity, key);
+  if ( entry->key == NULL ) return false;
+
+  entry->key = NULL;
+  entry->value = BOOL_VAL(true);
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void tableAddAll(Table* from, Table* to)
+{
+  for ( int i = 0; i < from->capacity; i++ ) {
+    Entry* entry = &from->entries[i];
+    if ( entry->key != NULL ) {
+      tableSet(to, entry->key, entry->value);
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Look up a string by its characters rather than by identity.
+ *
+ * This is the one place where strings are compared character by character,
+ * and it is what lets every other comparison be a pointer comparison. The
+ * cached hash and length reject almost all mismatches before memcmp().
+ */
+ObjString*
+tableFindString(Table* table, const char* chars, int length, uint32_t hash)
+{
+  if ( table->size == 0 ) return NULL;
+
+  uint32_t mask = (uint32_t)table->capacity - 1;
+  uint32_t index = hash & mask;
+  for ( ;; ) {
+    Entry* entry = &table->entries[index];
+    if ( entry->key == NULL ) {
+      // Stop if we find an empty non-tombstone entry
+      if ( IS_NIL(entry->value) ) return NULL;
+    } else if ( isDead((Obj*)entry->key) ) {
+      // Not removed yet, but must not be interned again
+    } else if (
+      entry->key->length == length && entry->key->hash == hash &&
+      memcmp(entry->key->chars, chars, (size_t)length) == 0 ) {
+      // We found it
+      return entry->key;
+    }
+
+    index = (index + 1) & mask;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Delete the entries whose key is about to be swept, among count entries
+ * from the given one. Return the entry to go on from.
+ *
+ * The strings table holds weak references: interning a string must not keep
+ * it alive, so dead strings are dropped from it before they are freed.
+ */
+int tableRemoveWhite(Table* table, int from, int count)
+{
+  int i = from;
+  for ( ; i < table->capacity && count-- > 0; i++ ) {
+    Entry* entry = &table->entries[i];
+    if ( entry->key != NULL && !isMarked((Obj*)entry->key) ) {
+      tableDelete(table, entry->key);
+    }
+  }
+  return i;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Mark every key and value of a table.
+ */
+void markTable(Table* table)
+{
+  for ( int i = 0; i < table->capacity; i++ ) {
+    Entry* entry = &table->entries[i];
+    markObject((Obj*)entry->key);
+    markValue(entry->value);
+  }
+}
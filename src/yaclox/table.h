@@ -0,0 +1,33 @@
+#ifndef clox_table_h
+#define clox_table_h
+
+#include "common.h"
+#include "value.h"
+
+typedef struct
+{
+  ObjString* key;  // NULL for empty buckets and tombstones
+  Value value;     // tombstones have a true value, empty buckets nil
+} Entry;
+
+// Hash table with open addressing and linear probing. The capacity is always
+// a power of two so a bucket index is just the hash masked by capacity - 1.
+typedef struct
+{
+  int size;  // number of live entries plus tombstones
+  int capacity;
+  Entry* entries;
+} Table;
+
+void initTable(Table* table);
+void freeTable(Table* table);
+bool tableGet(Table* table, ObjString* key, Value* value);
+bool tableSet(Table* table, ObjString* key, Value value);
+bool tableDelete(Table* table, ObjString* key);
+void tableAddAll(Table* from, Table* to);
+ObjString*
+tableFindString(Table* table, const char* chars, int length, uint32_t hash);
+int tableRemoveWhite(Table* table, int from, int count);
+void markTable(Table* table);
+
+#endif  // !clox_table_h
@@ -1,5 +1,6 @@
 #include "value.h"
 #include "memory.h"
+#include "object.h"
 
 #include <stdio.h>
 
@@ -35,7 +36,47 @@ void freeValueArray(ValueArray* array)
 
 /*---------------------------------------------------------------------------*/
 
+/** Compare two values for Lox equality.
+ *
+ * Values of different types are never equal. Under NaN boxing two numbers must
+ * still be compared as doubles so that NaN != NaN. Strings are interned, so
+ * two strings are equal only if they are the same object.
+ */
+bool valuesEqual(Value a, Value b)
+{
+#ifdef NAN_BOXING
+  if ( IS_NUMBER(a) && IS_NUMBER(b) ) {
+    return AS_NUMBER(a) == AS_NUMBER(b);
+  }
+  return a == b;
+#else
+  if ( a.type != b.type ) return false;
+  switch ( a.type ) {
+    case VAL_BOOL:
+      return AS_BOOL(a) == AS_BOOL(b);
+    case VAL_NIL:
+      return true;
+    case VAL_NUMBER:
+      return AS_NUMBER(a) == AS_NUMBER(b);
+    case VAL_OBJ:
+      return AS_OBJ(a) == AS_OBJ(b);
+    default:
+      return false;  // unreachable
+  }
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
 void printValue(Value value)
 {
-  printf("%g", value);
+  if ( IS_BOOL(value) ) {
+    printf(AS_BOOL(value) ? "true" : "false");
+  } else if ( IS_NIL(value) ) {
+    printf("nil");
+  } else if ( IS_NUMBER(value) ) {
+    printf("%g", AS_NUMBER(value));
+  } else if ( IS_OBJ(value) ) {
+    printObject(value);
+  }
 }
@@ -3,7 +3,131 @@
 
 #include "common.h"
 
-typedef double Value;
+#include <string.h>
+
+typedef struct Obj Obj;
+typedef struct ObjFunction ObjFunction;
+typedef struct ObjString ObjString;
+
+#ifdef NAN_BOXING
+
+/* A Value is a 64-bit word. Any bit pattern that is not a quiet NaN is a
+ * double. The remaining quiet NaNs carry the singleton values in their low
+ * bits, and object pointers in their low 48 bits with the sign bit set.
+ */
+
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN     ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NIL   1  // 01
+#define TAG_FALSE 2  // 10
+#define TAG_TRUE  3  // 11
+
+typedef uint64_t Value;
+
+#define IS_BOOL(value)   (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value)    ((value) == NIL_VAL)
+#define IS_NUMBER(value) (((value) & QNAN) != QNAN)
+#define IS_OBJ(value)    (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+
+#define AS_BOOL(value)   ((value) == TRUE_VAL)
+#define AS_NUMBER(value) valueToNum(value)
+#define AS_OBJ(value)    ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+
+#define BOOL_VAL(b)     ((b) ? TRUE_VAL : FALSE_VAL)
+#define FALSE_VAL       ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL        ((Value)(uint64_t)(QNAN | TAG_TRUE))
+#define NIL_VAL         ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define NUMBER_VAL(num) numToValue(num)
+#define OBJ_VAL(obj)    (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+
+// Type punning through memcpy() is the only well-defined way in C99, and every
+// decent compiler turns it into a plain register move.
+static inline double valueToNum(Value value)
+{
+  double num;
+  memcpy(&num, &value, sizeof(Value));
+  return num;
+}
+
+static inline Value numToValue(double num)
+{
+  Value value;
+  memcpy(&value, &num, sizeof(double));
+  return value;
+}
+
+#else
+
+typedef enum
+{
+  VAL_BOOL,
+  VAL_NIL,
+  VAL_NUMBER,
+  VAL_OBJ,
+} ValueType;
+
+// Tagged union fallback: 16 bytes per value but trivially debuggable
+typedef struct
+{
+  ValueType type;
+  union
+  {
+    bool boolean;
+    double number;
+    Obj* obj;
+  } as;
+} Value;
+
+#define IS_BOOL(value)   ((value).type == VAL_BOOL)
+#define IS_NIL(value)    ((value).type == VAL_NIL)
+#define IS_NUMBER(value) ((value).type == VAL_NUMBER)
+#define IS_OBJ(value)    ((value).type == VAL_OBJ)
+
+#define AS_BOOL(value)   ((value).as.boolean)
+#define AS_NUMBER(value) ((value).as.number)
+#define AS_OBJ(value)    ((value).as.obj)
+
+#define BOOL_VAL(value)   boolToValue(value)
+#define NIL_VAL           nilValue()
+#define NUMBER_VAL(value) numToValue(value)
+#define OBJ_VAL(object)   objToValue((Obj*)(object))
+
+// Constructors rather than compound literals, which C++ code including this
+// header does not have
+static inline Value boolToValue(bool boolean)
+{
+  Value value;
+  value.type = VAL_BOOL;
+  value.as.boolean = boolean;
+  return value;
+}
+
+static inline Value nilValue(void)
+{
+  Value value;
+  value.type = VAL_NIL;
+  value.as.number = 0;
+  return value;
+}
+
+static inline Value numToValue(double num)
+{
+  Value value;
+  value.type = VAL_NUMBER;
+  value.as.number = num;
+  return value;
+}
+
+static inline Value objToValue(Obj* obj)
+{
+  Value value;
+  value.type = VAL_OBJ;
+  value.as.obj = obj;
+  return value;
+}
+
+#endif  // NAN_BOXING
 
 typedef struct
 {
@@ -12,6 +136,7 @@ typedef struct
   Value* values;
 } ValueArray;
 
+bool valuesEqual(Value a, Value b);
 void initValueArray(ValueArray* array);
 void appendValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
@@ -0,0 +1,428 @@
+#include "verifier.h"
+#include "memory.h"
+
+// Room for the two values addValues() pushes above the top of the stack
+#define STACK_SLACK 2
+
+typedef struct
+{
+  ObjFunction* function;
+  Chunk* chunk;
+  bool* isStart;  // whether an instruction starts at each offset
+  int* depthAt;   // stack depth before each instruction, -1 until reached
+  int* work;      // offsets of reached instructions still to be checked
+  int workCount;
+  int maxDepth;
+} Verifier;
+
+/*---------------------------------------------------------------------------*/
+
+static bool isConstant(Verifier* v, int index)
+{
+  return index < v->chunk->constants.size;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool isStringConstant(Verifier* v, int index)
+{
+  return isConstant(v, index) && IS_STRING(v->chunk->constants.values[index]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool isFunctionConstant(Verifier* v, int index)
+{
+  return isConstant(v, index) &&
+         IS_FUNCTION(v->chunk->constants.values[index]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the length of the instruction at offset, or 0 if the opcode is
+ * unknown or the instruction runs past the end of the chunk.
+ */
+static int checkedLength(Verifier* v, int offset)
+{
+  Chunk* chunk = v->chunk;
+  bool registers = chunk->format == CHUNK_REGISTER;
+  uint8_t op = chunk->code[offset];
+
+  // Compare against the last opcode of each instruction set
+  if ( op > (registers ? ROP_RETURN : OP_LESS_JUMP_IF_FALSE) ) return 0;
+
+  // The length of a closure depends on the function it closes over
+  int constant = offset + (registers ? 2 : 1);
+  if ( op == (registers ? ROP_CLOSURE : OP_CLOSURE) &&
+       (constant >= chunk->size ||
+        !isFunctionConstant(v, chunk->code[constant])) ) {
+    return 0;
+  }
+
+  int length = registers ? registerInstructionLength(chunk, offset)
+                         : instructionLength(chunk, offset);
+  return length <= chunk->size - offset ? length : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the offset a jump lands on. Offsets are relative to the end of the
+ * jump instruction.
+ */
+static int jumpTarget(Chunk* chunk, int offset, int length, bool backward)
+{
+  int jump = (chunk->code[offset + length - 2] << 8) |
+             chunk->code[offset + length - 1];
+  return offset + length + (backward ? -jump : jump);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool landsOnInstruction(Verifier* v, int target)
+{
+  return target >= 0 && target < v->chunk->size && v->isStart[target];
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Check the upvalue pairs of a closure. Locals must exist in the frame, the
+ * other captures must be upvalues of the function being verified.
+ */
+static bool checkCaptures(Verifier* v, int offset, int length, int locals)
+{
+  uint8_t* code = v->chunk->code;
+  int pairs = offset + (v->chunk->format == CHUNK_REGISTER ? 3 : 2);
+
+  for ( int i = pairs; i < offset + length; i += 2 ) {
+    uint8_t isLocal = code[i];
+    uint8_t index = code[i + 1];
+    if ( isLocal > 1 ) return false;
+    if ( index >= (isLocal ? locals : v->function->upvalueCount) ) return false;
+  }
+
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Record the stack depth on a path into an instruction, queueing it the
+ * first time it is reached.
+ */
+static bool reach(Verifier* v, int offset, int depth)
+{
+  if ( v->depthAt[offset] == -1 ) {
+    v->depthAt[offset] = depth;
+    v->work[v->workCount++] = offset;
+    return true;
+  }
+
+  return v->depthAt[offset] == depth;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Check one reachable stack instruction and pass the stack depth on to its
+ * successors.
+ */
+static bool checkStackInstruction(Verifier* v, int offset)
+{
+  Chunk* chunk = v->chunk;
+  uint8_t* code = &chunk->code[offset];
+  int length = checkedLength(v, offset);
+  int depth = v->depthAt[offset];
+  int pops = 0;
+  int pushes = 0;
+  int target = -1;
+  bool fallsThrough = true;
+  bool ok = true;
+
+  switch ( code[0] ) {
+    case OP_CONSTANT:
+      ok = isConstant(v, code[1]);
+      pushes = 1;
+      break;
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+      pushes = 1;
+      break;
+    case OP_POP:
+    case OP_PRINT:
+    case OP_CLOSE_UPVALUE:
+      pops = 1;
+      break;
+    case OP_GET_LOCAL:
+      ok = code[1] < depth;
+      pushes = 1;
+      break;
+    case OP_SET_LOCAL:
+      ok = code[1] < depth;
+      pops = pushes = 1;
+      break;
+    case OP_GET_GLOBAL:
+      ok = isStringConstant(v, code[1]);
+      pushes = 1;
+      break;
+    case OP_DEFINE_GLOBAL:
+      ok = isStringConstant(v, code[1]);
+      pops = 1;
+      break;
+    case OP_SET_GLOBAL:
+      ok = isStringConstant(v, code[1]);
+      pops = pushes = 1;
+      break;
+    case OP_GET_UPVALUE:
+      ok = code[1] < v->function->upvalueCount;
+      pushes = 1;
+      break;
+    case OP_SET_UPVALUE:
+      ok = code[1] < v->function->upvalueCount;
+      pops = pushes = 1;
+      break;
+    case OP_EQUAL:
+    case OP_GREATER:
+    case OP_LESS:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+      pops = 2;
+      pushes = 1;
+      break;
+    case OP_NOT:
+    case OP_NEGATE:
+      pops = pushes = 1;
+      break;
+    case OP_JUMP:
+      target = jumpTarget(chunk, offset, length, false);
+      fallsThrough = false;
+      break;
+    case OP_LOOP:
+      target = jumpTarget(chunk, offset, length, true);
+      fallsThrough = false;
+      break;
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+      target = jumpTarget(chunk, offset, length, false);
+      pops = pushes = 1;
+      break;
+    case OP_CALL:
+      pops = code[1] + 1;
+      pushes = 1;
+      break;
+    case OP_CLOSURE:
+      ok = checkCaptures(v, offset, length, depth);
+      pushes = 1;
+      break;
+    case OP_RETURN:
+      pops = 1;
+      fallsThrough = false;
+      break;
+    case OP_GET_LOCAL_CONSTANT_ADD:
+      ok = code[1] < depth && isConstant(v, code[2]);
+      pushes = 1;
+      break;
+    case OP_GET_LOCAL_GET_LOCAL_ADD:
+      ok = code[1] < depth && code[2] < depth;
+      pushes = 1;
+      break;
+    case OP_GET_LOCAL_GET_LOCAL:
+      // The second local is read after the first is pushed, and can be it
+      ok = code[1] < depth && code[2] <= depth;
+      pushes = 2;
+      break;
+    case OP_GET_LOCAL_CONSTANT:
+      ok = code[1] < depth && isConstant(v, code[2]);
+      pushes = 2;
+      break;
+    case OP_SET_LOCAL_POP:
+      ok = code[1] < depth;
+      pops = 1;
+      break;
+    case OP_LESS_JUMP_IF_FALSE:
+      target = jumpTarget(chunk, offset, length, false);
+      pops = 2;
+      pushes = 1;
+      break;
+  }
+
+  if ( !ok || pops > depth ) return false;
+
+  int after = depth - pops + pushes;
+  if ( after > v->maxDepth ) v->maxDepth = after;
+
+  if ( target != -1 ) {
+    if ( !landsOnInstruction(v, target) || !reach(v, target, after) ) {
+      return false;
+    }
+  }
+  if ( fallsThrough ) {
+    int next = offset + length;
+    if ( next >= chunk->size || !reach(v, next, after) ) return false;
+  }
+
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Check one register instruction. Registers have no depth to track, so
+ * every instruction is checked, reachable or not.
+ */
+static bool checkRegisterInstruction(Verifier* v, int offset)
+{
+  Chunk* chunk = v->chunk;
+  uint8_t* code = &chunk->code[offset];
+  int length = checkedLength(v, offset);
+  int frameSize = chunk->frameSize;
+  int target = -1;
+  bool fallsThrough = true;
+  bool ok;
+
+  switch ( code[0] ) {
+    case ROP_LOADK:
+      ok = code[1] < frameSize && isConstant(v, code[2]);
+      break;
+    case ROP_LOADNIL:
+    case ROP_LOADTRUE:
+    case ROP_LOADFALSE:
+    case ROP_PRINT:
+    case ROP_CLOSE_UPVALUES:
+      ok = code[1] < frameSize;
+      break;
+    case ROP_MOVE:
+    case ROP_NOT:
+    case ROP_NEGATE:
+      ok = code[1] < frameSize && code[2] < frameSize;
+      break;
+    case ROP_GET_GLOBAL:
+    case ROP_DEFINE_GLOBAL:
+    case ROP_SET_GLOBAL:
+      ok = code[1] < frameSize && isStringConstant(v, code[2]);
+      break;
+    case ROP_GET_UPVALUE:
+    case ROP_SET_UPVALUE:
+      ok = code[1] < frameSize && code[2] < v->function->upvalueCount;
+      break;
+    case ROP_EQUAL:
+    case ROP_GREATER:
+    case ROP_LESS:
+    case ROP_ADD:
+    case ROP_SUBTRACT:
+    case ROP_MULTIPLY:
+    case ROP_DIVIDE:
+      ok = code[1] < frameSize && code[2] < frameSize && code[3] < frameSize;
+      break;
+    case ROP_EQUALK:
+    case ROP_GREATERK:
+    case ROP_LESSK:
+    case ROP_ADDK:
+    case ROP_SUBTRACTK:
+    case ROP_MULTIPLYK:
+    case ROP_DIVIDEK:
+      ok = code[1] < frameSize && code[2] < frameSize &&
+           isConstant(v, code[3]);
+      break;
+    case ROP_JUMP:
+      target = jumpTarget(chunk, offset, length, false);
+      fallsThrough = false;
+      ok = true;
+      break;
+    case ROP_LOOP:
+      target = jumpTarget(chunk, offset, length, true);
+      fallsThrough = false;
+      ok = true;
+      break;
+    case ROP_JUMP_IF_FALSE:
+    case ROP_JUMP_IF_TRUE:
+      target = jumpTarget(chunk, offset, length, false);
+      ok = code[1] < frameSize;
+      break;
+    case ROP_CALL:
+      ok = code[1] + code[2] < frameSize;
+      break;
+    case ROP_CLOSURE:
+      ok = code[1] < frameSize && checkCaptures(v, offset, length, frameSize);
+      break;
+    case ROP_RETURN:
+      ok = code[1] < frameSize;
+      fallsThrough = false;
+      break;
+    default:
+      ok = false;
+      break;
+  }
+
+  if ( !ok ) return false;
+  if ( target != -1 && !landsOnInstruction(v, target) ) return false;
+  return !fallsThrough || offset + length < chunk->size;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Verify the function, recording stack depths in depthAt when it is given.
+ */
+static bool verify(ObjFunction* function, int* depthAt)
+{
+  Chunk* chunk = &function->chunk;
+  if ( chunk->size == 0 ) return false;
+
+  Verifier v;
+  v.function = function;
+  v.chunk = chunk;
+  v.isStart = ALLOCATE(bool, chunk->size);
+  v.depthAt = depthAt != NULL ? depthAt : ALLOCATE(int, chunk->size);
+  v.work = ALLOCATE(int, chunk->size);
+  v.workCount = 0;
+  v.maxDepth = 0;
+
+  // Find where each instruction starts, so jumps can be checked against it
+  bool ok = true;
+  for ( int i = 0; i < chunk->size; i++ ) {
+    v.isStart[i] = false;
+    v.depthAt[i] = -1;
+  }
+  for ( int offset = 0; ok && offset < chunk->size; ) {
+    int length = checkedLength(&v, offset);
+    v.isStart[offset] = true;
+    ok = length > 0;
+    offset += length;
+  }
+
+  if ( ok && chunk->format == CHUNK_REGISTER ) {
+    // Arguments are copied into the first registers
+    ok = chunk->frameSize > function->arity &&
+         chunk->frameSize <= UINT8_COUNT;
+    for ( int offset = 0; ok && offset < chunk->size;
+          offset += checkedLength(&v, offset) ) {
+      ok = checkRegisterInstruction(&v, offset);
+    }
+  } else if ( ok ) {
+    // Slot zero holds the function, parameters follow
+    v.maxDepth = function->arity + 1;
+    reach(&v, 0, v.maxDepth);
+    while ( ok && v.workCount > 0 ) {
+      ok = checkStackInstruction(&v, v.work[--v.workCount]);
+    }
+    if ( ok ) chunk->frameSize = v.maxDepth + STACK_SLACK;
+  }
+
+  FREE_ARRAY(int, v.work, chunk->size);
+  if ( depthAt == NULL ) FREE_ARRAY(int, v.depthAt, chunk->size);
+  FREE_ARRAY(bool, v.isStart, chunk->size);
+  return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool verifyFunction(ObjFunction* function)
+{
+  return verify(function, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool stackDepths(ObjFunction* function, int* depths)
+{
+  return function->chunk.format == CHUNK_STACK && verify(function, depths);
+}
@@ -0,0 +1,22 @@
+#ifndef clox_verifier_h
+#define clox_verifier_h
+
+#include "object.h"
+
+// Check that a function's finished chunk can run without any runtime checks:
+// every instruction is complete, every constant index, local slot, register
+// and upvalue index is in range and of the right kind, every jump lands on an
+// instruction, no path falls off the end, and a stack chunk has the same
+// stack depth on every path into an instruction, never below its frame.
+//
+// On success a stack chunk's frameSize is set to the most stack slots the
+// function can use, which the VM checks once per call instead of on every
+// push. Nested functions are separate chunks and are verified on their own.
+bool verifyFunction(ObjFunction* function);
+
+// Verify a stack chunk and store in depths, which has one entry per byte of
+// code, how many slots of its frame are in use before each instruction. The
+// entry is -1 where no reachable instruction starts.
+bool stackDepths(ObjFunction* function, int* depths);
+
+#endif  // !clox_verifier_h
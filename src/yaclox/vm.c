@@ -0,0 +1,949 @@
+#include "vm.h"
+#include "compiler.h"
+#include "debug.h"
+#include "image.h"
+#include "jit.h"
+#include "memory.h"
+#include "object.h"
+#include "pool.h"
+#include "profiler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+VM vm;
+
+/*---------------------------------------------------------------------------*/
+
+/** The built-in clock() function.
+ * Return the number of seconds (with fractional) the program has been running.
+ */
+static Value clockNative(int argCount, Value* args)
+{
+  (void)argCount;
+  (void)args;
+  return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void resetStack(void)
+{
+  vm.stackTop = vm.stack;
+  vm.frameCount = 0;
+  vm.openUpvalues = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Report a runtime error followed by a stack trace of the calls in progress.
+ */
+static void runtimeError(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputs("\n", stderr);
+
+  for ( int i = vm.frameCount - 1; i >= 0; i-- ) {
+    CallFrame* frame = &vm.frames[i];
+    ObjFunction* function = frame->closure->function;
+    // The interpreter advances past each instruction before executing it
+    size_t instruction = (size_t)(frame->ip - function->chunk.code - 1);
+    fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
+    if ( function->name == NULL ) {
+      fprintf(stderr, "script\n");
+    } else {
+      fprintf(stderr, "%s()\n", function->name->chars);
+    }
+  }
+
+  resetStack();
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void defineNative(const char* name, NativeFn function)
+{
+  // Both objects are kept on the stack so the GC can see them
+  push(OBJ_VAL(copyString(name, (int)strlen(name))));
+  push(OBJ_VAL(newNative(function)));
+  tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
+  pop();
+  pop();
+}
+
+/*---------------------------------------------------------------------------*/
+
+void initVM(void)
+{
+  resetStack();
+  vm.backend = BACKEND_STACK;
+  vm.instructionCount = 0;
+  vm.profiling = false;
+  vm.objects = NULL;
+  vm.image = NULL;
+  vm.imageSize = 0;
+
+  // YACLOX_JIT_THRESHOLD=1 compiles every function on its first call
+  const char* threshold = getenv("YACLOX_JIT_THRESHOLD");
+  vm.jitThreshold = threshold != NULL ? atoi(threshold) : JIT_THRESHOLD;
+
+  vm.bytesAllocated = 0;
+  vm.nextGC = 1024 * 1024;
+  vm.gcPhase = GC_IDLE;
+  vm.currentMark = true;
+  vm.sweepString = 0;
+  vm.sweepLink = NULL;
+  vm.grayCount = 0;
+  vm.grayCapacity = 0;
+  vm.grayStack = NULL;
+
+  initTable(&vm.globals);
+  initTable(&vm.strings);
+
+  defineNative("clock", clockNative);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void freeVM(void)
+{
+  freeTable(&vm.globals);
+  freeTable(&vm.strings);
+  freeObjects();
+  unloadImage();
+
+#ifdef POOL_ALLOCATOR
+  // Nothing may be allocated through reallocate() after this point
+  freePool();
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+void push(Value value)
+{
+  *vm.stackTop = value;
+  vm.stackTop++;
+}
+
+/*---------------------------------------------------------------------------*/
+
+Value pop(void)
+{
+  vm.stackTop--;
+  return *vm.stackTop;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static Value peek(int distance)
+{
+  return vm.stackTop[-1 - distance];
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Push a new frame for the function. Its slots window starts at the callee
+ * itself, so the arguments already on the stack become its first locals.
+ */
+static bool call(ObjClosure* closure, int argCount)
+{
+  ObjFunction* function = closure->function;
+  if ( argCount != function->arity ) {
+    runtimeError(
+      "Expected %d arguments but got %d.", function->arity, argCount);
+    return false;
+  }
+
+  // The verifier bounded how deep the function can go, so this is the only
+  // stack check it needs
+  Value* slots = vm.stackTop - argCount - 1;
+  if ( vm.frameCount == FRAMES_MAX ||
+       slots + function->chunk.frameSize > vm.stack + STACK_MAX ) {
+    runtimeError("Stack overflow.");
+    return false;
+  }
+
+  CallFrame* frame = &vm.frames[vm.frameCount++];
+  frame->closure = closure;
+  frame->ip = function->chunk.code;
+  frame->slots = slots;
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static bool callValue(Value callee, int argCount)
+{
+  if ( IS_OBJ(callee) ) {
+    switch ( OBJ_TYPE(callee) ) {
+      case OBJ_CLOSURE:
+        return call(AS_CLOSURE(callee), argCount);
+      case OBJ_NATIVE: {
+        NativeFn native = AS_NATIVE(callee);
+        Value result = native(argCount, vm.stackTop - argCount);
+        vm.stackTop -= argCount + 1;
+        push(result);
+        return true;
+      }
+      default:
+        break;  // Non-callable object type
+    }
+  }
+
+  runtimeError("Can only call functions and classes.");
+  return false;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** nil and false are falsey and every other value behaves like true.
+ */
+static bool isFalsey(Value value)
+{
+  return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Return the upvalue for a stack slot, reusing the open one if the slot has
+ * been captured already so that all closures share the variable.
+ */
+static ObjUpvalue* captureUpvalue(Value* local)
+{
+  // The list is sorted, so the search stops at the first slot below local
+  ObjUpvalue* prevUpvalue = NULL;
+  ObjUpvalue* upvalue = vm.openUpvalues;
+  while ( upvalue != NULL && upvalue->location > local ) {
+    prevUpvalue = upvalue;
+    upvalue = upvalue->next;
+  }
+
+  if ( upvalue != NULL && upvalue->location == local ) {
+    return upvalue;
+  }
+
+  ObjUpvalue* createdUpvalue = newUpvalue(local);
+  createdUpvalue->next = upvalue;
+
+  if ( prevUpvalue == NULL ) {
+    vm.openUpvalues = createdUpvalue;
+  } else {
+    prevUpvalue->next = createdUpvalue;
+  }
+
+  return createdUpvalue;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Close every open upvalue at or above the given stack slot: move the value
+ * into the upvalue, which is all a variable needs once its frame is gone.
+ */
+static void closeUpvalues(Value* last)
+{
+  while ( vm.openUpvalues != NULL && vm.openUpvalues->location >= last ) {
+    ObjUpvalue* upvalue = vm.openUpvalues;
+    upvalue->closed = *upvalue->location;
+    upvalue->location = &upvalue->closed;
+    // The upvalue may already be black
+    writeBarrier(upvalue->closed);
+    vm.openUpvalues = upvalue->next;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Fill in the upvalues of a new closure from the operands that follow the
+ * closure instruction.
+ */
+static uint8_t* captureUpvalues(ObjClosure* closure, CallFrame* frame,
+                                uint8_t* ip)
+{
+  for ( int i = 0; i < closure->upvalueCount; i++ ) {
+    uint8_t isLocal = *ip++;
+    uint8_t index = *ip++;
+    if ( isLocal ) {
+      closure->upvalues[i] = captureUpvalue(frame->slots + index);
+    } else {
+      closure->upvalues[i] = frame->closure->upvalues[index];
+    }
+    writeBarrier(OBJ_VAL(closure->upvalues[i]));
+  }
+
+  return ip;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void concatenate(void)
+{
+  // Leave the operands on the stack until the result exists, allocating it can
+  // run the garbage collector
+  ObjString* b = AS_STRING(peek(0));
+  ObjString* a = AS_STRING(peek(1));
+
+  int length = a->length + b->length;
+  char* chars = ALLOCATE(char, length + 1);
+  memcpy(chars, a->chars, (size_t)a->length);
+  memcpy(chars + a->length, b->chars, (size_t)b->length);
+  chars[length] = '\0';
+
+  ObjString* result = takeString(chars, length);
+  pop();
+  pop();
+  push(OBJ_VAL(result));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Add two values the way OP_ADD does, storing the sum in dest.
+ */
+static bool addValues(Value* dest, Value a, Value b)
+{
+  if ( IS_NUMBER(a) && IS_NUMBER(b) ) {
+    *dest = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));
+  } else if ( IS_STRING(a) && IS_STRING(b) ) {
+    push(a);
+    push(b);
+    concatenate();
+    *dest = pop();
+  } else {
+    runtimeError("Operands must be two numbers or two strings.");
+    return false;
+  }
+
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+#ifdef JIT
+/** Count another call, loop iteration or return into the frame's function,
+ * compile the function once it is hot, and let its machine code run the frame
+ * for as long as it can.
+ */
+static void enterJit(CallFrame* frame)
+{
+  // Machine code does not count hits for the profiler
+  if ( vm.profiling ) return;
+
+  Chunk* chunk = &frame->closure->function->chunk;
+  if ( chunk->jit == NULL ) {
+    if ( vm.jitThreshold <= 0 || chunk->hotness < 0 ||
+         ++chunk->hotness < vm.jitThreshold ) {
+      return;
+    }
+    if ( !compileJit(frame->closure->function) ) {
+      chunk->hotness = -1;
+      return;
+    }
+  }
+
+  runJit(frame);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+/** The heart of the VM: decode and dispatch instructions one at a time.
+ */
+static InterpretResult run(void)
+{
+  // Cache the current frame, it is reloaded whenever a call starts or ends
+  CallFrame* frame = &vm.frames[vm.frameCount - 1];
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_SHORT()                                                       \
+  (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+#define READ_CONSTANT()                                                    \
+  (frame->closure->function->chunk.constants.values[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define BINARY_OP(valueType, op)                                           \
+  do {                                                                     \
+    if ( !IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)) ) {                    \
+      runtimeError("Operands must be numbers.");                           \
+      return INTERPRET_RUNTIME_ERROR;                                      \
+    }                                                                      \
+    double b = AS_NUMBER(pop());                                           \
+    double a = AS_NUMBER(pop());                                           \
+    push(valueType(a op b));                                               \
+  } while ( false )
+
+  for ( ;; ) {
+#ifdef DEBUG_TRACE_EXECUTION
+    printf("          ");
+    for ( Value* slot = vm.stack; slot < vm.stackTop; slot++ ) {
+      printf("[ ");
+      printValue(*slot);
+      printf(" ]");
+    }
+    printf("\n");
+    disassembleInstruction(
+      &frame->closure->function->chunk,
+      (int)(frame->ip - frame->closure->function->chunk.code));
+#endif
+
+    vm.instructionCount++;
+#ifdef PROFILER
+    if ( vm.profiling ) {
+      Chunk* chunk = &frame->closure->function->chunk;
+      profileInstruction(chunk, (int)(frame->ip - chunk->code));
+    }
+#endif
+    uint8_t instruction;
+    switch ( instruction = READ_BYTE() ) {
+      case OP_CONSTANT: {
+        Value constant = READ_CONSTANT();
+        push(constant);
+        break;
+      }
+      case OP_NIL:
+        push(NIL_VAL);
+        break;
+      case OP_TRUE:
+        push(BOOL_VAL(true));
+        break;
+      case OP_FALSE:
+        push(BOOL_VAL(false));
+        break;
+      case OP_POP:
+        pop();
+        break;
+      case OP_GET_LOCAL: {
+        uint8_t slot = READ_BYTE();
+        push(frame->slots[slot]);
+        break;
+      }
+      case OP_SET_LOCAL: {
+        uint8_t slot = READ_BYTE();
+        frame->slots[slot] = peek(0);
+        break;
+      }
+      case OP_GET_GLOBAL: {
+        ObjString* name = READ_STRING();
+        Value value;
+        if ( !tableGet(&vm.globals, name, &value) ) {
+          runtimeError("Undefined variable '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(value);
+        break;
+      }
+      case OP_DEFINE_GLOBAL: {
+        ObjString* name = READ_STRING();
+        tableSet(&vm.globals, name, peek(0));
+        pop();
+        break;
+      }
+      case OP_SET_GLOBAL: {
+        ObjString* name = READ_STRING();
+        if ( tableSet(&vm.globals, name, peek(0)) ) {
+          // Assignment never creates a global: undo and report
+          tableDelete(&vm.globals, name);
+          runtimeError("Undefined variable '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_GET_UPVALUE: {
+        uint8_t slot = READ_BYTE();
+        push(*frame->closure->upvalues[slot]->location);
+        break;
+      }
+      case OP_SET_UPVALUE: {
+        uint8_t slot = READ_BYTE();
+        *frame->closure->upvalues[slot]->location = peek(0);
+        writeBarrier(peek(0));
+        break;
+      }
+      case OP_EQUAL: {
+        Value b = pop();
+        Value a = pop();
+        push(BOOL_VAL(valuesEqual(a, b)));
+        break;
+      }
+      case OP_GREATER:
+        BINARY_OP(BOOL_VAL, >);
+        break;
+      case OP_LESS:
+        BINARY_OP(BOOL_VAL, <);
+        break;
+      case OP_ADD: {
+        if ( IS_STRING(peek(0)) && IS_STRING(peek(1)) ) {
+          concatenate();
+        } else if ( IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)) ) {
+          double b = AS_NUMBER(pop());
+          double a = AS_NUMBER(pop());
+          push(NUMBER_VAL(a + b));
+        } else {
+          runtimeError("Operands must be two numbers or two strings.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case OP_SUBTRACT:
+        BINARY_OP(NUMBER_VAL, -);
+        break;
+      case OP_MULTIPLY:
+        BINARY_OP(NUMBER_VAL, *);
+        break;
+      case OP_DIVIDE:
+        BINARY_OP(NUMBER_VAL, /);
+        break;
+      case OP_NOT:
+        push(BOOL_VAL(isFalsey(pop())));
+        break;
+      case OP_NEGATE:
+        if ( !IS_NUMBER(peek(0)) ) {
+          runtimeError("Operand must be a number.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(NUMBER_VAL(-AS_NUMBER(pop())));
+        break;
+      case OP_PRINT: {
+        printValue(pop());
+        printf("\n");
+        break;
+      }
+      case OP_JUMP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip += offset;
+        break;
+      }
+      case OP_JUMP_IF_FALSE: {
+        uint16_t offset = READ_SHORT();
+        if ( isFalsey(peek(0)) ) frame->ip += offset;
+        break;
+      }
+      case OP_LOOP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip -= offset;
+#ifdef JIT
+        enterJit(frame);
+#endif
+        break;
+      }
+      case OP_CALL: {
+        int argCount = READ_BYTE();
+        if ( !callValue(peek(argCount), argCount) ) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        frame = &vm.frames[vm.frameCount - 1];
+#ifdef JIT
+        enterJit(frame);
+#endif
+        break;
+      }
+      case OP_CLOSURE: {
+        ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+        ObjClosure* closure = newClosure(function);
+        push(OBJ_VAL(closure));
+        frame->ip = captureUpvalues(closure, frame, frame->ip);
+        break;
+      }
+      case OP_CLOSE_UPVALUE:
+        closeUpvalues(vm.stackTop - 1);
+        pop();
+        break;
+      case OP_RETURN: {
+        Value result = pop();
+        closeUpvalues(frame->slots);
+        vm.frameCount--;
+        if ( vm.frameCount == 0 ) {
+          // Pop the top-level script function
+          pop();
+          return INTERPRET_OK;
+        }
+
+        // Discard the callee's whole window and leave the result in its place
+        vm.stackTop = frame->slots;
+        push(result);
+        frame = &vm.frames[vm.frameCount - 1];
+#ifdef JIT
+        enterJit(frame);
+#endif
+        break;
+      }
+      case OP_JUMP_IF_TRUE: {
+        uint16_t offset = READ_SHORT();
+        if ( !isFalsey(peek(0)) ) frame->ip += offset;
+        break;
+      }
+      case OP_GET_LOCAL_CONSTANT_ADD: {
+        Value a = frame->slots[READ_BYTE()];
+        Value sum;
+        if ( !addValues(&sum, a, READ_CONSTANT()) ) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(sum);
+        break;
+      }
+      case OP_GET_LOCAL_GET_LOCAL_ADD: {
+        Value a = frame->slots[READ_BYTE()];
+        Value sum;
+        if ( !addValues(&sum, a, frame->slots[READ_BYTE()]) ) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(sum);
+        break;
+      }
+      case OP_GET_LOCAL_GET_LOCAL:
+        push(frame->slots[READ_BYTE()]);
+        push(frame->slots[READ_BYTE()]);
+        break;
+      case OP_GET_LOCAL_CONSTANT:
+        push(frame->slots[READ_BYTE()]);
+        push(READ_CONSTANT());
+        break;
+      case OP_SET_LOCAL_POP:
+        frame->slots[READ_BYTE()] = pop();
+        break;
+      case OP_LESS_JUMP_IF_FALSE: {
+        BINARY_OP(BOOL_VAL, <);
+        uint16_t offset = READ_SHORT();
+        if ( !AS_BOOL(peek(0)) ) frame->ip += offset;
+        break;
+      }
+    }
+  }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef BINARY_OP
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Start a call to a function compiled to register code. The callee and its
+ * arguments are already in place at slots[0] to slots[argCount].
+ */
+static bool callRegisters(ObjClosure* closure, Value* slots, int argCount)
+{
+  ObjFunction* function = closure->function;
+  if ( argCount != function->arity ) {
+    runtimeError(
+      "Expected %d arguments but got %d.", function->arity, argCount);
+    return false;
+  }
+
+  // Leave room for the two operands concatenate() pushes
+  Value* top = slots + function->chunk.frameSize;
+  if ( vm.frameCount == FRAMES_MAX || top + 2 > vm.stack + STACK_MAX ) {
+    runtimeError("Stack overflow.");
+    return false;
+  }
+
+  // The collector scans every register up to the stack top, so registers
+  // must never hold stale values from a finished call
+  for ( Value* slot = slots + argCount + 1; slot < top; slot++ ) {
+    *slot = NIL_VAL;
+  }
+
+  CallFrame* frame = &vm.frames[vm.frameCount++];
+  frame->closure = closure;
+  frame->ip = function->chunk.code;
+  frame->slots = slots;
+  frame->callerTop = vm.stackTop;
+  if ( top > vm.stackTop ) vm.stackTop = top;
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Interpreter loop for register code. Each frame's registers are its stack
+ * slots; vm.stackTop stays above the registers of every active frame.
+ */
+static InterpretResult runRegisters(void)
+{
+  CallFrame* frame = &vm.frames[vm.frameCount - 1];
+  Value* R = frame->slots;
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_SHORT()                                                       \
+  (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+#define READ_CONSTANT()                                                    \
+  (frame->closure->function->chunk.constants.values[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define BINARY_OP(valueType, op, right)                                    \
+  do {                                                                     \
+    uint8_t a = READ_BYTE();                                               \
+    Value b = R[READ_BYTE()];                                              \
+    Value c = right;                                                       \
+    if ( !IS_NUMBER(b) || !IS_NUMBER(c) ) {                                \
+      runtimeError("Operands must be numbers.");                           \
+      return INTERPRET_RUNTIME_ERROR;                                      \
+    }                                                                      \
+    R[a] = valueType(AS_NUMBER(b) op AS_NUMBER(c));                        \
+  } while ( false )
+
+  for ( ;; ) {
+#ifdef DEBUG_TRACE_EXECUTION
+    printf("          ");
+    for ( int i = 0; i < frame->closure->function->chunk.frameSize; i++ ) {
+      printf("[ ");
+      printValue(R[i]);
+      printf(" ]");
+    }
+    printf("\n");
+    disassembleInstruction(
+      &frame->closure->function->chunk,
+      (int)(frame->ip - frame->closure->function->chunk.code));
+#endif
+
+    vm.instructionCount++;
+#ifdef PROFILER
+    if ( vm.profiling ) {
+      Chunk* chunk = &frame->closure->function->chunk;
+      profileInstruction(chunk, (int)(frame->ip - chunk->code));
+    }
+#endif
+    uint8_t instruction;
+    switch ( instruction = READ_BYTE() ) {
+      case ROP_LOADK: {
+        uint8_t a = READ_BYTE();
+        R[a] = READ_CONSTANT();
+        break;
+      }
+      case ROP_LOADNIL:
+        R[READ_BYTE()] = NIL_VAL;
+        break;
+      case ROP_LOADTRUE:
+        R[READ_BYTE()] = BOOL_VAL(true);
+        break;
+      case ROP_LOADFALSE:
+        R[READ_BYTE()] = BOOL_VAL(false);
+        break;
+      case ROP_MOVE: {
+        uint8_t a = READ_BYTE();
+        R[a] = R[READ_BYTE()];
+        break;
+      }
+      case ROP_GET_GLOBAL: {
+        uint8_t a = READ_BYTE();
+        ObjString* name = READ_STRING();
+        if ( !tableGet(&vm.globals, name, &R[a]) ) {
+          runtimeError("Undefined variable '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_DEFINE_GLOBAL: {
+        uint8_t a = READ_BYTE();
+        tableSet(&vm.globals, READ_STRING(), R[a]);
+        break;
+      }
+      case ROP_SET_GLOBAL: {
+        uint8_t a = READ_BYTE();
+        ObjString* name = READ_STRING();
+        if ( tableSet(&vm.globals, name, R[a]) ) {
+          tableDelete(&vm.globals, name);
+          runtimeError("Undefined variable '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_GET_UPVALUE: {
+        uint8_t a = READ_BYTE();
+        R[a] = *frame->closure->upvalues[READ_BYTE()]->location;
+        break;
+      }
+      case ROP_SET_UPVALUE: {
+        uint8_t a = READ_BYTE();
+        *frame->closure->upvalues[READ_BYTE()]->location = R[a];
+        writeBarrier(R[a]);
+        break;
+      }
+      case ROP_EQUAL: {
+        uint8_t a = READ_BYTE();
+        Value b = R[READ_BYTE()];
+        R[a] = BOOL_VAL(valuesEqual(b, R[READ_BYTE()]));
+        break;
+      }
+      case ROP_EQUALK: {
+        uint8_t a = READ_BYTE();
+        Value b = R[READ_BYTE()];
+        R[a] = BOOL_VAL(valuesEqual(b, READ_CONSTANT()));
+        break;
+      }
+      case ROP_GREATER:
+        BINARY_OP(BOOL_VAL, >, R[READ_BYTE()]);
+        break;
+      case ROP_GREATERK:
+        BINARY_OP(BOOL_VAL, >, READ_CONSTANT());
+        break;
+      case ROP_LESS:
+        BINARY_OP(BOOL_VAL, <, R[READ_BYTE()]);
+        break;
+      case ROP_LESSK:
+        BINARY_OP(BOOL_VAL, <, READ_CONSTANT());
+        break;
+      case ROP_ADD: {
+        uint8_t a = READ_BYTE();
+        Value b = R[READ_BYTE()];
+        if ( !addValues(&R[a], b, R[READ_BYTE()]) ) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_ADDK: {
+        uint8_t a = READ_BYTE();
+        Value b = R[READ_BYTE()];
+        if ( !addValues(&R[a], b, READ_CONSTANT()) ) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_SUBTRACT:
+        BINARY_OP(NUMBER_VAL, -, R[READ_BYTE()]);
+        break;
+      case ROP_SUBTRACTK:
+        BINARY_OP(NUMBER_VAL, -, READ_CONSTANT());
+        break;
+      case ROP_MULTIPLY:
+        BINARY_OP(NUMBER_VAL, *, R[READ_BYTE()]);
+        break;
+      case ROP_MULTIPLYK:
+        BINARY_OP(NUMBER_VAL, *, READ_CONSTANT());
+        break;
+      case ROP_DIVIDE:
+        BINARY_OP(NUMBER_VAL, /, R[READ_BYTE()]);
+        break;
+      case ROP_DIVIDEK:
+        BINARY_OP(NUMBER_VAL, /, READ_CONSTANT());
+        break;
+      case ROP_NOT: {
+        uint8_t a = READ_BYTE();
+        R[a] = BOOL_VAL(isFalsey(R[READ_BYTE()]));
+        break;
+      }
+      case ROP_NEGATE: {
+        uint8_t a = READ_BYTE();
+        Value b = R[READ_BYTE()];
+        if ( !IS_NUMBER(b) ) {
+          runtimeError("Operand must be a number.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        R[a] = NUMBER_VAL(-AS_NUMBER(b));
+        break;
+      }
+      case ROP_PRINT:
+        printValue(R[READ_BYTE()]);
+        printf("\n");
+        break;
+      case ROP_JUMP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip += offset;
+        break;
+      }
+      case ROP_JUMP_IF_FALSE: {
+        uint8_t a = READ_BYTE();
+        uint16_t offset = READ_SHORT();
+        if ( isFalsey(R[a]) ) frame->ip += offset;
+        break;
+      }
+      case ROP_JUMP_IF_TRUE: {
+        uint8_t a = READ_BYTE();
+        uint16_t offset = READ_SHORT();
+        if ( !isFalsey(R[a]) ) frame->ip += offset;
+        break;
+      }
+      case ROP_LOOP: {
+        uint16_t offset = READ_SHORT();
+        frame->ip -= offset;
+        break;
+      }
+      case ROP_CALL: {
+        uint8_t a = READ_BYTE();
+        int argCount = READ_BYTE();
+        Value callee = R[a];
+        if ( IS_CLOSURE(callee) ) {
+          if ( !callRegisters(AS_CLOSURE(callee), &R[a], argCount) ) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          frame = &vm.frames[vm.frameCount - 1];
+          R = frame->slots;
+        } else if ( IS_NATIVE(callee) ) {
+          R[a] = AS_NATIVE(callee)(argCount, &R[a + 1]);
+        } else {
+          runtimeError("Can only call functions and classes.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_CLOSURE: {
+        uint8_t a = READ_BYTE();
+        ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+        ObjClosure* closure = newClosure(function);
+        R[a] = OBJ_VAL(closure);
+        frame->ip = captureUpvalues(closure, frame, frame->ip);
+        break;
+      }
+      case ROP_CLOSE_UPVALUES:
+        closeUpvalues(&R[READ_BYTE()]);
+        break;
+      case ROP_RETURN: {
+        Value result = R[READ_BYTE()];
+        closeUpvalues(frame->slots);
+        vm.frameCount--;
+        vm.stackTop = frame->callerTop;
+        if ( vm.frameCount == 0 ) {
+          // Pop the top-level script function
+          vm.stackTop = vm.stack;
+          return INTERPRET_OK;
+        }
+
+        // The result replaces the callee in the caller's registers
+        R[0] = result;
+        frame = &vm.frames[vm.frameCount - 1];
+        R = frame->slots;
+        break;
+      }
+    }
+  }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef BINARY_OP
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile the source and run it.
+ */
+InterpretResult interpret(const char* source)
+{
+  ObjFunction* function = compile(source);
+  if ( function == NULL ) return INTERPRET_COMPILE_ERROR;
+
+  return interpretFunction(function);
+}
+
+/*---------------------------------------------------------------------------*/
+
+InterpretResult interpretFunction(ObjFunction* function)
+{
+  // Keep the function reachable while its closure is allocated
+  push(OBJ_VAL(function));
+  ObjClosure* closure = newClosure(function);
+  pop();
+  push(OBJ_VAL(closure));
+
+  if ( function->chunk.format == CHUNK_REGISTER ) {
+    callRegisters(closure, vm.stackTop - 1, 0);
+    return runRegisters();
+  }
+
+  call(closure, 0);
+  return run();
+}
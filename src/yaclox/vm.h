@@ -0,0 +1,86 @@
+#ifndef clox_vm_h
+#define clox_vm_h
+
+#include "chunk.h"
+#include "object.h"
+#include "table.h"
+#include "value.h"
+
+#define FRAMES_MAX 64
+#define STACK_MAX  (FRAMES_MAX * UINT8_COUNT)
+
+// An ongoing function call
+typedef struct
+{
+  ObjClosure* closure;
+  uint8_t* ip;   // caller's return address when another function is called
+  Value* slots;  // first stack slot the function can use
+  Value* callerTop;  // register frames: stack top to restore on return
+} CallFrame;
+
+// Which instruction format the compiler emits and the VM runs
+typedef enum
+{
+  BACKEND_STACK,
+  BACKEND_REGISTER,
+} Backend;
+
+// Phases of an incremental collection cycle
+typedef enum
+{
+  GC_IDLE,           // no cycle in progress, mutator runs freely
+  GC_MARK,           // tracing gray objects a few at a time
+  GC_SWEEP_STRINGS,  // dropping white interned strings a few at a time
+  GC_SWEEP,          // freeing white objects a few at a time
+} GcPhase;
+
+typedef struct
+{
+  Backend backend;
+  uint64_t instructionCount;  // instructions executed so far
+  bool profiling;             // see startProfiler()
+  int jitThreshold;  // calls and loop iterations before a function is
+                     // compiled to machine code, 0 to never compile
+
+  CallFrame frames[FRAMES_MAX];
+  int frameCount;
+
+  Value stack[STACK_MAX];
+  Value* stackTop;  // where the next value to be pushed will go
+  Table globals;
+  Table strings;  // all interned strings
+  ObjUpvalue* openUpvalues;  // sorted by stack slot, highest slot first
+  Obj* objects;   // head of the list of all allocated objects
+  uint8_t* image;    // mapped bytecode image, see loadImage()
+  size_t imageSize;
+
+  // Garbage collector state
+  size_t bytesAllocated;  // live bytes handed out by reallocate()
+  size_t nextGC;          // threshold that starts the next cycle
+  GcPhase gcPhase;
+  bool currentMark;  // an object is black or gray iff obj->mark == currentMark
+  int sweepString;   // next entry of the strings table to be swept
+  Obj** sweepLink;   // link to the next object to be swept
+  int grayCount;
+  int grayCapacity;
+  Obj** grayStack;  // worklist of gray objects
+} VM;
+
+typedef enum
+{
+  INTERPRET_OK,
+  INTERPRET_COMPILE_ERROR,
+  INTERPRET_RUNTIME_ERROR
+} InterpretResult;
+
+extern VM vm;
+
+void initVM(void);
+void freeVM(void);
+InterpretResult interpret(const char* source);
+// Run an already compiled script, in the format its chunk was emitted in
+InterpretResult interpretFunction(ObjFunction* function);
+void push(Value value);
+Value pop(void);
+
+#endif  // !clox_vm_h
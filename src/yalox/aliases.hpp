@@ -8,6 +8,8 @@
 
 namespace lox {
 
+class LoxString;
+
 class LoxCallable;
 
 class LoxInstance;
@@ -18,9 +20,19 @@ using LoxInstancePtr = counted_ptr<LoxInstance>;
 
 // Lox values can be number, string, bool, callable (function, class)
 using LoxValueType =
-  std::variant<double, std::string, bool, LoxCallable, LoxInstancePtr>;
+  std::variant<double, LoxString, bool, LoxCallable, LoxInstancePtr>;
 
 // or nil
 using LoxObject = std::optional<LoxValueType>;
 
+// What is known of a value before the program runs
+enum class StaticType
+{
+  UNKNOWN,
+  NIL,
+  NUMBER,
+  STRING,
+  BOOL
+};
+
 }
@@ -62,9 +62,26 @@ std::string AstPrinter::visitAssignExpr(AssignExpr& expr)
 
 /*---------------------------------------------------------------------------*/
 
-std::string AstPrinter::visitCallExpr([[maybe_unused]] CallExpr& expr)
+std::string AstPrinter::visitCallExpr(CallExpr& expr)
 {
-  return "";
+  std::string call = "(call " + expr.callee->toString(*this);
+  for ( auto& arg : expr.arguments ) {
+    call += " " + arg->toString(*this);
+  }
+  return call + ")";
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** An inlined call prints as the call it replaces.
+ */
+std::string AstPrinter::visitInlineExpr(InlineExpr& expr)
+{
+  std::string call = "(inline " + expr.callee->toString(*this);
+  for ( auto& arg : expr.arguments ) {
+    call += " " + arg->toString(*this);
+  }
+  return call + ")";
 }
 
 /*---------------------------------------------------------------------------*/
@@ -0,0 +1,285 @@
+#include "asttransformer.hpp"
+#include "interpreter.hpp"
+
+#include <algorithm>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Whether every way through a statement ends with a return.
+ */
+bool alwaysReturns(const Stmt& stmt)
+{
+  if ( dynamic_cast<const ReturnStmt*>(&stmt) ) return true;
+
+  if ( auto block = dynamic_cast<const BlockStmt*>(&stmt) ) {
+    for ( const auto& inner : block->statements ) {
+      if ( alwaysReturns(*inner) ) return true;
+    }
+  } else if ( auto ifStmt = dynamic_cast<const IfStmt*>(&stmt) ) {
+    return ifStmt->elseBranch && alwaysReturns(*(ifStmt->thenBranch)) &&
+           alwaysReturns(*(ifStmt->elseBranch));
+  }
+
+  return false;
+}
+
+/*---------------------------------------------------------------------------*/
+
+AstTransformer::AstTransformer(Interpreter& interpreter)
+  : intpr_(interpreter)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Transform a list of statements, dropping those that became empty.
+ */
+void AstTransformer::transform(std::vector<StmtPtr>& statements)
+{
+  for ( auto& stmt : statements ) {
+    transform(stmt);
+  }
+
+  std::erase_if(statements, [this](StmtPtr& stmt) {
+    auto block = dynamic_cast<BlockStmt*>(stmt.get());
+    if ( !block || !block->statements.empty() ) return false;
+
+    intpr_.retire(std::move(stmt));
+    return true;
+  });
+}
+
+/*---------------------------------------------------------------------------*/
+
+void AstTransformer::transform(StmtPtr& stmt)
+{
+  if ( auto replacement = stmt->transform(*this) ) {
+    intpr_.retire(std::move(stmt));
+    stmt = std::move(replacement);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void AstTransformer::transform(ExprPtr& expr)
+{
+  if ( auto replacement = expr->transform(*this) ) {
+    intpr_.retire(std::move(expr));
+    expr = std::move(replacement);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::emptyStmt()
+{
+  return std::make_unique<BlockStmt>(std::vector<StmtPtr>{});
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitAssignExpr(AssignExpr& expr)
+{
+  transform(expr.value);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitBinaryExpr(BinaryExpr& expr)
+{
+  transform(expr.left);
+  transform(expr.right);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitCallExpr(CallExpr& expr)
+{
+  transform(expr.callee);
+  for ( auto& arg : expr.arguments ) {
+    transform(arg);
+  }
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitGetExpr(GetExpr& expr)
+{
+  transform(expr.object);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitGroupingExpr(GroupingExpr& expr)
+{
+  transform(expr.expression);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitInlineExpr(InlineExpr& expr)
+{
+  transform(expr.callee);
+  for ( auto& arg : expr.arguments ) {
+    transform(arg);
+  }
+  transform(expr.body);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitLiteralExpr(LiteralExpr& /* unused */)
+{
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitLogicalExpr(LogicalExpr& expr)
+{
+  transform(expr.left);
+  transform(expr.right);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitSetExpr(SetExpr& expr)
+{
+  transform(expr.object);
+  transform(expr.value);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitThisExpr(ThisExpr& /* unused */)
+{
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitUnaryExpr(UnaryExpr& expr)
+{
+  transform(expr.right);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AstTransformer::visitVariableExpr(VariableExpr& /* unused */)
+{
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitBlockStmt(BlockStmt& stmt)
+{
+  transform(stmt.statements);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitClassStmt(ClassStmt& stmt)
+{
+  // Methods stay FunctionStmt nodes, only their bodies change
+  for ( auto& method : stmt.methods ) {
+    method->transform(*this);
+  }
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitExprStmt(ExprStmt& stmt)
+{
+  transform(stmt.expression);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitFunctionStmt(FunctionStmt& stmt)
+{
+  transform(stmt.body);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitIfStmt(IfStmt& stmt)
+{
+  transform(stmt.condition);
+  transform(stmt.thenBranch);
+  if ( stmt.elseBranch ) {
+    transform(stmt.elseBranch);
+  }
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitPrintStmt(PrintStmt& stmt)
+{
+  transform(stmt.expression);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitReturnStmt(ReturnStmt& stmt)
+{
+  if ( stmt.value ) {
+    transform(stmt.value);
+  }
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitVarStmt(VarStmt& stmt)
+{
+  if ( stmt.initializer ) {
+    transform(stmt.initializer);
+  }
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitWhileStmt(WhileStmt& stmt)
+{
+  transform(stmt.condition);
+  transform(stmt.body);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr AstTransformer::visitForStmt(ForStmt& stmt)
+{
+  if ( stmt.initializer ) {
+    transform(stmt.initializer);
+  }
+  if ( stmt.condition ) {
+    transform(stmt.condition);
+  }
+  transform(stmt.body);
+  if ( stmt.increment ) {
+    transform(stmt.increment);
+  }
+  return nullptr;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "stmt.hpp"
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+// Whether every way through a statement ends with a return
+bool alwaysReturns(const Stmt&);
+
+/*---------------------------------------------------------------------------*/
+
+/** Base class for passes that rewrite resolved syntax trees in place.
+ *
+ * A visit method returns the node that takes the place of the visited one, or
+ * nullptr to keep it. The default methods keep every node and only transform
+ * its children, so a pass overrides just the nodes it rewrites.
+ *
+ * Nodes taken out of the tree are handed to the interpreter rather than freed:
+ * a new node allocated at the same address must not pick up the resolution
+ * data of an old one.
+ */
+class AstTransformer
+  : public ExprVisitor<ExprPtr>
+  , public StmtVisitor<StmtPtr>
+{
+public:
+  AstTransformer(Interpreter&);
+
+  void transform(std::vector<StmtPtr>&);
+
+  // Every node of the tree goes through one of these two, which a pass that
+  // only inspects the tree can override.
+  virtual void transform(StmtPtr&);
+
+  virtual void transform(ExprPtr&);
+
+  ExprPtr visitAssignExpr(AssignExpr&) override;
+  ExprPtr visitBinaryExpr(BinaryExpr&) override;
+  ExprPtr visitCallExpr(CallExpr&) override;
+  ExprPtr visitGetExpr(GetExpr&) override;
+  ExprPtr visitGroupingExpr(GroupingExpr&) override;
+  ExprPtr visitInlineExpr(InlineExpr&) override;
+  ExprPtr visitLiteralExpr(LiteralExpr&) override;
+  ExprPtr visitLogicalExpr(LogicalExpr&) override;
+  ExprPtr visitSetExpr(SetExpr&) override;
+  ExprPtr visitThisExpr(ThisExpr&) override;
+  ExprPtr visitUnaryExpr(UnaryExpr&) override;
+  ExprPtr visitVariableExpr(VariableExpr&) override;
+
+  StmtPtr visitBlockStmt(BlockStmt&) override;
+  StmtPtr visitClassStmt(ClassStmt&) override;
+  StmtPtr visitExprStmt(ExprStmt&) override;
+  StmtPtr visitFunctionStmt(FunctionStmt&) override;
+  StmtPtr visitIfStmt(IfStmt&) override;
+  StmtPtr visitPrintStmt(PrintStmt&) override;
+  StmtPtr visitReturnStmt(ReturnStmt&) override;
+  StmtPtr visitVarStmt(VarStmt&) override;
+  StmtPtr visitWhileStmt(WhileStmt&) override;
+  StmtPtr visitForStmt(ForStmt&) override;
+
+protected:
+  Interpreter& intpr_;
+
+  // A statement that does nothing, which statement lists drop
+  static StmtPtr emptyStmt();
+};
+
+}
@@ -0,0 +1,694 @@
+#include "closurecompiler.hpp"
+#include "interpreter.hpp"
+
+#include <cassert>
+
+namespace lox {
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+bool isNumber(const Expr& expr)
+{
+  return expr.type == StaticType::NUMBER;
+}
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+ClosureCompiler::ClosureCompiler(Interpreter& interpreter)
+  : interpreter_(interpreter)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::compile(Expr& expr)
+{
+  return expr.compile(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::compile(Stmt& stmt)
+{
+  return stmt.compile(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledBlock ClosureCompiler::compile(const std::vector<StmtPtr>& statements)
+{
+  CompiledBlock block;
+  block.reserve(statements.size());
+  for ( auto& stmt : statements ) {
+    block.emplace_back(compile(*stmt));
+  }
+
+  return block;
+}
+
+/*---------------------------------------------------------------------------*/
+
+const CompiledBlock& ClosureCompiler::body(FunctionStmt& funcStmt)
+{
+  if ( auto it = bodies_.find(&funcStmt); it != bodies_.end() ) {
+    return it->second;
+  }
+
+  return bodies_.emplace(&funcStmt, compile(funcStmt.body)).first->second;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Look up a variable at the scope depth the resolver found for it, or in the
+ * globals if it found none.
+ */
+CompiledExpr ClosureCompiler::lookUpVariable(const Token& name, Expr& expr)
+{
+  auto intpr = &interpreter_;
+
+  if ( const auto it = intpr->locals_.find(&expr);
+       it != intpr->locals_.end() ) {
+    return [intpr, depth = it->second, name = name.lexeme()]() -> LoxObject {
+      return intpr->env_->getAt(depth, name);
+    };
+  }
+
+  // Globals are never removed, so once the variable is defined its value
+  // stays at the same place in the globals for good
+  const LoxObject* value = nullptr;
+  return [intpr, name, value]() mutable {
+    if ( !value ) value = &intpr->globals->get(name);
+    return *value;
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitAssignExpr(AssignExpr& expr)
+{
+  auto intpr = &interpreter_;
+  auto value = compile(*(expr.value));
+
+  if ( const auto it = intpr->locals_.find(&expr);
+       it != intpr->locals_.end() ) {
+    return [intpr, depth = it->second, name = expr.name, value]() {
+      LoxObject result = value();
+      intpr->env_->assignAt(depth, name, result);
+      return result;
+    };
+  }
+
+  return [intpr, name = expr.name, value]() {
+    LoxObject result = value();
+    intpr->globals->assign(name, result);
+    return result;
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile an arithmetic or comparison operator, which is only defined for
+ * two numbers.
+ */
+template <typename Op>
+CompiledExpr ClosureCompiler::numberOperation(BinaryExpr& expr, Op op)
+{
+  // Operands that TypeInferrer proved to be numbers need no checks
+  if ( isNumber(*(expr.left)) && isNumber(*(expr.right)) ) {
+    return [left = compile(*(expr.left)),
+            right = compile(*(expr.right)),
+            op]() -> LoxObject {
+      return op(
+        std::get<double>(left().value()), std::get<double>(right().value()));
+    };
+  }
+
+  return [intpr = &interpreter_,
+          left = compile(*(expr.left)),
+          right = compile(*(expr.right)),
+          token = expr.op,
+          op]() -> LoxObject {
+    auto a = left();
+    auto b = right();
+    intpr->validateNumberOperands(token, a, b);
+    return op(std::get<double>(a.value()), std::get<double>(b.value()));
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitBinaryExpr(BinaryExpr& expr)
+{
+  switch ( expr.op.type() ) {
+    case TokenType::MINUS:
+      return numberOperation(expr, [](double a, double b) { return a - b; });
+    case TokenType::SLASH:
+      return numberOperation(expr, [](double a, double b) { return a / b; });
+    case TokenType::STAR:
+      return numberOperation(expr, [](double a, double b) { return a * b; });
+    case TokenType::GREATER:
+      return numberOperation(expr, [](double a, double b) { return a > b; });
+    case TokenType::GREATER_EQUAL:
+      return numberOperation(expr, [](double a, double b) { return a >= b; });
+    case TokenType::LESS:
+      return numberOperation(expr, [](double a, double b) { return a < b; });
+    case TokenType::LESS_EQUAL:
+      return numberOperation(expr, [](double a, double b) { return a <= b; });
+    default:
+      break;
+  }
+
+  auto left = compile(*(expr.left));
+  auto right = compile(*(expr.right));
+
+  switch ( expr.op.type() ) {
+    case TokenType::PLUS:
+      if ( isNumber(*(expr.left)) && isNumber(*(expr.right)) ) {
+        return [left, right]() -> LoxObject {
+          return std::get<double>(left().value()) +
+                 std::get<double>(right().value());
+        };
+      }
+      if ( expr.left->type == StaticType::STRING &&
+           expr.right->type == StaticType::STRING ) {
+        return [left, right]() -> LoxObject {
+          return std::get<LoxString>(left().value()) +
+                 std::get<LoxString>(right().value());
+        };
+      }
+      return [left, right, token = expr.op]() -> LoxObject {
+        auto a = left();
+        auto b = right();
+        if ( a && b ) {
+          if (
+            std::holds_alternative<double>(a.value()) &&
+            std::holds_alternative<double>(b.value()) ) {
+            return std::get<double>(a.value()) + std::get<double>(b.value());
+          }
+          if (
+            std::holds_alternative<LoxString>(a.value()) &&
+            std::holds_alternative<LoxString>(b.value()) ) {
+            return std::get<LoxString>(a.value()) +
+                   std::get<LoxString>(b.value());
+          }
+        }
+
+        throw RuntimeError(
+          token, "Operands must be two numbers or two strings.");
+      };
+
+    case TokenType::BANG_EQUAL:
+      return [left, right]() -> LoxObject {
+        auto a = left();
+        auto b = right();
+        return a != b;
+      };
+    case TokenType::EQUAL_EQUAL:
+      return [left, right]() -> LoxObject {
+        auto a = left();
+        auto b = right();
+        return a == b;
+      };
+
+    default:
+      break;
+  }
+
+  // unreachable
+  return [left, right]() -> LoxObject {
+    left();
+    right();
+    return {};
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitCallExpr(CallExpr& expr)
+{
+  std::vector<CompiledExpr> arguments;
+  arguments.reserve(expr.arguments.size());
+  for ( auto& arg : expr.arguments ) {
+    arguments.emplace_back(compile(*arg));
+  }
+
+  return [callee = compile(*(expr.callee)),
+          arguments = std::move(arguments),
+          paren = expr.closingParen]() -> LoxObject {
+    LoxObject object = callee();
+
+    LoxArguments args{};
+    args.reserve(arguments.size());
+    for ( auto& arg : arguments ) {
+      args.emplace_back(arg());
+    }
+
+    validateLoxCallable(paren, object);
+    auto& function = std::get<LoxCallable>(object.value());
+
+    validateFunctionArity(paren, args, function);
+
+    return callFunction(std::move(function), args);
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitGetExpr(GetExpr& expr)
+{
+  return [intpr = &interpreter_,
+          object = compile(*(expr.object)),
+          name = expr.name]() -> LoxObject {
+    LoxObject instance = object();
+    if (
+      instance && std::holds_alternative<LoxInstancePtr>(instance.value()) ) {
+      auto& prop = std::get<LoxInstancePtr>(instance.value())->get(name);
+      if ( prop && std::holds_alternative<LoxCallable>(prop.value()) ) {
+        // Bind "this" to the current instance for methods
+        intpr->bindInstance(std::get<LoxCallable>(prop.value()), instance);
+      }
+      return prop;
+    }
+
+    throw RuntimeError(name, "Only instances have properties.");
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Grouping only matters to the parser: the compiled expression is the inner
+ * one.
+ */
+CompiledExpr ClosureCompiler::visitGroupingExpr(GroupingExpr& expr)
+{
+  return compile(*(expr.expression));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** See Interpreter::visitInlineExpr(). The body is compiled into a closure
+ * that returns the value of its last return statement.
+ */
+CompiledExpr ClosureCompiler::visitInlineExpr(InlineExpr& expr)
+{
+  std::vector<CompiledExpr> arguments;
+  arguments.reserve(expr.arguments.size());
+  for ( auto& arg : expr.arguments ) {
+    arguments.emplace_back(compile(*arg));
+  }
+
+  return [intpr = &interpreter_,
+          callee = compile(*(expr.callee)),
+          arguments = std::move(arguments),
+          paren = expr.closingParen,
+          function = expr.function,
+          body = compileTail(expr.body)]() -> LoxObject {
+    LoxObject object = callee();
+
+    LoxArguments args{};
+    args.reserve(arguments.size());
+    for ( auto& arg : arguments ) {
+      args.emplace_back(arg());
+    }
+
+    if ( !isInlined(object, *function) ) {
+      validateLoxCallable(paren, object);
+      auto& lc = std::get<LoxCallable>(object.value());
+
+      validateFunctionArity(paren, args, lc);
+
+      return callFunction(std::move(lc), args);
+    }
+
+    EnvPtr inlineEnv{ new Environment{ intpr->globals } };
+    for ( size_t i = 0; i < args.size(); ++i ) {
+      inlineEnv->define(function->params[i].lexeme(), std::move(args[i]));
+    }
+
+    EnvBlockGuard eg{ intpr->env_ };
+    intpr->env_ = inlineEnv;
+    return body();
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::compileTail(const std::vector<StmtPtr>& block)
+{
+  if ( block.empty() ) {
+    return []() { return LoxObject{}; };
+  }
+
+  CompiledBlock init;
+  for ( size_t i = 0; i + 1 < block.size(); ++i ) {
+    init.emplace_back(compile(*block[i]));
+  }
+
+  auto last = compileTail(*(block.back()));
+  if ( init.empty() ) return last;
+
+  return [init, last]() {
+    for ( auto& stmt : init ) {
+      stmt();
+    }
+    return last();
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::compileTail(Stmt& stmt)
+{
+  auto intpr = &interpreter_;
+
+  if ( auto returnStmt = dynamic_cast<ReturnStmt*>(&stmt) ) {
+    if ( !returnStmt->value ) return []() { return LoxObject{}; };
+    return compile(*(returnStmt->value));
+  }
+
+  if ( auto ifStmt = dynamic_cast<IfStmt*>(&stmt) ) {
+    return [intpr,
+            condition = compile(*(ifStmt->condition)),
+            thenBranch = compileTail(*(ifStmt->thenBranch)),
+            elseBranch = ifStmt->elseBranch
+                           ? compileTail(*(ifStmt->elseBranch))
+                           : []() { return LoxObject{}; }]() {
+      return intpr->isTruthy(condition()) ? thenBranch() : elseBranch();
+    };
+  }
+
+  if ( auto block = dynamic_cast<BlockStmt*>(&stmt) ) {
+    return [intpr, statements = compileTail(block->statements)]() {
+      EnvPtr blockEnv{ new Environment{ intpr->env_ } };
+      EnvBlockGuard eg{ intpr->env_ };
+      intpr->env_ = blockEnv;
+      return statements();
+    };
+  }
+
+  return [compiled = compile(stmt)]() {
+    compiled();
+    return LoxObject{};
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitLiteralExpr(LiteralExpr& expr)
+{
+  return [value = expr.value]() { return value; };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitLogicalExpr(LogicalExpr& expr)
+{
+  auto intpr = &interpreter_;
+  auto left = compile(*(expr.left));
+  auto right = compile(*(expr.right));
+
+  if ( expr.op.type() == TokenType::OR ) {
+    return [intpr, left, right]() {
+      auto value = left();
+      // short circuit for OR op
+      if ( intpr->isTruthy(value) ) return value;
+      return right();
+    };
+  }
+
+  return [intpr, left, right]() {
+    auto value = left();
+    // short circuit for AND op
+    if ( !intpr->isTruthy(value) ) return value;
+    return right();
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Like the tree-walk interpreter, assign the object back to the variable it
+ * was read from once the field is set.
+ */
+CompiledExpr ClosureCompiler::visitSetExpr(SetExpr& expr)
+{
+  auto intpr = &interpreter_;
+
+  // The variable the object was read from, if any
+  const Token* variable = nullptr;
+  if ( auto var = dynamic_cast<VariableExpr*>(expr.object.get()) ) {
+    variable = &var->name;
+  } else if ( auto self = dynamic_cast<ThisExpr*>(expr.object.get()) ) {
+    variable = &self->keyword;
+  }
+
+  std::function<void(const LoxObject&)> reassign = [](const LoxObject&) {};
+  if ( variable ) {
+    if ( const auto it = intpr->locals_.find(expr.object.get());
+         it != intpr->locals_.end() ) {
+      reassign = [intpr, depth = it->second, name = *variable](
+                   const LoxObject& object) {
+        intpr->env_->assignAt(depth, name, object);
+      };
+    } else {
+      reassign = [intpr, name = *variable](const LoxObject& object) {
+        intpr->globals->assign(name, object);
+      };
+    }
+  }
+
+  return [object = compile(*(expr.object)),
+          value = compile(*(expr.value)),
+          name = expr.name,
+          reassign]() -> LoxObject {
+    LoxObject instance = object();
+
+    if (
+      instance && std::holds_alternative<LoxInstancePtr>(instance.value()) ) {
+      auto result = value();
+      std::get<LoxInstancePtr>(instance.value())->set(name, result);
+      reassign(instance);
+      return result;
+    }
+
+    throw RuntimeError(name, "Only instance have fields.");
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitThisExpr(ThisExpr& expr)
+{
+  return lookUpVariable(expr.keyword, expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitUnaryExpr(UnaryExpr& expr)
+{
+  auto intpr = &interpreter_;
+  auto right = compile(*(expr.right));
+
+  if ( expr.op.type() == TokenType::BANG ) {
+    return [intpr, right]() -> LoxObject { return !intpr->isTruthy(right()); };
+  }
+
+  assert(expr.op.type() == TokenType::MINUS);
+  if ( isNumber(*(expr.right)) ) {
+    return [right]() -> LoxObject {
+      return -(std::get<double>(right().value()));
+    };
+  }
+
+  return [intpr, right, token = expr.op]() -> LoxObject {
+    auto value = right();
+    intpr->validateNumberOperand(token, value);
+    return -(std::get<double>(value.value()));
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr ClosureCompiler::visitVariableExpr(VariableExpr& expr)
+{
+  return lookUpVariable(expr.name, expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitBlockStmt(BlockStmt& stmt)
+{
+  return [intpr = &interpreter_, block = compile(stmt.statements)]() {
+    // execute the block in a new env whose outer scope is the current env.
+    EnvPtr blockEnv{ new Environment{ intpr->env_ } };
+    intpr->executeBlock(block, blockEnv);
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Class declarations only run once per declaration and have nothing to
+ * specialize. Their methods are made with Interpreter::makeLoxCallable(),
+ * which compiles their bodies in CLOSURES mode.
+ */
+CompiledStmt ClosureCompiler::visitClassStmt(ClassStmt& stmt)
+{
+  return [intpr = &interpreter_, &stmt]() { intpr->visitClassStmt(stmt); };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitExprStmt(ExprStmt& stmt)
+{
+  return [expression = compile(*(stmt.expression))]() { expression(); };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitFunctionStmt(FunctionStmt& stmt)
+{
+  return [intpr = &interpreter_, &stmt]() {
+    intpr->env_->define(
+      stmt.name.lexeme(), intpr->makeLoxCallable(stmt, intpr->env_, false));
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitIfStmt(IfStmt& stmt)
+{
+  auto intpr = &interpreter_;
+  auto condition = compile(*(stmt.condition));
+  auto thenBranch = compile(*(stmt.thenBranch));
+
+  if ( !stmt.elseBranch ) {
+    return [intpr, condition, thenBranch]() {
+      if ( intpr->isTruthy(condition()) ) thenBranch();
+    };
+  }
+
+  return [intpr,
+          condition,
+          thenBranch,
+          elseBranch = compile(*(stmt.elseBranch))]() {
+    if ( intpr->isTruthy(condition()) ) {
+      thenBranch();
+    } else {
+      elseBranch();
+    }
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitPrintStmt(PrintStmt& stmt)
+{
+  return [intpr = &interpreter_, expression = compile(*(stmt.expression))]() {
+    intpr->out_->write(toString(expression()));
+    intpr->out_->write("\n");
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** See Interpreter::visitReturnStmt().
+ */
+CompiledStmt ClosureCompiler::visitReturnStmt(ReturnStmt& stmt)
+{
+  if ( auto call = interpreter_.tailCall(stmt) ) {
+    std::vector<CompiledExpr> arguments;
+    arguments.reserve(call->arguments.size());
+    for ( auto& arg : call->arguments ) {
+      arguments.emplace_back(compile(*arg));
+    }
+
+    return [callee = compile(*(call->callee)),
+            arguments = std::move(arguments),
+            paren = call->closingParen]() {
+      LoxObject object = callee();
+
+      LoxArguments args{};
+      args.reserve(arguments.size());
+      for ( auto& arg : arguments ) {
+        args.emplace_back(arg());
+      }
+
+      validateLoxCallable(paren, object);
+      auto& function = std::get<LoxCallable>(object.value());
+
+      validateFunctionArity(paren, args, function);
+
+      throw TailCall(std::move(function), std::move(args));
+    };
+  }
+
+  if ( !stmt.value ) {
+    return []() { throw ReturnValue({}); };
+  }
+
+  return [value = compile(*(stmt.value))]() { throw ReturnValue(value()); };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitVarStmt(VarStmt& stmt)
+{
+  auto intpr = &interpreter_;
+
+  if ( !stmt.initializer ) {
+    return [intpr, name = stmt.name.lexeme()]() {
+      intpr->env_->define(name, {});
+    };
+  }
+
+  return [intpr,
+          name = stmt.name.lexeme(),
+          initializer = compile(*(stmt.initializer))]() {
+    intpr->env_->define(name, initializer());
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitWhileStmt(WhileStmt& stmt)
+{
+  return [intpr = &interpreter_,
+          condition = compile(*(stmt.condition)),
+          body = compile(*(stmt.body))]() {
+    while ( intpr->isTruthy(condition()) ) {
+      body();
+    }
+  };
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ClosureCompiler::visitForStmt(ForStmt& stmt)
+{
+  // Lox requires a body in for loop so no need to check for null here
+  assert(stmt.body);
+
+  auto intpr = &interpreter_;
+  auto body = compile(*(stmt.body));
+
+  CompiledStmt initializer;
+  CompiledExpr condition;
+  CompiledExpr increment;
+  if ( stmt.initializer ) initializer = compile(*(stmt.initializer));
+  if ( stmt.condition ) condition = compile(*(stmt.condition));
+  if ( stmt.increment ) increment = compile(*(stmt.increment));
+
+  return [intpr, initializer, condition, increment, body]() {
+    if ( initializer ) initializer();
+
+    while ( !condition || intpr->isTruthy(condition()) ) {
+      body();
+      if ( increment ) increment();
+    }
+  };
+}
+
+}
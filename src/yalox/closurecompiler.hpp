@@ -0,0 +1,81 @@
+#pragma once
+
+#include "stmt.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+using CompiledBlock = std::vector<CompiledStmt>;
+
+/*---------------------------------------------------------------------------*/
+
+/** Compile resolved statements into trees of closures, which is how the
+ * interpreter runs them in its CLOSURES mode.
+ *
+ * Everything about a node that cannot change once the resolver has run (the
+ * scope depth of a variable, the operator of an expression, the value of a
+ * literal) is looked at here, once, and baked into a closure made for just
+ * that case. Running the closure then only does the work left to do at
+ * runtime: no visitor dispatch, no switch on the operator and no lookup in
+ * the interpreter's locals_.
+ */
+class ClosureCompiler
+  : public ExprVisitor<CompiledExpr>
+  , public StmtVisitor<CompiledStmt>
+{
+public:
+  ClosureCompiler(Interpreter&);
+
+  CompiledExpr compile(Expr&);
+
+  CompiledStmt compile(Stmt&);
+
+  // The function's body, compiled the first time it is asked for. The block
+  // is kept as long as the compiler and shared by all closures of the function.
+  const CompiledBlock& body(FunctionStmt&);
+
+  CompiledExpr visitAssignExpr(AssignExpr&) override;
+  CompiledExpr visitBinaryExpr(BinaryExpr&) override;
+  CompiledExpr visitCallExpr(CallExpr&) override;
+  CompiledExpr visitGetExpr(GetExpr&) override;
+  CompiledExpr visitGroupingExpr(GroupingExpr&) override;
+  CompiledExpr visitInlineExpr(InlineExpr&) override;
+  CompiledExpr visitLiteralExpr(LiteralExpr&) override;
+  CompiledExpr visitLogicalExpr(LogicalExpr&) override;
+  CompiledExpr visitSetExpr(SetExpr&) override;
+  CompiledExpr visitThisExpr(ThisExpr&) override;
+  CompiledExpr visitUnaryExpr(UnaryExpr&) override;
+  CompiledExpr visitVariableExpr(VariableExpr&) override;
+
+  CompiledStmt visitBlockStmt(BlockStmt&) override;
+  CompiledStmt visitClassStmt(ClassStmt&) override;
+  CompiledStmt visitExprStmt(ExprStmt&) override;
+  CompiledStmt visitFunctionStmt(FunctionStmt&) override;
+  CompiledStmt visitIfStmt(IfStmt&) override;
+  CompiledStmt visitPrintStmt(PrintStmt&) override;
+  CompiledStmt visitReturnStmt(ReturnStmt&) override;
+  CompiledStmt visitVarStmt(VarStmt&) override;
+  CompiledStmt visitWhileStmt(WhileStmt&) override;
+  CompiledStmt visitForStmt(ForStmt&) override;
+
+private:
+  Interpreter& interpreter_;
+
+  std::unordered_map<FunctionStmt*, CompiledBlock> bodies_;
+
+  CompiledBlock compile(const std::vector<StmtPtr>&);
+
+  CompiledExpr lookUpVariable(const Token&, Expr&);
+
+  CompiledExpr compileTail(const std::vector<StmtPtr>&);
+  CompiledExpr compileTail(Stmt&);
+
+  template <typename Op>
+  CompiledExpr numberOperation(BinaryExpr&, Op);
+};
+
+}
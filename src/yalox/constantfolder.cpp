@@ -0,0 +1,222 @@
+#include "constantfolder.hpp"
+#include "yalox.hpp"
+
+namespace lox {
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+LiteralExpr* asLiteral(const ExprPtr& expr)
+{
+  return dynamic_cast<LiteralExpr*>(expr.get());
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** false and nil are falsey, and everything else is truthy.
+ */
+bool isTruthy(const LoxObject& value)
+{
+  if ( !value ) return false;
+
+  if ( std::holds_alternative<bool>(value.value()) ) {
+    return std::get<bool>(value.value());
+  }
+
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Whether an expression can only evaluate to true or false.
+ */
+bool isBoolean(const Expr& expr)
+{
+  if ( auto unary = dynamic_cast<const UnaryExpr*>(&expr) ) {
+    return unary->op.type() == TokenType::BANG;
+  }
+
+  if ( auto binary = dynamic_cast<const BinaryExpr*>(&expr) ) {
+    switch ( binary->op.type() ) {
+      case TokenType::BANG_EQUAL:
+      case TokenType::EQUAL_EQUAL:
+      case TokenType::GREATER:
+      case TokenType::GREATER_EQUAL:
+      case TokenType::LESS:
+      case TokenType::LESS_EQUAL:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+ConstantFolder::ConstantFolder(Interpreter& interpreter)
+  : AstTransformer(interpreter)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+void ConstantFolder::fold(std::vector<StmtPtr>& statements)
+{
+  transform(statements);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void ConstantFolder::fold(ExprPtr& expr)
+{
+  transform(expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool ConstantFolder::failed() const
+{
+  return failed_;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Evaluate an expression whose operands are all literals. The interpreter
+ * does the work, so a folded value is exactly the one the program would
+ * compute.
+ */
+ExprPtr ConstantFolder::evaluate(Expr& expr)
+{
+  try {
+    return std::make_unique<LiteralExpr>(expr.evaluate(intpr_));
+  } catch ( const RuntimeError& error ) {
+    // The operation would fail every time it runs
+    YaLox::error(error.token, error.what());
+    failed_ = true;
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr ConstantFolder::visitBinaryExpr(BinaryExpr& expr)
+{
+  AstTransformer::visitBinaryExpr(expr);
+
+  if ( asLiteral(expr.left) && asLiteral(expr.right) ) {
+    return evaluate(expr);
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Parentheses only matter to the parser.
+ */
+ExprPtr ConstantFolder::visitGroupingExpr(GroupingExpr& expr)
+{
+  AstTransformer::visitGroupingExpr(expr);
+
+  return std::move(expr.expression);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A literal on the left decides which side is the value: "nil or x" is x,
+ * "1 or x" is 1, "false and x" is false and "true and x" is x.
+ */
+ExprPtr ConstantFolder::visitLogicalExpr(LogicalExpr& expr)
+{
+  AstTransformer::visitLogicalExpr(expr);
+
+  if ( auto left = asLiteral(expr.left) ) {
+    const bool isOr = expr.op.type() == TokenType::OR;
+    if ( isTruthy(left->value) == isOr ) {
+      return std::move(expr.left);
+    }
+    return std::move(expr.right);
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Besides literals, "!!x" is x when x is already true or false.
+ */
+ExprPtr ConstantFolder::visitUnaryExpr(UnaryExpr& expr)
+{
+  AstTransformer::visitUnaryExpr(expr);
+
+  if ( asLiteral(expr.right) ) {
+    return evaluate(expr);
+  }
+
+  if ( expr.op.type() == TokenType::BANG ) {
+    auto inner = dynamic_cast<UnaryExpr*>(expr.right.get());
+    if ( inner && inner->op.type() == TokenType::BANG &&
+         isBoolean(*(inner->right)) ) {
+      return std::move(inner->right);
+    }
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ConstantFolder::visitIfStmt(IfStmt& stmt)
+{
+  AstTransformer::visitIfStmt(stmt);
+
+  if ( auto condition = asLiteral(stmt.condition) ) {
+    if ( isTruthy(condition->value) ) return std::move(stmt.thenBranch);
+    if ( stmt.elseBranch ) return std::move(stmt.elseBranch);
+    return emptyStmt();
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ConstantFolder::visitWhileStmt(WhileStmt& stmt)
+{
+  AstTransformer::visitWhileStmt(stmt);
+
+  if ( auto condition = asLiteral(stmt.condition) ) {
+    if ( !isTruthy(condition->value) ) return emptyStmt();
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A loop that never runs leaves only its initializer, and a loop that always
+ * runs does not need to test its condition.
+ */
+StmtPtr ConstantFolder::visitForStmt(ForStmt& stmt)
+{
+  AstTransformer::visitForStmt(stmt);
+
+  if ( stmt.condition ) {
+    if ( auto condition = asLiteral(stmt.condition) ) {
+      if ( !isTruthy(condition->value) ) {
+        return stmt.initializer ? std::move(stmt.initializer) : emptyStmt();
+      }
+      intpr_.retire(std::move(stmt.condition));
+    }
+  }
+
+  return nullptr;
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "asttransformer.hpp"
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Evaluate at compile time what does not depend on the running program.
+ *
+ * Unary, binary and grouping expressions on literals become literals, logical
+ * expressions with a literal on the left become the side they evaluate to,
+ * and if, while and for statements with a literal condition become the code
+ * that runs. An operation on literals that would fail at runtime is reported
+ * as a compile error instead.
+ */
+class ConstantFolder : public AstTransformer
+{
+public:
+  ConstantFolder(Interpreter&);
+
+  void fold(std::vector<StmtPtr>&);
+
+  void fold(ExprPtr&);
+
+  // Whether an operation that would always fail was reported
+  bool failed() const;
+
+  ExprPtr visitBinaryExpr(BinaryExpr&) override;
+  ExprPtr visitGroupingExpr(GroupingExpr&) override;
+  ExprPtr visitLogicalExpr(LogicalExpr&) override;
+  ExprPtr visitUnaryExpr(UnaryExpr&) override;
+
+  StmtPtr visitIfStmt(IfStmt&) override;
+  StmtPtr visitWhileStmt(WhileStmt&) override;
+  StmtPtr visitForStmt(ForStmt&) override;
+
+private:
+  bool failed_{};
+
+  ExprPtr evaluate(Expr&);
+};
+
+}
@@ -0,0 +1,322 @@
+#include "deadcodeeliminator.hpp"
+#include "interpreter.hpp"
+#include "typeinferrer.hpp"
+
+#include <algorithm>
+
+namespace lox {
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+/** Whether evaluating an expression has no effect and cannot fail.
+ */
+bool harmless(Interpreter& interpreter, Expr& expr)
+{
+  if ( dynamic_cast<LiteralExpr*>(&expr) ) return true;
+
+  // Only globals can be read before they are declared
+  if ( dynamic_cast<VariableExpr*>(&expr) ) {
+    return !interpreter.isGlobal(expr);
+  }
+
+  if ( auto grouping = dynamic_cast<GroupingExpr*>(&expr) ) {
+    return harmless(interpreter, *(grouping->expression));
+  }
+
+  if ( auto unary = dynamic_cast<UnaryExpr*>(&expr) ) {
+    return harmless(interpreter, *(unary->right)) &&
+           !TypeInferrer::canFail(*unary);
+  }
+
+  if ( auto binary = dynamic_cast<BinaryExpr*>(&expr) ) {
+    return harmless(interpreter, *(binary->left)) &&
+           harmless(interpreter, *(binary->right)) &&
+           !TypeInferrer::canFail(*binary);
+  }
+
+  if ( auto logical = dynamic_cast<LogicalExpr*>(&expr) ) {
+    return harmless(interpreter, *(logical->left)) &&
+           harmless(interpreter, *(logical->right));
+  }
+
+  return false;
+}
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+DeadCodeEliminator::DeadCodeEliminator(
+  Interpreter& interpreter,
+  bool closedWorld)
+  : AstTransformer(interpreter)
+  , closedWorld_(closedWorld)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Each round finds what is used, then sweeps what is not.
+ */
+void DeadCodeEliminator::eliminate(std::vector<StmtPtr>& statements)
+{
+  for ( ;; ) {
+    used_.clear();
+    usedGlobals_.clear();
+    sweeping_ = false;
+    eliminateFrom(statements);
+
+    const auto removed = removed_;
+    sweeping_ = true;
+    eliminateFrom(statements);
+
+    if ( removed_ == removed ) return;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+size_t DeadCodeEliminator::removed() const
+{
+  return removed_;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void DeadCodeEliminator::eliminateFrom(std::vector<StmtPtr>& statements)
+{
+  if ( sweeping_ ) {
+    auto last = std::ranges::find_if(
+      statements, [](const StmtPtr& stmt) { return alwaysReturns(*stmt); });
+
+    if ( last != statements.end() ) {
+      for ( auto it = std::next(last); it != statements.end(); ++it ) {
+        intpr_.retire(std::move(*it));
+        ++removed_;
+      }
+      statements.erase(std::next(last), statements.end());
+    }
+  }
+
+  transform(statements);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void DeadCodeEliminator::eliminateIn(FunctionStmt& function)
+{
+  scopes_.emplace_back();
+  for ( const auto& param : function.params ) {
+    declare(param, nullptr);
+  }
+  eliminateFrom(function.body);
+  scopes_.pop_back();
+}
+
+/*---------------------------------------------------------------------------*/
+
+void DeadCodeEliminator::enter(const Stmt& declaration, const Token& name)
+{
+  if ( scopes_.empty() ) {
+    global_ = &name;
+  }
+  declaring_.push_back(&declaration);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void DeadCodeEliminator::leave()
+{
+  declaring_.pop_back();
+  if ( declaring_.empty() ) {
+    global_ = nullptr;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void DeadCodeEliminator::declare(const Token& name, const Stmt* declaration)
+{
+  if ( !scopes_.empty() ) {
+    scopes_.back()[name.lexeme()] = declaration;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Mark the declaration a variable refers to as used, unless the variable is
+ * in the code of that very declaration.
+ */
+void DeadCodeEliminator::use(Expr& expr, const Token& name)
+{
+  if ( intpr_.isGlobal(expr) ) {
+    if ( !global_ || global_->lexeme() != name.lexeme() ) {
+      usedGlobals_.insert(name.lexeme());
+    }
+    return;
+  }
+
+  for ( auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope ) {
+    if ( auto it = scope->find(name.lexeme()); it != scope->end() ) {
+      const auto declaration = it->second;
+      if ( declaration &&
+           std::ranges::find(declaring_, declaration) == declaring_.end() ) {
+        used_.insert(declaration);
+      }
+      return;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool DeadCodeEliminator::unused(const Stmt& stmt, const Token& name) const
+{
+  if ( scopes_.empty() ) {
+    return closedWorld_ && !usedGlobals_.contains(name.lexeme());
+  }
+
+  return !used_.contains(&stmt);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr DeadCodeEliminator::visitAssignExpr(AssignExpr& expr)
+{
+  transform(expr.value);
+  use(expr, expr.name);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Like in the resolver, an inlined body only sees its own scopes and the
+ * globals.
+ */
+ExprPtr DeadCodeEliminator::visitInlineExpr(InlineExpr& expr)
+{
+  transform(expr.callee);
+  for ( auto& arg : expr.arguments ) {
+    transform(arg);
+  }
+
+  auto enclosingScopes = std::move(scopes_);
+  scopes_.clear();
+
+  scopes_.emplace_back();
+  for ( const auto& param : expr.function->params ) {
+    declare(param, nullptr);
+  }
+  eliminateFrom(expr.body);
+
+  scopes_ = std::move(enclosingScopes);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr DeadCodeEliminator::visitVariableExpr(VariableExpr& expr)
+{
+  use(expr, expr.name);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr DeadCodeEliminator::visitBlockStmt(BlockStmt& stmt)
+{
+  scopes_.emplace_back();
+  eliminateFrom(stmt.statements);
+  scopes_.pop_back();
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr DeadCodeEliminator::visitClassStmt(ClassStmt& stmt)
+{
+  if ( sweeping_ && unused(stmt, stmt.name) ) {
+    ++removed_;
+    return emptyStmt();
+  }
+
+  declare(stmt.name, &stmt);
+  enter(stmt, stmt.name);
+
+  // The scope of "this"
+  scopes_.emplace_back();
+  for ( auto& method : stmt.methods ) {
+    eliminateIn(static_cast<FunctionStmt&>(*method));
+  }
+  scopes_.pop_back();
+
+  leave();
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr DeadCodeEliminator::visitFunctionStmt(FunctionStmt& stmt)
+{
+  if ( sweeping_ && unused(stmt, stmt.name) ) {
+    ++removed_;
+    return emptyStmt();
+  }
+
+  declare(stmt.name, &stmt);
+  enter(stmt, stmt.name);
+  eliminateIn(stmt);
+  leave();
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Only local variables go, and only if their initializer can be skipped.
+ */
+StmtPtr DeadCodeEliminator::visitVarStmt(VarStmt& stmt)
+{
+  if ( stmt.initializer ) {
+    transform(stmt.initializer);
+  }
+
+  if ( sweeping_ && !scopes_.empty() && unused(stmt, stmt.name) &&
+       (!stmt.initializer || harmless(intpr_, *(stmt.initializer))) ) {
+    ++removed_;
+    return emptyStmt();
+  }
+
+  declare(stmt.name, &stmt);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The variable of a for loop stays, as it is part of the statement.
+ */
+StmtPtr DeadCodeEliminator::visitForStmt(ForStmt& stmt)
+{
+  if ( auto var = dynamic_cast<VarStmt*>(stmt.initializer.get()) ) {
+    if ( var->initializer ) {
+      transform(var->initializer);
+    }
+    declare(var->name, nullptr);
+  } else if ( stmt.initializer ) {
+    transform(stmt.initializer);
+  }
+
+  if ( stmt.condition ) {
+    transform(stmt.condition);
+  }
+  transform(stmt.body);
+  if ( stmt.increment ) {
+    transform(stmt.increment);
+  }
+
+  return nullptr;
+}
+
+}
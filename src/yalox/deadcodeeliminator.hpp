@@ -0,0 +1,71 @@
+#pragma once
+
+#include "asttransformer.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Remove the code that cannot run and the declarations nothing uses.
+ *
+ * The statements after one that always returns are dropped, and so are the
+ * local variables, functions and classes that are never read or assigned, as
+ * long as declaring them has no effect and cannot fail. A function that only
+ * refers to itself is unused. Removing a declaration can leave others unused,
+ * so the program is swept until nothing more goes.
+ *
+ * Globals could be used by code run later, in the REPL for instance. In a
+ * closed world, where the program is known to be the whole script, unused
+ * top-level functions and classes are removed too.
+ */
+class DeadCodeEliminator : public AstTransformer
+{
+public:
+  DeadCodeEliminator(Interpreter&, bool closedWorld = false);
+
+  void eliminate(std::vector<StmtPtr>&);
+
+  // How many statements were removed
+  size_t removed() const;
+
+  ExprPtr visitAssignExpr(AssignExpr&) override;
+  ExprPtr visitInlineExpr(InlineExpr&) override;
+  ExprPtr visitVariableExpr(VariableExpr&) override;
+
+  StmtPtr visitBlockStmt(BlockStmt&) override;
+  StmtPtr visitClassStmt(ClassStmt&) override;
+  StmtPtr visitFunctionStmt(FunctionStmt&) override;
+  StmtPtr visitVarStmt(VarStmt&) override;
+  StmtPtr visitForStmt(ForStmt&) override;
+
+private:
+  bool closedWorld_;
+
+  // Local declarations by name, like in the resolver. Parameters and the
+  // variables of for loops are there to hide others, but cannot be removed.
+  std::vector<std::unordered_map<std::string, const Stmt*>> scopes_;
+
+  // The functions and classes being visited, whose uses of themselves do not
+  // count, the top-level one by name
+  std::vector<const Stmt*> declaring_;
+  const Token* global_{};
+
+  std::unordered_set<const Stmt*> used_;  // local declarations
+  std::unordered_set<std::string> usedGlobals_;
+  bool sweeping_{};
+  size_t removed_{};
+
+  void eliminateFrom(std::vector<StmtPtr>&);
+  void eliminateIn(FunctionStmt&);
+  void enter(const Stmt& declaration, const Token& name);
+  void leave();
+  void declare(const Token&, const Stmt*);
+  void use(Expr&, const Token&);
+  bool unused(const Stmt&, const Token&) const;
+};
+
+}
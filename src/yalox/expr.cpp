@@ -3,6 +3,8 @@
 #include "astprinter.hpp"
 #include "resolver.hpp"
 #include "interpreter.hpp"
+#include "closurecompiler.hpp"
+#include "asttransformer.hpp"
 
 namespace lox {
 
@@ -37,6 +39,20 @@ LoxObject AssignExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr AssignExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitAssignExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr AssignExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitAssignExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 BinaryExpr::BinaryExpr(ExprPtr left, Token op, ExprPtr right)
   : left(std::move(left))
   , op(std::move(op))
@@ -67,6 +83,20 @@ LoxObject BinaryExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr BinaryExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitBinaryExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr BinaryExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitBinaryExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 CallExpr::CallExpr(
   ExprPtr callee,
   Token closingParen,
@@ -100,6 +130,20 @@ LoxObject CallExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr CallExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitCallExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr CallExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitCallExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 GetExpr::GetExpr(ExprPtr object, Token name)
   : object(std::move(object))
   , name(std::move(name))
@@ -129,6 +173,20 @@ LoxObject GetExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr GetExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitGetExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr GetExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitGetExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 GroupingExpr::GroupingExpr(ExprPtr expression)
   : expression(std::move(expression))
 {
@@ -157,6 +215,71 @@ LoxObject GroupingExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr GroupingExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitGroupingExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr GroupingExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitGroupingExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+InlineExpr::InlineExpr(
+  ExprPtr callee,
+  Token closingParen,
+  std::vector<ExprPtr> arguments,
+  FunctionStmt* function,
+  std::vector<std::unique_ptr<Stmt>> body)
+  : callee(std::move(callee))
+  , closingParen(std::move(closingParen))
+  , arguments(std::move(arguments))
+  , function(std::move(function))
+  , body(std::move(body))
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+std::string InlineExpr::toString(AstPrinter& printer)
+{
+  return printer.visitInlineExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void InlineExpr::resolve(Resolver& r)
+{
+  return r.visitInlineExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxObject InlineExpr::evaluate(Interpreter& interpreter)
+{
+  return interpreter.visitInlineExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr InlineExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitInlineExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr InlineExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitInlineExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 LiteralExpr::LiteralExpr(LoxObject value)
   : value(std::move(value))
 {
@@ -185,6 +308,20 @@ LoxObject LiteralExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr LiteralExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitLiteralExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr LiteralExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitLiteralExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 LogicalExpr::LogicalExpr(ExprPtr left, Token op, ExprPtr right)
   : left(std::move(left))
   , op(std::move(op))
@@ -215,6 +352,20 @@ LoxObject LogicalExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr LogicalExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitLogicalExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr LogicalExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitLogicalExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 SetExpr::SetExpr(ExprPtr object, Token name, ExprPtr value)
   : object(std::move(object))
   , name(std::move(name))
@@ -245,6 +396,20 @@ LoxObject SetExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr SetExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitSetExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr SetExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitSetExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 ThisExpr::ThisExpr(Token keyword)
   : keyword(std::move(keyword))
 {
@@ -273,6 +438,20 @@ LoxObject ThisExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr ThisExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitThisExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr ThisExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitThisExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 UnaryExpr::UnaryExpr(Token op, ExprPtr right)
   : op(std::move(op))
   , right(std::move(right))
@@ -302,6 +481,20 @@ LoxObject UnaryExpr::evaluate(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledExpr UnaryExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitUnaryExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr UnaryExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitUnaryExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 VariableExpr::VariableExpr(Token name)
   : name(std::move(name))
 {
@@ -328,4 +521,18 @@ LoxObject VariableExpr::evaluate(Interpreter& interpreter)
   return interpreter.visitVariableExpr(*this);
 }
 
+/*---------------------------------------------------------------------------*/
+
+CompiledExpr VariableExpr::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitVariableExpr(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr VariableExpr::transform(AstTransformer& transformer)
+{
+  return transformer.visitVariableExpr(*this);
+}
+
 }  // namespace lox
@@ -2,6 +2,7 @@
 
 #include "token.hpp"
 
+#include <functional>
 #include <vector>
 #include <memory>
 
@@ -16,6 +17,7 @@ class BinaryExpr;
 class CallExpr;
 class GetExpr;
 class GroupingExpr;
+class InlineExpr;
 class LiteralExpr;
 class LogicalExpr;
 class SetExpr;
@@ -23,8 +25,15 @@ class ThisExpr;
 class UnaryExpr;
 class VariableExpr;
 
+// Statements, which inlined calls contain
+class Stmt;
+class FunctionStmt;
+
 using ExprPtr = std::unique_ptr<Expr>;
 
+// An expression compiled by the ClosureCompiler
+using CompiledExpr = std::function<LoxObject()>;
+
 /*---------------------------------------------------------------------------*/
 
 template <typename T>
@@ -38,6 +47,7 @@ public:
   virtual T visitCallExpr(CallExpr&) = 0;
   virtual T visitGetExpr(GetExpr&) = 0;
   virtual T visitGroupingExpr(GroupingExpr&) = 0;
+  virtual T visitInlineExpr(InlineExpr&) = 0;
   virtual T visitLiteralExpr(LiteralExpr&) = 0;
   virtual T visitLogicalExpr(LogicalExpr&) = 0;
   virtual T visitSetExpr(SetExpr&) = 0;
@@ -52,6 +62,8 @@ public:
 class AstPrinter;
 class Resolver;
 class Interpreter;
+class ClosureCompiler;
+class AstTransformer;
 
 /*---------------------------------------------------------------------------*/
 
@@ -70,6 +82,16 @@ public:
 
   // accept function for ExprVisitor<LoxObject>
   virtual LoxObject evaluate(Interpreter&) = 0;
+
+  // accept function for ExprVisitor<CompiledExpr>
+  virtual CompiledExpr compile(ClosureCompiler&) = 0;
+
+  // accept function for ExprVisitor<ExprPtr>
+  virtual ExprPtr transform(AstTransformer&) = 0;
+
+  // Type of every value the expression evaluates to, when
+  // TypeInferrer could prove it
+  StaticType type{ StaticType::UNKNOWN };
 };
 
 /*---------------------------------------------------------------------------*/
@@ -87,6 +109,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   Token name;
   ExprPtr value;
 };
@@ -106,6 +132,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr left;
   Token op;
   ExprPtr right;
@@ -126,6 +156,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr callee;
   Token closingParen;
   std::vector<ExprPtr> arguments;
@@ -146,6 +180,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr object;
   Token name;
 };
@@ -165,11 +203,46 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr expression;
 };
 
 /*---------------------------------------------------------------------------*/
 
+/** Inline expression.
+ */
+class InlineExpr : public Expr
+{
+public:
+  InlineExpr(
+    ExprPtr callee,
+    Token closingParen,
+    std::vector<ExprPtr> arguments,
+    FunctionStmt* function,
+    std::vector<std::unique_ptr<Stmt>> body);
+
+  std::string toString(AstPrinter&) override;
+
+  void resolve(Resolver&) override;
+
+  LoxObject evaluate(Interpreter&) override;
+
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
+  ExprPtr callee;
+  Token closingParen;
+  std::vector<ExprPtr> arguments;
+  FunctionStmt* function;
+  std::vector<std::unique_ptr<Stmt>> body;
+};
+
+/*---------------------------------------------------------------------------*/
+
 /** Literal expression.
  */
 class LiteralExpr : public Expr
@@ -183,6 +256,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   LoxObject value;
 };
 
@@ -201,6 +278,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr left;
   Token op;
   ExprPtr right;
@@ -221,6 +302,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   ExprPtr object;
   Token name;
   ExprPtr value;
@@ -241,6 +326,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   Token keyword;
 };
 
@@ -259,6 +348,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   Token op;
   ExprPtr right;
 };
@@ -278,6 +371,10 @@ public:
 
   LoxObject evaluate(Interpreter&) override;
 
+  CompiledExpr compile(ClosureCompiler&) override;
+
+  ExprPtr transform(AstTransformer&) override;
+
   Token name;
 };
 
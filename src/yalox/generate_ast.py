@@ -33,9 +33,13 @@ def declareType(file, baseName, className, fieldList):
         file.write("  std::string toString(AstPrinter&) override;\n\n")
         file.write("  void resolve(Resolver&) override;\n\n")
         file.write("  LoxObject evaluate(Interpreter&) override;\n\n")
+        file.write("  CompiledExpr compile(ClosureCompiler&) override;\n\n")
+        file.write("  ExprPtr transform(AstTransformer&) override;\n\n")
     else:
         file.write("  void resolve(Resolver&) override;\n\n")
         file.write("  void execute(Interpreter&) override;\n\n")
+        file.write("  CompiledStmt compile(ClosureCompiler&) override;\n\n")
+        file.write("  StmtPtr transform(AstTransformer&) override;\n\n")
 
     # Write member lines
     lines = ""
@@ -76,6 +80,14 @@ def defineType(file, baseName, className, fieldList):
         file.write("/*" + 75 * "-" + "*/\n\n")
         file.write(f"LoxObject {fullName}::evaluate(Interpreter& interpreter)\n")
         file.write(f"{{\n  return interpreter.visit{fullName}(*this);\n}}\n\n")
+
+        file.write("/*" + 75 * "-" + "*/\n\n")
+        file.write(f"CompiledExpr {fullName}::compile(ClosureCompiler& compiler)\n")
+        file.write(f"{{\n  return compiler.visit{fullName}(*this);\n}}\n\n")
+
+        file.write("/*" + 75 * "-" + "*/\n\n")
+        file.write(f"ExprPtr {fullName}::transform(AstTransformer& transformer)\n")
+        file.write(f"{{\n  return transformer.visit{fullName}(*this);\n}}\n\n")
     else:
         file.write("/*" + 75 * "-" + "*/\n\n")
         file.write(f"void {fullName}::resolve(Resolver& r)\n")
@@ -85,6 +97,14 @@ def defineType(file, baseName, className, fieldList):
         file.write(f"void {fullName}::execute(Interpreter& interpreter)\n")
         file.write(f"{{\n  interpreter.visit{fullName}(*this);\n}}\n\n")
 
+        file.write("/*" + 75 * "-" + "*/\n\n")
+        file.write(f"CompiledStmt {fullName}::compile(ClosureCompiler& compiler)\n")
+        file.write(f"{{\n  return compiler.visit{fullName}(*this);\n}}\n\n")
+
+        file.write("/*" + 75 * "-" + "*/\n\n")
+        file.write(f"StmtPtr {fullName}::transform(AstTransformer& transformer)\n")
+        file.write(f"{{\n  return transformer.visit{fullName}(*this);\n}}\n\n")
+
 
 def defineVisitor(file, baseName, types):
     file.write("/*" + 75 * "-" + "*/\n\n")
@@ -101,7 +121,9 @@ def defineVisitor(file, baseName, types):
         file.write(f"// Forward declare {baseName}Visitor implementations\n")
         file.write("class AstPrinter;\n")
         file.write("class Resolver;\n")
-        file.write("class Interpreter;\n\n")
+        file.write("class Interpreter;\n")
+        file.write("class ClosureCompiler;\n")
+        file.write("class AstTransformer;\n\n")
 
 
 def defineAst(outputDir, baseName, types):
@@ -114,6 +136,7 @@ def defineAst(outputDir, baseName, types):
             f.write('#include "expr.hpp"\n\n')
         else:
             f.write('#include "token.hpp"\n\n')
+            f.write("#include <functional>\n")
         f.write("#include <vector>\n")
         f.write("#include <memory>\n\n")
         f.write("namespace lox {\n\n")
@@ -127,7 +150,17 @@ def defineAst(outputDir, baseName, types):
         for name in classNames:
             f.write(f"class {name}{baseName};\n")
         f.write("\n")
+        if baseName == "Expr":
+            f.write("// Statements, which inlined calls contain\n")
+            f.write("class Stmt;\n")
+            f.write("class FunctionStmt;\n\n")
         f.write(f"using {baseName}Ptr = std::unique_ptr<{baseName}>;\n\n")
+        if baseName == "Expr":
+            f.write("// An expression compiled by the ClosureCompiler\n")
+            f.write("using CompiledExpr = std::function<LoxObject()>;\n\n")
+        else:
+            f.write("// A statement compiled by the ClosureCompiler\n")
+            f.write("using CompiledStmt = std::function<void()>;\n\n")
 
         defineVisitor(f, baseName, classNames)
 
@@ -146,12 +179,23 @@ def defineAst(outputDir, baseName, types):
             f.write(f"  // accept function for {baseName}Visitor<void>\n")
             f.write("  virtual void resolve(Resolver&) = 0;\n\n")
             f.write(f"  // accept function for {baseName}Visitor<LoxObject>\n")
-            f.write("  virtual LoxObject evaluate(Interpreter&) = 0;\n")
+            f.write("  virtual LoxObject evaluate(Interpreter&) = 0;\n\n")
+            f.write(f"  // accept function for {baseName}Visitor<CompiledExpr>\n")
+            f.write("  virtual CompiledExpr compile(ClosureCompiler&) = 0;\n\n")
+            f.write(f"  // accept function for {baseName}Visitor<ExprPtr>\n")
+            f.write("  virtual ExprPtr transform(AstTransformer&) = 0;\n\n")
+            f.write("  // Type of every value the expression evaluates to, when\n")
+            f.write("  // TypeInferrer could prove it\n")
+            f.write("  StaticType type{ StaticType::UNKNOWN };\n")
         else:
             f.write(f"  // accept function for {baseName}Visitor<void>\n")
             f.write("  virtual void resolve(Resolver&) = 0;\n\n")
             f.write(f"  // accept function for {baseName}Visitor<void>\n")
-            f.write("  virtual void execute(Interpreter&) = 0;\n")
+            f.write("  virtual void execute(Interpreter&) = 0;\n\n")
+            f.write(f"  // accept function for {baseName}Visitor<CompiledStmt>\n")
+            f.write("  virtual CompiledStmt compile(ClosureCompiler&) = 0;\n\n")
+            f.write(f"  // accept function for {baseName}Visitor<StmtPtr>\n")
+            f.write("  virtual StmtPtr transform(AstTransformer&) = 0;\n")
         f.write("};\n\n")
 
         for idx, name in enumerate(classNames):
@@ -166,7 +210,9 @@ def defineAst(outputDir, baseName, types):
         if baseName == "Expr":
             f.write('#include "astprinter.hpp"\n')
         f.write('#include "resolver.hpp"\n')
-        f.write('#include "interpreter.hpp"\n\n')
+        f.write('#include "interpreter.hpp"\n')
+        f.write('#include "closurecompiler.hpp"\n')
+        f.write('#include "asttransformer.hpp"\n\n')
         f.write("namespace lox {\n\n")
         for idx, name in enumerate(classNames):
             defineType(f, baseName, name, classFields[idx])
@@ -204,6 +250,16 @@ if __name__ == "__main__":
                 ["expression", "ExprPtr"],
             ],
         },
+        {
+            "name": "Inline",
+            "params": [
+                ["callee", "ExprPtr"],
+                ["closingParen", "Token"],
+                ["arguments", "std::vector<ExprPtr>"],
+                ["function", "FunctionStmt*"],
+                ["body", "std::vector<std::unique_ptr<Stmt>>"],
+            ],
+        },
         {
             "name": "Literal",
             "params": [
@@ -0,0 +1,486 @@
+#include "inliner.hpp"
+#include "interpreter.hpp"
+#include "resolver.hpp"
+
+namespace lox {
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+/** Deep copy of a syntax tree. Copies are not resolved.
+ */
+class Cloner : public AstTransformer
+{
+public:
+  using AstTransformer::AstTransformer;
+
+  ExprPtr clone(const ExprPtr& expr)
+  {
+    return expr ? expr->transform(*this) : nullptr;
+  }
+
+  StmtPtr clone(const StmtPtr& stmt)
+  {
+    return stmt ? stmt->transform(*this) : nullptr;
+  }
+
+  std::vector<ExprPtr> clone(const std::vector<ExprPtr>& exprs)
+  {
+    std::vector<ExprPtr> copies;
+    for ( const auto& expr : exprs ) {
+      copies.emplace_back(clone(expr));
+    }
+    return copies;
+  }
+
+  std::vector<StmtPtr> clone(const std::vector<StmtPtr>& statements)
+  {
+    std::vector<StmtPtr> copies;
+    for ( const auto& stmt : statements ) {
+      copies.emplace_back(clone(stmt));
+    }
+    return copies;
+  }
+
+  ExprPtr visitAssignExpr(AssignExpr& expr) override
+  {
+    return std::make_unique<AssignExpr>(expr.name, clone(expr.value));
+  }
+
+  ExprPtr visitBinaryExpr(BinaryExpr& expr) override
+  {
+    return std::make_unique<BinaryExpr>(
+      clone(expr.left), expr.op, clone(expr.right));
+  }
+
+  ExprPtr visitCallExpr(CallExpr& expr) override
+  {
+    return std::make_unique<CallExpr>(
+      clone(expr.callee), expr.closingParen, clone(expr.arguments));
+  }
+
+  ExprPtr visitGetExpr(GetExpr& expr) override
+  {
+    return std::make_unique<GetExpr>(clone(expr.object), expr.name);
+  }
+
+  ExprPtr visitGroupingExpr(GroupingExpr& expr) override
+  {
+    return std::make_unique<GroupingExpr>(clone(expr.expression));
+  }
+
+  ExprPtr visitInlineExpr(InlineExpr& expr) override
+  {
+    return std::make_unique<InlineExpr>(
+      clone(expr.callee),
+      expr.closingParen,
+      clone(expr.arguments),
+      expr.function,
+      clone(expr.body));
+  }
+
+  ExprPtr visitLiteralExpr(LiteralExpr& expr) override
+  {
+    return std::make_unique<LiteralExpr>(expr.value);
+  }
+
+  ExprPtr visitLogicalExpr(LogicalExpr& expr) override
+  {
+    return std::make_unique<LogicalExpr>(
+      clone(expr.left), expr.op, clone(expr.right));
+  }
+
+  ExprPtr visitSetExpr(SetExpr& expr) override
+  {
+    return std::make_unique<SetExpr>(
+      clone(expr.object), expr.name, clone(expr.value));
+  }
+
+  ExprPtr visitThisExpr(ThisExpr& expr) override
+  {
+    return std::make_unique<ThisExpr>(expr.keyword);
+  }
+
+  ExprPtr visitUnaryExpr(UnaryExpr& expr) override
+  {
+    return std::make_unique<UnaryExpr>(expr.op, clone(expr.right));
+  }
+
+  ExprPtr visitVariableExpr(VariableExpr& expr) override
+  {
+    return std::make_unique<VariableExpr>(expr.name);
+  }
+
+  StmtPtr visitBlockStmt(BlockStmt& stmt) override
+  {
+    return std::make_unique<BlockStmt>(clone(stmt.statements));
+  }
+
+  StmtPtr visitClassStmt(ClassStmt& stmt) override
+  {
+    return std::make_unique<ClassStmt>(stmt.name, clone(stmt.methods));
+  }
+
+  StmtPtr visitExprStmt(ExprStmt& stmt) override
+  {
+    return std::make_unique<ExprStmt>(clone(stmt.expression));
+  }
+
+  StmtPtr visitFunctionStmt(FunctionStmt& stmt) override
+  {
+    return std::make_unique<FunctionStmt>(
+      stmt.name, stmt.params, clone(stmt.body));
+  }
+
+  StmtPtr visitIfStmt(IfStmt& stmt) override
+  {
+    return std::make_unique<IfStmt>(
+      clone(stmt.condition), clone(stmt.thenBranch), clone(stmt.elseBranch));
+  }
+
+  StmtPtr visitPrintStmt(PrintStmt& stmt) override
+  {
+    return std::make_unique<PrintStmt>(clone(stmt.expression));
+  }
+
+  StmtPtr visitReturnStmt(ReturnStmt& stmt) override
+  {
+    return std::make_unique<ReturnStmt>(stmt.keyword, clone(stmt.value));
+  }
+
+  StmtPtr visitVarStmt(VarStmt& stmt) override
+  {
+    return std::make_unique<VarStmt>(stmt.name, clone(stmt.initializer));
+  }
+
+  StmtPtr visitWhileStmt(WhileStmt& stmt) override
+  {
+    return std::make_unique<WhileStmt>(
+      clone(stmt.condition), clone(stmt.body));
+  }
+
+  StmtPtr visitForStmt(ForStmt& stmt) override
+  {
+    return std::make_unique<ForStmt>(
+      clone(stmt.initializer),
+      clone(stmt.condition),
+      clone(stmt.increment),
+      clone(stmt.body));
+  }
+};
+
+/*---------------------------------------------------------------------------*/
+
+/** Measure the body of a top-level function and look for what keeps it from
+ * being inlined. The tree is only read.
+ */
+class BodyScanner : public AstTransformer
+{
+public:
+  BodyScanner(Interpreter& interpreter, FunctionStmt& function)
+    : AstTransformer(interpreter)
+    , function_(function)
+  {
+    for ( auto& stmt : function.body ) {
+      transform(stmt);
+    }
+  }
+
+  bool inlinable(size_t budget) const
+  {
+    return !rejected_ && size_ <= budget;
+  }
+
+  bool tailCalls() const
+  {
+    return tailCalls_;
+  }
+
+  using AstTransformer::transform;
+
+  void transform(StmtPtr& stmt) override
+  {
+    ++size_;
+    AstTransformer::transform(stmt);
+  }
+
+  void transform(ExprPtr& expr) override
+  {
+    ++size_;
+    AstTransformer::transform(expr);
+  }
+
+  ExprPtr visitInlineExpr(InlineExpr& /* unused */) override
+  {
+    rejected_ = true;
+    return nullptr;
+  }
+
+  // A call to itself, which would never stop expanding
+  ExprPtr visitVariableExpr(VariableExpr& expr) override
+  {
+    if ( expr.name.lexeme() == function_.name.lexeme() &&
+         intpr_.isGlobal(expr) ) {
+      rejected_ = true;
+    }
+    return nullptr;
+  }
+
+  // Closures and classes would need the function's environment to outlive it
+  StmtPtr visitClassStmt(ClassStmt& /* unused */) override
+  {
+    rejected_ = true;
+    return nullptr;
+  }
+
+  StmtPtr visitFunctionStmt(FunctionStmt& /* unused */) override
+  {
+    rejected_ = true;
+    return nullptr;
+  }
+
+  // A return from a loop cannot be made the last statement of the body
+  StmtPtr visitReturnStmt(ReturnStmt& stmt) override
+  {
+    if ( loops_ > 0 ) {
+      rejected_ = true;
+    }
+    if ( dynamic_cast<CallExpr*>(stmt.value.get()) ) {
+      tailCalls_ = true;
+    }
+    return AstTransformer::visitReturnStmt(stmt);
+  }
+
+  StmtPtr visitWhileStmt(WhileStmt& stmt) override
+  {
+    ++loops_;
+    AstTransformer::visitWhileStmt(stmt);
+    --loops_;
+    return nullptr;
+  }
+
+  StmtPtr visitForStmt(ForStmt& stmt) override
+  {
+    ++loops_;
+    AstTransformer::visitForStmt(stmt);
+    --loops_;
+    return nullptr;
+  }
+
+private:
+  const FunctionStmt& function_;
+  size_t size_{};
+  size_t loops_{};
+  bool rejected_{};
+  bool tailCalls_{};
+};
+
+/*---------------------------------------------------------------------------*/
+
+bool containsReturn(const Stmt& stmt)
+{
+  if ( dynamic_cast<const ReturnStmt*>(&stmt) ) return true;
+
+  if ( auto block = dynamic_cast<const BlockStmt*>(&stmt) ) {
+    for ( const auto& inner : block->statements ) {
+      if ( containsReturn(*inner) ) return true;
+    }
+  } else if ( auto ifStmt = dynamic_cast<const IfStmt*>(&stmt) ) {
+    return containsReturn(*(ifStmt->thenBranch)) ||
+           (ifStmt->elseBranch && containsReturn(*(ifStmt->elseBranch)));
+  }
+
+  return false;
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool toTailForm(std::vector<StmtPtr>&);
+
+/** Make sure a statement in tail position only returns as its last step.
+ */
+bool toTailForm(Stmt& stmt)
+{
+  if ( auto block = dynamic_cast<BlockStmt*>(&stmt) ) {
+    return toTailForm(block->statements);
+  }
+
+  if ( auto ifStmt = dynamic_cast<IfStmt*>(&stmt) ) {
+    return toTailForm(*(ifStmt->thenBranch)) &&
+           (!ifStmt->elseBranch || toTailForm(*(ifStmt->elseBranch)));
+  }
+
+  return dynamic_cast<ReturnStmt*>(&stmt) || !containsReturn(stmt);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Rewrite a statement list so that a return can only be its last statement,
+ * or the last statement of a branch that is. What follows a statement that
+ * always returns is dropped, and what follows an if statement with a return
+ * in one branch moves into the other:
+ *
+ *   if (c) return a;        if (c) return a;
+ *   print b;           =>   else { print b; return b; }
+ *   return b;
+ *
+ * Code would have to be copied when neither branch always returns, in which
+ * case the list is left alone and false is returned.
+ */
+bool toTailForm(std::vector<StmtPtr>& statements)
+{
+  for ( size_t i = 0; i < statements.size(); ++i ) {
+    auto& stmt = *(statements[i]);
+    if ( !containsReturn(stmt) ) continue;
+
+    if ( alwaysReturns(stmt) ) {
+      statements.erase(statements.begin() + i + 1, statements.end());
+      return toTailForm(stmt);
+    }
+
+    if ( i + 1 == statements.size() ) return toTailForm(stmt);
+
+    auto ifStmt = dynamic_cast<IfStmt*>(&stmt);
+    if ( !ifStmt ) return false;
+
+    StmtPtr* open = nullptr;  // the branch the rest of the list goes to
+    if ( alwaysReturns(*(ifStmt->thenBranch)) ) {
+      open = &(ifStmt->elseBranch);
+    } else if ( ifStmt->elseBranch && alwaysReturns(*(ifStmt->elseBranch)) ) {
+      open = &(ifStmt->thenBranch);
+    } else {
+      return false;
+    }
+
+    std::vector<StmtPtr> rest;
+    if ( *open ) {
+      rest.emplace_back(std::move(*open));
+    }
+    for ( size_t j = i + 1; j < statements.size(); ++j ) {
+      rest.emplace_back(std::move(statements[j]));
+    }
+    statements.erase(statements.begin() + i + 1, statements.end());
+
+    *open = std::make_unique<BlockStmt>(std::move(rest));
+    return toTailForm(stmt);
+  }
+
+  return true;
+}
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+Inliner::Inliner(Interpreter& interpreter, size_t budget)
+  : AstTransformer(interpreter)
+  , budget_(budget)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+void Inliner::inlineCalls(std::vector<StmtPtr>& statements)
+{
+  if ( budget_ == 0 ) return;
+
+  findCandidates(statements);
+  if ( candidates_.empty() ) return;
+
+  transform(statements);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Keep a copy of the body of every function that can be inlined, in tail
+ * form. A name declared more than once at the top level could hold any of
+ * its declarations and is skipped.
+ */
+void Inliner::findCandidates(const std::vector<StmtPtr>& statements)
+{
+  std::unordered_map<std::string, size_t> declarations;
+  for ( const auto& stmt : statements ) {
+    if ( auto function = dynamic_cast<FunctionStmt*>(stmt.get()) ) {
+      ++declarations[function->name.lexeme()];
+    } else if ( auto var = dynamic_cast<VarStmt*>(stmt.get()) ) {
+      ++declarations[var->name.lexeme()];
+    } else if ( auto klass = dynamic_cast<ClassStmt*>(stmt.get()) ) {
+      ++declarations[klass->name.lexeme()];
+    }
+  }
+
+  for ( const auto& stmt : statements ) {
+    auto function = dynamic_cast<FunctionStmt*>(stmt.get());
+    if ( !function || declarations[function->name.lexeme()] != 1 ) continue;
+
+    BodyScanner scanner{ intpr_, *function };
+    if ( !scanner.inlinable(budget_) ) continue;
+
+    auto body = Cloner(intpr_).clone(function->body);
+    if ( !toTailForm(body) ) continue;
+
+    candidates_.emplace(
+      function->name.lexeme(),
+      Candidate{ function, std::move(body), scanner.tailCalls(), false });
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Replace a call to a candidate by a copy of its body, in which calls are
+ * inlined in turn. The copy is resolved once, with the outermost call: it
+ * refers to nothing but its parameters, its own locals and the globals.
+ *
+ * A copy is not resolved while it is being built, so a callee in it may look
+ * global when it is a parameter. The check made by the inlined call covers
+ * that case too.
+ */
+ExprPtr Inliner::visitCallExpr(CallExpr& expr)
+{
+  const bool returned = &expr == tailCall_;
+  AstTransformer::visitCallExpr(expr);
+
+  auto variable = dynamic_cast<VariableExpr*>(expr.callee.get());
+  if ( !variable || !intpr_.isGlobal(*variable) ) return nullptr;
+
+  auto found = candidates_.find(variable->name.lexeme());
+  if ( found == candidates_.end() ) return nullptr;
+
+  auto& candidate = found->second;
+  if ( candidate.expanding || (returned && candidate.tailCalls) ||
+       expr.arguments.size() != candidate.function->params.size() ) {
+    return nullptr;
+  }
+
+  auto body = Cloner(intpr_).clone(candidate.body);
+
+  candidate.expanding = true;
+  ++depth_;
+  transform(body);
+  --depth_;
+  candidate.expanding = false;
+
+  auto inlined = std::make_unique<InlineExpr>(
+    std::move(expr.callee),
+    expr.closingParen,
+    std::move(expr.arguments),
+    candidate.function,
+    std::move(body));
+
+  if ( depth_ == 0 ) {
+    Resolver(intpr_).resolveInlined(*inlined);
+  }
+
+  return inlined;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr Inliner::visitReturnStmt(ReturnStmt& stmt)
+{
+  tailCall_ = dynamic_cast<CallExpr*>(stmt.value.get());
+  return AstTransformer::visitReturnStmt(stmt);
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "asttransformer.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Substitute the bodies of small functions at the places they are called.
+ *
+ * A function is inlined when it is declared once at the top level, does not
+ * call itself, declares no function or class, returns nothing from inside a
+ * loop and has at most `budget` nodes in its body. Its calls through the
+ * global variable of the same name become InlineExpr nodes, which run a copy
+ * of the body without creating a closure, a frame or a ReturnValue.
+ *
+ * Whether a function escapes does not have to be known: an inlined call
+ * checks that the variable still holds the function and makes a normal call
+ * if it does not. A budget of 0 turns inlining off.
+ *
+ * A function that returns the value of a call is not inlined in a return
+ * statement, where it would turn tail calls into nested ones: recursion that
+ * goes through it has to run in constant stack space.
+ */
+class Inliner : public AstTransformer
+{
+public:
+  static constexpr size_t DEFAULT_BUDGET = 40;
+
+  Inliner(Interpreter&, size_t budget = DEFAULT_BUDGET);
+
+  void inlineCalls(std::vector<StmtPtr>&);
+
+  ExprPtr visitCallExpr(CallExpr&) override;
+
+  StmtPtr visitReturnStmt(ReturnStmt&) override;
+
+private:
+  struct Candidate
+  {
+    FunctionStmt* function;
+    std::vector<StmtPtr> body;  // with every return in tail position
+    bool tailCalls;             // whether it returns the value of a call
+    bool expanding;             // stops mutually recursive functions
+  };
+
+  size_t budget_;
+  size_t depth_{};        // nesting of the bodies being expanded
+  CallExpr* tailCall_{};  // the call of the return statement visited
+  std::unordered_map<std::string, Candidate> candidates_;
+
+  void findCandidates(const std::vector<StmtPtr>&);
+};
+
+}
@@ -4,43 +4,11 @@
 #include <chrono>
 #include <cassert>
 #include <format>
-#include <iostream>
 
 namespace lox {
 
 /*---------------------------------------------------------------------------*/
 
-/** Make sure interpreter's env_ does not change after and exit a block.
- *
- * Keep the current env when constructing and restore it when destructing.
- * This is used by executeBlock() to ensure that if the function is done or
- * there is any exception, then the env will not be changed.
- */
-class EnvBlockGuard
-{
-public:
-  // Pass the reference of the current env pointer
-  EnvBlockGuard(EnvPtr& env)
-    : env_(env)
-  {
-    original_ = env;  // keep the original env pointer address
-  }
-
-  ~EnvBlockGuard()
-  {
-    env_ = original_;  // now restore the original env pointer
-  }
-
-  EnvBlockGuard(const EnvBlockGuard&) = delete;
-  EnvBlockGuard& operator=(const EnvBlockGuard&) = delete;
-
-private:
-  EnvPtr& env_;
-  EnvPtr original_;
-};
-
-/*---------------------------------------------------------------------------*/
-
 /** Equality comparison for LoxObject.
  */
 bool operator==(const LoxObject& left, const LoxObject& right)
@@ -59,10 +27,10 @@ bool operator==(const LoxObject& left, const LoxObject& right)
       return std::get<double>(left.value()) == std::get<double>(right.value());
 
     if (
-      std::holds_alternative<std::string>(left.value()) &&
-      std::holds_alternative<std::string>(right.value()) )
-      return std::get<std::string>(left.value()) ==
-             std::get<std::string>(right.value());
+      std::holds_alternative<LoxString>(left.value()) &&
+      std::holds_alternative<LoxString>(right.value()) )
+      return std::get<LoxString>(left.value()) ==
+             std::get<LoxString>(right.value());
 
     if (
       std::holds_alternative<bool>(left.value()) &&
@@ -80,7 +48,7 @@ bool operator==(const LoxObject& left, const LoxObject& right)
 /** The built-in clock() function.
  * Return the number of seconds (with fractional) that have passed since epoch.
  */
-LoxObject clockFunc(const std::vector<LoxObject>& /* unused */)
+LoxObject clockFunc(LoxArguments& /* unused */)
 {
   std::chrono::duration<double> duration =
     std::chrono::system_clock::now().time_since_epoch();
@@ -94,8 +62,10 @@ LoxObject clockFunc(const std::vector<LoxObject>& /* unused */)
  * fixed reference to the outermost global environment.
  */
 
-Interpreter::Interpreter()
+Interpreter::Interpreter(ExecutionMode mode)
   : globals{ new Environment{} }
+  , mode_(mode)
+  , compiler_(*this)
 {
   env_ = globals;
 
@@ -105,11 +75,24 @@ Interpreter::Interpreter()
 
 /*---------------------------------------------------------------------------*/
 
+/** Switch how code is run from now on. Functions that were already declared
+ * keep running the way they were declared.
+ */
+void Interpreter::setMode(ExecutionMode mode)
+{
+  mode_ = mode;
+}
+
+/*---------------------------------------------------------------------------*/
+
 LoxObject Interpreter::interpret(Expr& expr)
 {
   try {
+    if ( mode_ == ExecutionMode::CLOSURES ) return compiler_.compile(expr)();
+
     return evaluate(expr);
   } catch ( const RuntimeError& error ) {
+    out_->flush();
     YaLox::runtimeError(error);
   }
 
@@ -118,21 +101,54 @@ LoxObject Interpreter::interpret(Expr& expr)
 
 /*---------------------------------------------------------------------------*/
 
+/** Print to the given output from now on. It is flushed, like the standard
+ * output is, after every program and before a runtime error is reported.
+ */
+void Interpreter::setOutput(OutputSink& out)
+{
+  out_->flush();
+  out_ = &out;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Flush the standard output at the end of every line rather than when its
+ * buffer is full, for interactive use.
+ */
+void Interpreter::setLineBuffered(bool enabled)
+{
+  stdout_.setLineBuffered(enabled);
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Execute a Lox program.
  */
 void Interpreter::interpret(std::vector<StmtPtr> statements)
 {
-  try {
-    for ( auto& stmt : statements ) {
-      stmt->execute(*this);
+  // Store statements so that function/class declaration statement pointers
+  // persist to be referenced later when calling them. That includes those
+  // after a runtime error: a function declared in a block that failed half
+  // way may already be referenced from the globals.
+  const auto first = funcStmts_.size();
+  for ( auto& stmt : statements ) {
+    funcStmts_.emplace_back(std::move(stmt));
+  }
 
-      // Store statements so that function/class declaration statement pointers
-      // persist to be referenced later when calling them.
-      funcStmts_.emplace_back(std::move(stmt));
+  try {
+    for ( auto i = first; i < funcStmts_.size(); ++i ) {
+      if ( mode_ == ExecutionMode::CLOSURES ) {
+        compiler_.compile(*funcStmts_[i])();
+      } else {
+        funcStmts_[i]->execute(*this);
+      }
     }
   } catch ( const RuntimeError& error ) {
+    out_->flush();
     YaLox::runtimeError(error);
   }
+
+  out_->flush();
 }
 
 /*---------------------------------------------------------------------------*/
@@ -151,6 +167,45 @@ void Interpreter::resolve(Expr& expr, size_t depth)
 
 /*---------------------------------------------------------------------------*/
 
+void Interpreter::resolveTailCall(ReturnStmt& stmt)
+{
+  tailCalls_.insert(&stmt);
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool Interpreter::isGlobal(Expr& expr) const
+{
+  return !locals_.contains(&expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+size_t Interpreter::depth(Expr& expr) const
+{
+  return locals_.at(&expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** locals_ is keyed by node address, so a node allocated where a freed one
+ * used to be could pick up its depth. The nodes a pass removes are kept
+ * alive for as long as the interpreter instead.
+ */
+void Interpreter::retire(ExprPtr expr)
+{
+  retiredExprs_.emplace_back(std::move(expr));
+}
+
+/*---------------------------------------------------------------------------*/
+
+void Interpreter::retire(StmtPtr stmt)
+{
+  retiredStmts_.emplace_back(std::move(stmt));
+}
+
+/*---------------------------------------------------------------------------*/
+
 LoxObject Interpreter::evaluate(Expr& expr)
 {
   return expr.evaluate(*this);
@@ -178,17 +233,24 @@ LoxObject Interpreter::visitBinaryExpr(BinaryExpr& expr)
   auto left = evaluate(*(expr.left));
   auto right = evaluate(*(expr.right));
 
+  // Operands that TypeInferrer proved to be numbers need no checks
+  const bool numbers = expr.left->type == StaticType::NUMBER &&
+                       expr.right->type == StaticType::NUMBER;
+
   switch ( expr.op.type() ) {
     case TokenType::MINUS:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) - std::get<double>(right.value());
     case TokenType::PLUS: {
+      if ( numbers ) {
+        return std::get<double>(left.value()) + std::get<double>(right.value());
+      }
       if ( left && right ) {
         if (
-          std::holds_alternative<std::string>(left.value()) &&
-          std::holds_alternative<std::string>(right.value()) ) {
-          return std::get<std::string>(left.value()) +
-                 std::get<std::string>(right.value());
+          std::holds_alternative<LoxString>(left.value()) &&
+          std::holds_alternative<LoxString>(right.value()) ) {
+          return std::get<LoxString>(left.value()) +
+                 std::get<LoxString>(right.value());
         }
         if (
           std::holds_alternative<double>(left.value()) &&
@@ -203,23 +265,23 @@ LoxObject Interpreter::visitBinaryExpr(BinaryExpr& expr)
     }
 
     case TokenType::SLASH:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) / std::get<double>(right.value());
     case TokenType::STAR:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) * std::get<double>(right.value());
 
     case TokenType::GREATER:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) > std::get<double>(right.value());
     case TokenType::GREATER_EQUAL:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) >= std::get<double>(right.value());
     case TokenType::LESS:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) < std::get<double>(right.value());
     case TokenType::LESS_EQUAL:
-      validateNumberOperands(expr.op, left, right);
+      if ( !numbers ) validateNumberOperands(expr.op, left, right);
       return std::get<double>(left.value()) <= std::get<double>(right.value());
 
     case TokenType::BANG_EQUAL:
@@ -252,7 +314,7 @@ void validateLoxCallable(Token op, const LoxObject& obj)
  */
 void validateFunctionArity(
   const Token& op,
-  const std::vector<LoxObject>& args,
+  const LoxArguments& args,
   const LoxCallable& func)
 {
   if ( args.size() == func.arity ) return;
@@ -264,23 +326,53 @@ void validateFunctionArity(
 
 /*---------------------------------------------------------------------------*/
 
+/** Check that a callee is a closure of a function whose calls were inlined.
+ */
+bool isInlined(const LoxObject& callee, const FunctionStmt& function)
+{
+  return callee && std::holds_alternative<LoxCallable>(callee.value()) &&
+         std::get<LoxCallable>(callee.value()).funcStmt == &function;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Call a function, then every function it returns the call of, until one
+ * returns a value. However long the chain, it takes a single native frame.
+ *
+ * The arguments are left to the function called, which may move them.
+ */
+LoxObject callFunction(LoxCallable function, LoxArguments& args)
+{
+  for ( ;; ) {
+    try {
+      return function.call(args);
+    } catch ( TailCall& tailCall ) {
+      function = std::move(tailCall.function);
+      args = std::move(tailCall.args);
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Execute function call.
  */
 LoxObject Interpreter::visitCallExpr(CallExpr& expr)
 {
   LoxObject callee = evaluate(*(expr.callee));
 
-  std::vector<LoxObject> arguments{};
+  LoxArguments arguments{};
+  arguments.reserve(expr.arguments.size());
   for ( auto& arg : expr.arguments ) {
     arguments.emplace_back(evaluate(*arg));
   }
 
   validateLoxCallable(expr.closingParen, callee);
-  auto function = std::get<LoxCallable>(callee.value());
+  auto& function = std::get<LoxCallable>(callee.value());
 
   validateFunctionArity(expr.closingParen, arguments, function);
 
-  return function.call(arguments);
+  return callFunction(std::move(function), arguments);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -328,6 +420,45 @@ LoxObject Interpreter::visitGroupingExpr(GroupingExpr& expr)
 
 /*---------------------------------------------------------------------------*/
 
+/** Run an inlined call: the function's body right here, in an environment
+ * that encloses the globals like the function's own would, with every return
+ * in tail position so that none has to unwind.
+ *
+ * If the variable called no longer holds the inlined function, because it was
+ * assigned or not declared yet, the call is made as written.
+ */
+LoxObject Interpreter::visitInlineExpr(InlineExpr& expr)
+{
+  LoxObject callee = evaluate(*(expr.callee));
+
+  LoxArguments arguments{};
+  arguments.reserve(expr.arguments.size());
+  for ( auto& arg : expr.arguments ) {
+    arguments.emplace_back(evaluate(*arg));
+  }
+
+  if ( !isInlined(callee, *(expr.function)) ) {
+    validateLoxCallable(expr.closingParen, callee);
+    auto& function = std::get<LoxCallable>(callee.value());
+
+    validateFunctionArity(expr.closingParen, arguments, function);
+
+    return callFunction(std::move(function), arguments);
+  }
+
+  EnvPtr inlineEnv{ new Environment{ globals } };
+  for ( size_t i = 0; i < arguments.size(); ++i ) {
+    inlineEnv->define(
+      expr.function->params[i].lexeme(), std::move(arguments[i]));
+  }
+
+  EnvBlockGuard eg{ this->env_ };
+  this->env_ = inlineEnv;
+  return executeTail(expr.body);
+}
+
+/*---------------------------------------------------------------------------*/
+
 LoxObject Interpreter::visitLiteralExpr(LiteralExpr& expr)
 {
   return expr.value;
@@ -403,7 +534,9 @@ LoxObject Interpreter::visitUnaryExpr(UnaryExpr& expr)
     case TokenType::BANG:
       return !isTruthy(right);
     case TokenType::MINUS:
-      validateNumberOperand(expr.op, right);
+      if ( expr.right->type != StaticType::NUMBER ) {
+        validateNumberOperand(expr.op, right);
+      }
       return -(std::get<double>(right.value()));
     default:
       break;
@@ -435,6 +568,18 @@ LoxObject Interpreter::lookUpVariable(const Token& name, Expr& expr)
 
 /*---------------------------------------------------------------------------*/
 
+/** The call a return statement makes in tail position, if any. A pass may
+ * have replaced the call the resolver saw, by an inlined one for instance.
+ */
+CallExpr* Interpreter::tailCall(ReturnStmt& stmt) const
+{
+  if ( !tailCalls_.contains(&stmt) ) return nullptr;
+
+  return dynamic_cast<CallExpr*>(stmt.value.get());
+}
+
+/*---------------------------------------------------------------------------*/
+
 void Interpreter::executeBlock(
   const std::vector<StmtPtr>& block,
   EnvPtr& blockEnv)
@@ -450,6 +595,62 @@ void Interpreter::executeBlock(
 
 /*---------------------------------------------------------------------------*/
 
+/** Execute the body of an inlined call in the current environment and return
+ * the value of the return statement it ends with, if any.
+ */
+LoxObject Interpreter::executeTail(const std::vector<StmtPtr>& block)
+{
+  if ( block.empty() ) return {};
+
+  for ( size_t i = 0; i + 1 < block.size(); ++i ) {
+    block[i]->execute(*this);
+  }
+
+  return executeTail(*(block.back()));
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxObject Interpreter::executeTail(Stmt& stmt)
+{
+  if ( auto returnStmt = dynamic_cast<ReturnStmt*>(&stmt) ) {
+    return returnStmt->value ? evaluate(*(returnStmt->value)) : LoxObject{};
+  }
+
+  if ( auto ifStmt = dynamic_cast<IfStmt*>(&stmt) ) {
+    if ( isTruthy(evaluate(*(ifStmt->condition))) ) {
+      return executeTail(*(ifStmt->thenBranch));
+    }
+    return ifStmt->elseBranch ? executeTail(*(ifStmt->elseBranch))
+                              : LoxObject{};
+  }
+
+  if ( auto block = dynamic_cast<BlockStmt*>(&stmt) ) {
+    EnvPtr blockEnv{ new Environment{ this->env_ } };
+    EnvBlockGuard eg{ this->env_ };
+    this->env_ = blockEnv;
+    return executeTail(block->statements);
+  }
+
+  stmt.execute(*this);
+  return {};
+}
+
+/*---------------------------------------------------------------------------*/
+
+void Interpreter::executeBlock(const CompiledBlock& block, EnvPtr& blockEnv)
+{
+  EnvBlockGuard eg{ this->env_ };
+
+  this->env_ = blockEnv;
+
+  for ( auto& stmt : block ) {
+    stmt();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Execute block statement.
  */
 void Interpreter::visitBlockStmt(BlockStmt& stmt)
@@ -486,8 +687,7 @@ void Interpreter::visitClassStmt(ClassStmt& stmt)
     lc.arity = std::get<LoxCallable>(it->second.value()).arity;
   }
 
-  lc.call = [this,
-             lc](const std::vector<LoxObject>& args) mutable -> LoxObject {
+  lc.call = [this, lc](LoxArguments& args) mutable -> LoxObject {
     auto instance =
       LoxInstancePtr(new LoxInstance{ lc, lc.name + " instance" });
 
@@ -528,21 +728,32 @@ LoxCallable Interpreter::makeLoxCallable(
 {
   auto func = &funcStmt;
 
+  // In CLOSURES mode the body is compiled once, with the first closure made
+  // of the function, and run by every call of every closure made of it.
+  const CompiledBlock* body = nullptr;
+  if ( mode_ == ExecutionMode::CLOSURES ) {
+    body = &compiler_.body(funcStmt);
+  }
+
   LoxCallable lc;
   lc.arity = func->params.size();
   lc.funcStmt = func;
-  lc.call = [this, func, closure, isInit](
-              const std::vector<LoxObject>& args) -> LoxObject {
+  lc.call = [this, func, body, closure, isInit](
+              LoxArguments& args) -> LoxObject {
     assert(func->params.size() == args.size());
 
     EnvPtr funcEnv{ new Environment{ closure } };
 
     for ( size_t i = 0; i < func->params.size(); ++i ) {
-      funcEnv->define(func->params[i].lexeme(), args[i]);
+      funcEnv->define(func->params[i].lexeme(), std::move(args[i]));
     };
 
     try {
-      this->executeBlock(func->body, funcEnv);
+      if ( body ) {
+        this->executeBlock(*body, funcEnv);
+      } else {
+        this->executeBlock(func->body, funcEnv);
+      }
     } catch ( const ReturnValue& ret ) {
       // empty early return returns "this" instead of nil
       if ( isInit ) return closure->getAt(0, "this");
@@ -581,13 +792,32 @@ void Interpreter::visitIfStmt(IfStmt& stmt)
 void Interpreter::visitPrintStmt(PrintStmt& stmt)
 {
   auto value = evaluate(*(stmt.expression));
-  std::cout << toString(value) << '\n';
+  out_->write(toString(value));
+  out_->write("\n");
 }
 
 /*---------------------------------------------------------------------------*/
 
 void Interpreter::visitReturnStmt(ReturnStmt& stmt)
 {
+  // The call is made by the caller, once this function's frame is gone
+  if ( auto call = tailCall(stmt) ) {
+    LoxObject callee = evaluate(*(call->callee));
+
+    LoxArguments arguments{};
+    arguments.reserve(call->arguments.size());
+    for ( auto& arg : call->arguments ) {
+      arguments.emplace_back(evaluate(*arg));
+    }
+
+    validateLoxCallable(call->closingParen, callee);
+    auto& function = std::get<LoxCallable>(callee.value());
+
+    validateFunctionArity(call->closingParen, arguments, function);
+
+    throw TailCall(std::move(function), std::move(arguments));
+  }
+
   LoxObject value{};
   if ( stmt.value ) {
     value = evaluate(*(stmt.value));
@@ -709,6 +939,15 @@ ReturnValue::ReturnValue(LoxObject value)
 
 /*---------------------------------------------------------------------------*/
 
+TailCall::TailCall(LoxCallable function, LoxArguments args)
+  : std::runtime_error("")
+  , function(std::move(function))
+  , args(std::move(args))
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
 RuntimeError::RuntimeError(const Token& token, const std::string& message)
   : std::runtime_error(message)
   , token(token)
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "environment.hpp"
-#include "stmt.hpp"
+#include "closurecompiler.hpp"
+#include "output.hpp"
 
+#include <iostream>
+#include <unordered_set>
 #include <vector>
 
 namespace lox {
@@ -11,6 +14,59 @@ namespace lox {
 
 bool operator==(const LoxObject&, const LoxObject&);
 
+void validateLoxCallable(Token op, const LoxObject& obj);
+
+void validateFunctionArity(
+  const Token& op,
+  const LoxArguments& args,
+  const LoxCallable& func);
+
+bool isInlined(const LoxObject& callee, const FunctionStmt& function);
+
+LoxObject callFunction(LoxCallable function, LoxArguments& args);
+
+/*---------------------------------------------------------------------------*/
+
+/** Make sure interpreter's env_ does not change after and exit a block.
+ *
+ * Keep the current env when constructing and restore it when destructing.
+ * This is used by executeBlock() to ensure that if the function is done or
+ * there is any exception, then the env will not be changed.
+ */
+class EnvBlockGuard
+{
+public:
+  // Pass the reference of the current env pointer
+  EnvBlockGuard(EnvPtr& env)
+    : env_(env)
+  {
+    original_ = env;  // keep the original env pointer address
+  }
+
+  ~EnvBlockGuard()
+  {
+    env_ = original_;  // now restore the original env pointer
+  }
+
+  EnvBlockGuard(const EnvBlockGuard&) = delete;
+  EnvBlockGuard& operator=(const EnvBlockGuard&) = delete;
+
+private:
+  EnvPtr& env_;
+  EnvPtr original_;
+};
+
+/*---------------------------------------------------------------------------*/
+
+/** How the interpreter runs resolved code: by visiting the syntax tree, or by
+ * compiling each statement into closures first (see ClosureCompiler).
+ */
+enum class ExecutionMode
+{
+  TREE_WALK,
+  CLOSURES
+};
+
 /*---------------------------------------------------------------------------*/
 
 class Interpreter
@@ -18,7 +74,15 @@ class Interpreter
   , public StmtVisitor<void>
 {
 public:
-  Interpreter();
+  Interpreter(ExecutionMode mode = ExecutionMode::TREE_WALK);
+
+  void setMode(ExecutionMode mode);
+
+  // Where print statements write, instead of the standard output
+  void setOutput(OutputSink&);
+
+  // Whether the standard output is flushed at the end of every line
+  void setLineBuffered(bool);
 
   LoxObject interpret(Expr&);
 
@@ -26,11 +90,25 @@ public:
 
   void resolve(Expr&, size_t depth);
 
+  // Mark a return statement whose value is a call that can reuse the frame
+  void resolveTailCall(ReturnStmt&);
+
+  // Whether the resolver left a variable to be looked up in the globals
+  bool isGlobal(Expr&) const;
+
+  // How many scopes out the resolver found a local variable
+  size_t depth(Expr&) const;
+
+  // Keep a node that a pass took out of the tree (see AstTransformer)
+  void retire(ExprPtr);
+  void retire(StmtPtr);
+
   LoxObject visitAssignExpr(AssignExpr&) override;
   LoxObject visitBinaryExpr(BinaryExpr&) override;
   LoxObject visitCallExpr(CallExpr&) override;
   LoxObject visitGetExpr(GetExpr&) override;
   LoxObject visitGroupingExpr(GroupingExpr&) override;
+  LoxObject visitInlineExpr(InlineExpr&) override;
   LoxObject visitLiteralExpr(LiteralExpr&) override;
   LoxObject visitLogicalExpr(LogicalExpr&) override;
   LoxObject visitSetExpr(SetExpr&) override;
@@ -39,6 +117,7 @@ public:
   LoxObject visitVariableExpr(VariableExpr&) override;
 
   void executeBlock(const std::vector<StmtPtr>&, EnvPtr&);
+  void executeBlock(const CompiledBlock&, EnvPtr&);
   void visitBlockStmt(BlockStmt&) override;
   void visitClassStmt(ClassStmt&) override;
   void visitExprStmt(ExprStmt&) override;
@@ -53,14 +132,30 @@ public:
   EnvPtr globals;
 
 private:
+  friend class ClosureCompiler;
+
   EnvPtr env_;
 
+  ExecutionMode mode_;
+
+  ClosureCompiler compiler_;
+
+  BufferedOutput stdout_{ std::cout };
+  OutputSink* out_{ &stdout_ };
+
   // A map to store resolution info that associates each syntax tree node with
   // its resolved data.
   std::unordered_map<Expr*, size_t> locals_;
 
+  // Return statements whose calls are made by the caller of the function
+  std::unordered_set<Stmt*> tailCalls_;
+
   std::vector<StmtPtr> funcStmts_;
 
+  // Nodes taken out of the tree, whose addresses must stay in use
+  std::vector<ExprPtr> retiredExprs_;
+  std::vector<StmtPtr> retiredStmts_;
+
   LoxObject evaluate(Expr&);
 
   void validateNumberOperand(const Token& op, const LoxObject& operand) const;
@@ -72,6 +167,9 @@ private:
   bool isTruthy(const LoxObject&) const;
 
   LoxObject lookUpVariable(const Token&, Expr&);
+  CallExpr* tailCall(ReturnStmt&) const;
+  LoxObject executeTail(const std::vector<StmtPtr>&);
+  LoxObject executeTail(Stmt&);
   LoxCallable makeLoxCallable(FunctionStmt&, const EnvPtr&, bool);
   void bindInstance(LoxCallable&, const LoxObject&);
 };
@@ -90,6 +188,23 @@ public:
 
 /*---------------------------------------------------------------------------*/
 
+/** An exception that returns from a function by calling another one.
+ *
+ * The returning function is done by the time the call is made, so
+ * callFunction() makes it in place of the call being returned from: in a loop
+ * rather than on top of the stack.
+ */
+class TailCall : public std::runtime_error
+{
+public:
+  TailCall(LoxCallable function, LoxArguments args);
+
+  LoxCallable function;
+  LoxArguments args;
+};
+
+/*---------------------------------------------------------------------------*/
+
 class RuntimeError : public std::runtime_error
 {
 public:
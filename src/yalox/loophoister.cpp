@@ -0,0 +1,488 @@
+#include "loophoister.hpp"
+#include "interpreter.hpp"
+#include "typeinferrer.hpp"
+
+#include <format>
+
+namespace lox {
+
+namespace {
+
+using Names = std::unordered_set<std::string>;
+
+/*---------------------------------------------------------------------------*/
+
+/** Find the variables that code assigns or declares, and whether it makes
+ * calls. The tree is only read.
+ */
+class LoopScanner : public AstTransformer
+{
+public:
+  using AstTransformer::AstTransformer;
+
+  using AstTransformer::transform;
+
+  void scan(std::vector<StmtPtr>& statements)
+  {
+    for ( auto& stmt : statements ) {
+      transform(stmt);
+    }
+  }
+
+  const Names& assigned() const
+  {
+    return assigned_;
+  }
+
+  bool changes(const std::string& name) const
+  {
+    return assigned_.contains(name) || declared_.contains(name);
+  }
+
+  bool calls() const
+  {
+    return calls_;
+  }
+
+  ExprPtr visitAssignExpr(AssignExpr& expr) override
+  {
+    assigned_.insert(expr.name.lexeme());
+    return AstTransformer::visitAssignExpr(expr);
+  }
+
+  ExprPtr visitCallExpr(CallExpr& expr) override
+  {
+    calls_ = true;
+    return AstTransformer::visitCallExpr(expr);
+  }
+
+  ExprPtr visitInlineExpr(InlineExpr& expr) override
+  {
+    calls_ = true;
+    return AstTransformer::visitInlineExpr(expr);
+  }
+
+  StmtPtr visitClassStmt(ClassStmt& stmt) override
+  {
+    declared_.insert(stmt.name.lexeme());
+    return AstTransformer::visitClassStmt(stmt);
+  }
+
+  StmtPtr visitFunctionStmt(FunctionStmt& stmt) override
+  {
+    declared_.insert(stmt.name.lexeme());
+    for ( const auto& param : stmt.params ) {
+      declared_.insert(param.lexeme());
+    }
+    return AstTransformer::visitFunctionStmt(stmt);
+  }
+
+  StmtPtr visitVarStmt(VarStmt& stmt) override
+  {
+    declared_.insert(stmt.name.lexeme());
+    return AstTransformer::visitVarStmt(stmt);
+  }
+
+private:
+  Names assigned_;
+  Names declared_;
+  bool calls_{};
+};
+
+/*---------------------------------------------------------------------------*/
+
+/** Replace the invariant operations of a loop with variables, and make the
+ * declarations of these variables.
+ */
+class InvariantMover : public AstTransformer
+{
+public:
+  InvariantMover(
+    Interpreter& interpreter,
+    const LoopScanner& loop,
+    const Names& assigned,
+    const Names* defined,
+    bool local,
+    size_t& count)
+    : AstTransformer(interpreter)
+    , loop_(loop)
+    , assigned_(assigned)
+    , defined_(defined)
+    , local_(local)
+    , count_(count)
+  {
+  }
+
+  // The condition is evaluated first in the loop, and at least once
+  void moveFromCondition(ExprPtr& condition)
+  {
+    clean_ = true;
+    conditional_ = false;
+    transform(condition);
+  }
+
+  // What runs after the condition may not run at all
+  void moveFrom(ExprPtr& expr)
+  {
+    conditional_ = true;
+    transform(expr);
+  }
+
+  void moveFrom(StmtPtr& stmt)
+  {
+    conditional_ = true;
+    transform(stmt);
+  }
+
+  std::vector<StmtPtr> declarations()
+  {
+    return std::move(declarations_);
+  }
+
+  using AstTransformer::transform;
+
+  void transform(ExprPtr& expr) override
+  {
+    const auto traits = classify(*expr);
+    if ( traits.invariant && traits.operation &&
+         (traits.safe || (clean_ && !conditional_)) ) {
+      move(expr);
+      return;
+    }
+
+    AstTransformer::transform(expr);
+    clean_ = clean_ && traits.safe;
+  }
+
+  // The body runs in scopes of its own
+  ExprPtr visitInlineExpr(InlineExpr& expr) override
+  {
+    transform(expr.callee);
+    for ( auto& arg : expr.arguments ) {
+      transform(arg);
+    }
+    return nullptr;
+  }
+
+  // The right operand may not be evaluated
+  ExprPtr visitLogicalExpr(LogicalExpr& expr) override
+  {
+    transform(expr.left);
+
+    const auto conditional = conditional_;
+    conditional_ = true;
+    transform(expr.right);
+    conditional_ = conditional;
+
+    return nullptr;
+  }
+
+  StmtPtr visitBlockStmt(BlockStmt& stmt) override
+  {
+    ++depth_;
+    transform(stmt.statements);
+    --depth_;
+    return nullptr;
+  }
+
+  // Their code runs when they are called, not in the loop
+  StmtPtr visitClassStmt(ClassStmt& /* unused */) override
+  {
+    return nullptr;
+  }
+
+  StmtPtr visitFunctionStmt(FunctionStmt& /* unused */) override
+  {
+    return nullptr;
+  }
+
+private:
+  struct Traits
+  {
+    bool invariant;  // has no effect and reads nothing the loop changes
+    bool safe;       // cannot fail
+    bool operation;  // computes something rather than reading a value
+  };
+
+  const LoopScanner& loop_;
+  const Names& assigned_;
+  const Names* defined_;  // globals that are known to exist, if any
+  bool local_;
+  size_t& count_;
+
+  size_t depth_{};         // number of blocks around the code visited
+  bool clean_{};           // nothing evaluated so far can fail or have effects
+  bool conditional_{};     // whether the code visited may not be evaluated
+  std::vector<StmtPtr> declarations_;
+
+  void move(ExprPtr& expr)
+  {
+    const Token name{ TokenType::IDENTIFIER,
+                      std::format("(invariant {})", count_++),
+                      {},
+                      0 };
+
+    auto variable = std::make_unique<VariableExpr>(name);
+    variable->type = expr->type;
+    if ( local_ ) {
+      intpr_.resolve(*variable, depth_);
+    }
+
+    rebase(*expr);
+    declarations_.emplace_back(
+      std::make_unique<VarStmt>(name, std::move(expr)));
+    expr = std::move(variable);
+  }
+
+  // The local variables of a moved operation are found from before the loop
+  void rebase(Expr& expr)
+  {
+    if ( auto variable = dynamic_cast<VariableExpr*>(&expr) ) {
+      if ( !intpr_.isGlobal(*variable) ) {
+        intpr_.resolve(*variable, intpr_.depth(*variable) - depth_);
+      }
+    } else if ( auto grouping = dynamic_cast<GroupingExpr*>(&expr) ) {
+      rebase(*(grouping->expression));
+    } else if ( auto unary = dynamic_cast<UnaryExpr*>(&expr) ) {
+      rebase(*(unary->right));
+    } else if ( auto binary = dynamic_cast<BinaryExpr*>(&expr) ) {
+      rebase(*(binary->left));
+      rebase(*(binary->right));
+    } else if ( auto logical = dynamic_cast<LogicalExpr*>(&expr) ) {
+      rebase(*(logical->left));
+      rebase(*(logical->right));
+    }
+  }
+
+  Traits classify(Expr& expr) const
+  {
+    if ( dynamic_cast<LiteralExpr*>(&expr) ) {
+      return { true, true, false };
+    }
+
+    if ( auto variable = dynamic_cast<VariableExpr*>(&expr) ) {
+      return { invariant(*variable), defined(*variable), false };
+    }
+
+    if ( auto grouping = dynamic_cast<GroupingExpr*>(&expr) ) {
+      return classify(*(grouping->expression));
+    }
+
+    if ( auto unary = dynamic_cast<UnaryExpr*>(&expr) ) {
+      const auto right = classify(*(unary->right));
+      return { right.invariant,
+               right.safe && !TypeInferrer::canFail(*unary),
+               true };
+    }
+
+    if ( auto binary = dynamic_cast<BinaryExpr*>(&expr) ) {
+      const auto left = classify(*(binary->left));
+      const auto right = classify(*(binary->right));
+      return { left.invariant && right.invariant,
+               left.safe && right.safe && !TypeInferrer::canFail(*binary),
+               true };
+    }
+
+    if ( auto logical = dynamic_cast<LogicalExpr*>(&expr) ) {
+      const auto left = classify(*(logical->left));
+      const auto right = classify(*(logical->right));
+      return { left.invariant && right.invariant,
+               left.safe && right.safe,
+               true };
+    }
+
+    // Calls, properties, assignments and "this"
+    return { false, false, false };
+  }
+
+  bool invariant(VariableExpr& expr) const
+  {
+    const auto& name = expr.name.lexeme();
+    if ( loop_.changes(name) ) return false;
+    if ( !loop_.calls() ) return true;
+
+    // A call can run a function that assigns the variable
+    return !intpr_.isGlobal(expr) && !assigned_.contains(name);
+  }
+
+  // Reading a global fails if it has not been declared yet
+  bool defined(VariableExpr& expr) const
+  {
+    return !intpr_.isGlobal(expr) ||
+           (defined_ && defined_->contains(expr.name.lexeme()));
+  }
+};
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+LoopHoister::LoopHoister(Interpreter& interpreter)
+  : AstTransformer(interpreter)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+void LoopHoister::hoist(std::vector<StmtPtr>& statements)
+{
+  LoopScanner program{ intpr_ };
+  program.scan(statements);
+  assigned_ = program.assigned();
+
+  hoistFrom(statements);
+}
+
+/*---------------------------------------------------------------------------*/
+
+size_t LoopHoister::hoisted() const
+{
+  return hoisted_;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Hoist from the loops of a statement list, innermost loops first. The
+ * declarations of a loop go right before it.
+ */
+void LoopHoister::hoistFrom(std::vector<StmtPtr>& statements)
+{
+  for ( size_t i = 0; i < statements.size(); ++i ) {
+    transform(statements[i]);
+
+    auto declarations = hoistFrom(statements[i]);
+    define(*(statements[i]));
+
+    statements.insert(
+      statements.begin() + static_cast<std::ptrdiff_t>(i),
+      std::make_move_iterator(declarations.begin()),
+      std::make_move_iterator(declarations.end()));
+    i += declarations.size();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Hoist from a loop and return the statements to put before it.
+ *
+ * The initializer of a for loop has to run before the declarations, and is
+ * moved out along with them: the resolver gives for loops no scope of their
+ * own, so it declares its variable in the same scope wherever it is.
+ */
+std::vector<StmtPtr> LoopHoister::hoistFrom(StmtPtr& stmt)
+{
+  auto whileStmt = dynamic_cast<WhileStmt*>(stmt.get());
+  auto forStmt = dynamic_cast<ForStmt*>(stmt.get());
+  if ( !whileStmt && !forStmt ) return {};
+
+  LoopScanner loop{ intpr_ };
+  InvariantMover mover{ intpr_,
+                        loop,
+                        assigned_,
+                        level_ == 0 ? &defined_ : nullptr,
+                        local_,
+                        hoisted_ };
+
+  if ( whileStmt ) {
+    loop.transform(whileStmt->condition);
+    loop.transform(whileStmt->body);
+
+    mover.moveFromCondition(whileStmt->condition);
+    mover.moveFrom(whileStmt->body);
+    return mover.declarations();
+  }
+
+  if ( forStmt->initializer ) {
+    define(*(forStmt->initializer));
+  }
+  if ( forStmt->condition ) {
+    loop.transform(forStmt->condition);
+  }
+  loop.transform(forStmt->body);
+  if ( forStmt->increment ) {
+    loop.transform(forStmt->increment);
+  }
+
+  if ( forStmt->condition ) {
+    mover.moveFromCondition(forStmt->condition);
+  }
+  mover.moveFrom(forStmt->body);
+  if ( forStmt->increment ) {
+    mover.moveFrom(forStmt->increment);
+  }
+
+  auto declarations = mover.declarations();
+  if ( !declarations.empty() && forStmt->initializer ) {
+    declarations.insert(
+      declarations.begin(), std::move(forStmt->initializer));
+  }
+  return declarations;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Remember the globals that the top-level code declares: they exist from
+ * then on.
+ */
+void LoopHoister::define(const Stmt& stmt)
+{
+  if ( local_ ) return;
+
+  if ( auto var = dynamic_cast<const VarStmt*>(&stmt) ) {
+    defined_.insert(var->name.lexeme());
+  } else if ( auto function = dynamic_cast<const FunctionStmt*>(&stmt) ) {
+    defined_.insert(function->name.lexeme());
+  } else if ( auto klass = dynamic_cast<const ClassStmt*>(&stmt) ) {
+    defined_.insert(klass->name.lexeme());
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** An inlined body runs in scopes of its own, like the function it comes
+ * from.
+ */
+ExprPtr LoopHoister::visitInlineExpr(InlineExpr& expr)
+{
+  transform(expr.callee);
+  for ( auto& arg : expr.arguments ) {
+    transform(arg);
+  }
+
+  const auto local = local_;
+  ++level_;
+  local_ = true;
+  hoistFrom(expr.body);
+  local_ = local;
+  --level_;
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr LoopHoister::visitBlockStmt(BlockStmt& stmt)
+{
+  const auto local = local_;
+  local_ = true;
+  hoistFrom(stmt.statements);
+  local_ = local;
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr LoopHoister::visitFunctionStmt(FunctionStmt& stmt)
+{
+  const auto local = local_;
+  ++level_;
+  local_ = true;
+  hoistFrom(stmt.body);
+  local_ = local;
+  --level_;
+
+  return nullptr;
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "asttransformer.hpp"
+
+#include <string>
+#include <unordered_set>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Move the computations of while and for loops that give the same value on
+ * every iteration out of them.
+ *
+ * An expression of a loop is invariant when it only reads variables and
+ * literals, and none of its variables is assigned or declared in the loop. A
+ * call in the loop could assign any global, and any local variable that some
+ * function assigns, so these are not invariant in a loop that makes calls.
+ *
+ * The largest invariant operations are computed once into variables declared
+ * right before the loop, in the statement list that contains it, so that no
+ * scope is added and the resolution of the other variables holds. Loops that
+ * are not part of a statement list are left as they are.
+ *
+ * An operation is only moved if that changes nothing but how often it runs:
+ * either it cannot fail, such as arithmetic on operands known to be numbers
+ * (see TypeInferrer), or it is in the condition of the loop and nothing that
+ * could fail or have an effect is evaluated before it.
+ */
+class LoopHoister : public AstTransformer
+{
+public:
+  LoopHoister(Interpreter&);
+
+  void hoist(std::vector<StmtPtr>&);
+
+  // How many operations were moved out of loops
+  size_t hoisted() const;
+
+  ExprPtr visitInlineExpr(InlineExpr&) override;
+
+  StmtPtr visitBlockStmt(BlockStmt&) override;
+  StmtPtr visitFunctionStmt(FunctionStmt&) override;
+
+private:
+  using Names = std::unordered_set<std::string>;
+
+  Names assigned_;  // anywhere in the program
+  Names defined_;   // globals declared by the top-level code run so far
+  size_t level_{};  // number of functions around the code being visited
+  bool local_{};    // whether the statement list visited is in a local scope
+  size_t hoisted_{};
+
+  void hoistFrom(std::vector<StmtPtr>&);
+  std::vector<StmtPtr> hoistFrom(StmtPtr& loop);
+  void define(const Stmt&);
+};
+
+}
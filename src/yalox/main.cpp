@@ -1,17 +1,60 @@
 #include "yalox.hpp"
 
+#include <charconv>
 #include <iostream>
+#include <string_view>
 
 using namespace lox;
 
 /*---------------------------------------------------------------------------*/
 
+[[noreturn]] void usage()
+{
+  std::cout << "Usage: yalox [--closures] [--inline-budget=N] [--type-stats] "
+               "[--closed-world] [--line-buffered] [script]\n";
+  // EX_USAGE(64) - the command was used incorrectly
+  std::exit(ERR_USAGE);
+}
+
+/*---------------------------------------------------------------------------*/
+
 int main(int argc, char* argv[])
 {
+  // Options come before the script
+  while ( argc > 1 && std::string_view{ argv[1] }.starts_with("--") ) {
+    const std::string_view option{ argv[1] };
+    const std::string_view budgetOption{ "--inline-budget=" };
+
+    if ( option == "--closures" ) {
+      // compile statements into closures before running them
+      YaLox::setExecutionMode(ExecutionMode::CLOSURES);
+    } else if ( option == "--type-stats" ) {
+      // report the arithmetic specialized by type inference
+      YaLox::setTypeStats(true);
+    } else if ( option == "--closed-world" ) {
+      // the script is the whole program: drop its unused top-level functions
+      YaLox::setClosedWorld(true);
+    } else if ( option == "--line-buffered" ) {
+      // show what the script prints line by line rather than in chunks
+      YaLox::setLineBuffered(true);
+    } else if ( option.starts_with(budgetOption) ) {
+      // largest function body inlined at its calls, 0 to turn inlining off
+      const auto digits = option.substr(budgetOption.size());
+      const auto last = digits.data() + digits.size();
+      size_t budget{};
+      auto [end, ec] = std::from_chars(digits.data(), last, budget);
+      if ( ec != std::errc{} || end != last ) usage();
+      YaLox::setInlineBudget(budget);
+    } else {
+      usage();
+    }
+
+    --argc;
+    ++argv;
+  }
+
   if ( argc > 2 ) {
-    std::cout << "Usage: yalox [script]\n";
-    // EX_USAGE(64) - the command was used incorrectly
-    std::exit(ERR_USAGE);
+    usage();
   } else if ( argc == 2 ) {
     YaLox::runScript(argv[1]);
   } else {
@@ -0,0 +1,67 @@
+#include "output.hpp"
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+BufferedOutput::BufferedOutput(std::ostream& os)
+  : os_(os)
+{
+  buffer_.reserve(CAPACITY);
+}
+
+/*---------------------------------------------------------------------------*/
+
+BufferedOutput::~BufferedOutput()
+{
+  flush();
+}
+
+/*---------------------------------------------------------------------------*/
+
+void BufferedOutput::setLineBuffered(bool enabled)
+{
+  lineBuffered_ = enabled;
+  if ( enabled ) flush();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Keep the text in the buffer, making room for it first if needed. Text that
+ * is larger than the buffer is written out right away.
+ */
+void BufferedOutput::write(std::string_view text)
+{
+  if ( buffer_.size() + text.size() > CAPACITY ) drain();
+
+  if ( text.size() >= CAPACITY ) {
+    os_.write(text.data(), static_cast<std::streamsize>(text.size()));
+  } else {
+    buffer_.append(text);
+  }
+
+  if ( lineBuffered_ && text.find('\n') != std::string_view::npos ) flush();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Write out the buffer, then flush the stream itself so that the output is
+ * seen before whatever comes next, such as an error or a prompt.
+ */
+void BufferedOutput::flush()
+{
+  drain();
+  os_.flush();
+}
+
+/*---------------------------------------------------------------------------*/
+
+void BufferedOutput::drain()
+{
+  if ( buffer_.empty() ) return;
+
+  os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+}
+
+}  // namespace lox
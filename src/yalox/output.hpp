@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Where the print statements of a program write (see
+ * Interpreter::setOutput). An embedder can capture what a program prints by
+ * giving the interpreter its own.
+ */
+class OutputSink
+{
+public:
+  virtual ~OutputSink() = default;
+
+  virtual void write(std::string_view) = 0;
+
+  // Make what was written so far visible, if it is kept anywhere
+  virtual void flush() {}
+};
+
+/*---------------------------------------------------------------------------*/
+
+/** Output to a stream, kept in a large buffer and written out when the buffer
+ * is full or flushed, instead of a little at every print.
+ *
+ * Line-buffered, it is flushed at the end of every line as well, for when
+ * someone is watching the output come.
+ */
+class BufferedOutput : public OutputSink
+{
+public:
+  static constexpr size_t CAPACITY = 64 * 1024;
+
+  BufferedOutput(std::ostream&);
+  ~BufferedOutput() override;
+
+  BufferedOutput(const BufferedOutput&) = delete;
+  BufferedOutput& operator=(const BufferedOutput&) = delete;
+
+  void setLineBuffered(bool);
+
+  void write(std::string_view) override;
+  void flush() override;
+
+private:
+  std::ostream& os_;
+  std::string buffer_;
+  bool lineBuffered_{};
+
+  void drain();
+};
+
+}
@@ -59,6 +59,50 @@ void Resolver::visitGroupingExpr(GroupingExpr& expr)
 
 /*---------------------------------------------------------------------------*/
 
+void Resolver::visitInlineExpr(InlineExpr& expr)
+{
+  resolve(*(expr.callee));
+
+  for ( const auto& arg : expr.arguments ) {
+    resolve(*arg);
+  }
+
+  resolveInlined(expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Resolve the body of an inlined call.
+ *
+ * Only top-level functions are inlined, so the body can see nothing but its
+ * own scopes and the globals, wherever the call is. It is resolved in scopes
+ * of its own, exactly like the function it comes from: a local variable at
+ * the call site must not capture a global that the body refers to.
+ */
+void Resolver::resolveInlined(InlineExpr& expr)
+{
+  auto enclosingScopes = std::move(scopes_);
+  auto enclosingFuncType = currentFuncType_;
+  auto enclosingClassType = currentClassType_;
+  scopes_.clear();
+  currentFuncType_ = FunctionType::FUNC;
+  currentClassType_ = ClassType::NONE;
+
+  beginScope();
+  for ( const auto& param : expr.function->params ) {
+    declare(param);
+    define(param);
+  }
+  resolve(expr.body);
+  endScope();
+
+  scopes_ = std::move(enclosingScopes);
+  currentFuncType_ = enclosingFuncType;
+  currentClassType_ = enclosingClassType;
+}
+
+/*---------------------------------------------------------------------------*/
+
 void Resolver::visitLiteralExpr(LiteralExpr& /* unused */) {}
 
 /*---------------------------------------------------------------------------*/
@@ -191,6 +235,9 @@ void Resolver::visitPrintStmt(PrintStmt& stmt)
 
 /*---------------------------------------------------------------------------*/
 
+/** A function that returns the value of a call does nothing after the call,
+ * which can then be made without nesting in the function's frame.
+ */
 void Resolver::visitReturnStmt(ReturnStmt& stmt)
 {
   if ( currentFuncType_ == FunctionType::NONE ) {
@@ -203,6 +250,10 @@ void Resolver::visitReturnStmt(ReturnStmt& stmt)
     }
 
     resolve(*(stmt.value));
+
+    if ( dynamic_cast<CallExpr*>(stmt.value.get()) ) {
+      intpr_.resolveTailCall(stmt);
+    }
   }
 }
 
@@ -17,11 +17,14 @@ public:
 
   void resolve(const std::vector<StmtPtr>&);
 
+  void resolveInlined(InlineExpr&);
+
   void visitAssignExpr(AssignExpr&) override;
   void visitBinaryExpr(BinaryExpr&) override;
   void visitCallExpr(CallExpr&) override;
   void visitGetExpr(GetExpr&) override;
   void visitGroupingExpr(GroupingExpr&) override;
+  void visitInlineExpr(InlineExpr&) override;
   void visitLiteralExpr(LiteralExpr&) override;
   void visitLogicalExpr(LogicalExpr&) override;
   void visitSetExpr(SetExpr&) override;
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+/*---------------------------------------------------------------------------*/
+
+/** small_vector - vector that keeps up to N elements in place and only goes to
+ * the heap when it grows past that.
+ *
+ * It has just what the interpreter needs of std::vector: adding elements at
+ * the back, indexing and iterating over them.
+ */
+
+template <typename T, size_t N>
+class small_vector
+{
+public:
+  small_vector() = default;
+
+  small_vector(const small_vector& other)
+  {
+    reserve(other.size_);
+    for ( auto& element : other ) emplace_back(element);
+  }
+
+  small_vector(small_vector&& other) noexcept
+  {
+    take(other);
+  }
+
+  ~small_vector()
+  {
+    clear();
+    deallocate();
+  }
+
+  small_vector& operator=(const small_vector& other)
+  {
+    if ( this != &other ) {
+      clear();
+      reserve(other.size_);
+      for ( auto& element : other ) emplace_back(element);
+    }
+    return *this;
+  }
+
+  small_vector& operator=(small_vector&& other) noexcept
+  {
+    if ( this != &other ) {
+      clear();
+      deallocate();
+      take(other);
+    }
+    return *this;
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args)
+  {
+    if ( size_ == capacity_ ) reserve(2 * capacity_);
+    return *(new (data_ + size_++) T(std::forward<Args>(args)...));
+  }
+
+  void reserve(size_t capacity)
+  {
+    if ( capacity <= capacity_ ) return;
+
+    T* data = std::allocator<T>{}.allocate(capacity);
+    for ( size_t i = 0; i < size_; ++i ) {
+      new (data + i) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    deallocate();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void clear()
+  {
+    for ( size_t i = 0; i < size_; ++i ) data_[i].~T();
+    size_ = 0;
+  }
+
+  size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  T& operator[](size_t i)
+  {
+    return data_[i];
+  }
+
+  const T& operator[](size_t i) const
+  {
+    return data_[i];
+  }
+
+  T* begin()
+  {
+    return data_;
+  }
+
+  T* end()
+  {
+    return data_ + size_;
+  }
+
+  const T* begin() const
+  {
+    return data_;
+  }
+
+  const T* end() const
+  {
+    return data_ + size_;
+  }
+
+private:
+  alignas(T) std::byte buffer_[N * sizeof(T)];
+  T* data_{ reinterpret_cast<T*>(buffer_) };
+  size_t size_{};
+  size_t capacity_{ N };
+
+  inline bool inPlace() const
+  {
+    return data_ == reinterpret_cast<const T*>(buffer_);
+  }
+
+  inline void deallocate()
+  {
+    if ( !inPlace() ) {
+      std::allocator<T>{}.deallocate(data_, capacity_);
+      data_ = reinterpret_cast<T*>(buffer_);
+      capacity_ = N;
+    }
+  }
+
+  // Elements on the heap change hands, those in place are moved one by one
+  inline void take(small_vector& other)
+  {
+    if ( other.inPlace() ) {
+      for ( auto& element : other ) emplace_back(std::move(element));
+      other.clear();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+      capacity_ = other.capacity_;
+      other.data_ = reinterpret_cast<T*>(other.buffer_);
+      other.size_ = 0;
+      other.capacity_ = N;
+    }
+  }
+};
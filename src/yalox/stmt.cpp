@@ -2,6 +2,8 @@
 
 #include "resolver.hpp"
 #include "interpreter.hpp"
+#include "closurecompiler.hpp"
+#include "asttransformer.hpp"
 
 namespace lox {
 
@@ -28,6 +30,20 @@ void BlockStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt BlockStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitBlockStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr BlockStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitBlockStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 ClassStmt::ClassStmt(Token name, std::vector<StmtPtr> methods)
   : name(std::move(name))
   , methods(std::move(methods))
@@ -50,6 +66,20 @@ void ClassStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt ClassStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitClassStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ClassStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitClassStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 ExprStmt::ExprStmt(ExprPtr expression)
   : expression(std::move(expression))
 {
@@ -71,6 +101,20 @@ void ExprStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt ExprStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitExprStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ExprStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitExprStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 FunctionStmt::FunctionStmt(
   Token name,
   std::vector<Token> params,
@@ -97,6 +141,20 @@ void FunctionStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt FunctionStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitFunctionStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr FunctionStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitFunctionStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 IfStmt::IfStmt(ExprPtr condition, StmtPtr thenBranch, StmtPtr elseBranch)
   : condition(std::move(condition))
   , thenBranch(std::move(thenBranch))
@@ -120,6 +178,20 @@ void IfStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt IfStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitIfStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr IfStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitIfStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 PrintStmt::PrintStmt(ExprPtr expression)
   : expression(std::move(expression))
 {
@@ -141,6 +213,20 @@ void PrintStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt PrintStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitPrintStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr PrintStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitPrintStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 ReturnStmt::ReturnStmt(Token keyword, ExprPtr value)
   : keyword(std::move(keyword))
   , value(std::move(value))
@@ -163,6 +249,20 @@ void ReturnStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt ReturnStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitReturnStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ReturnStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitReturnStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 VarStmt::VarStmt(Token name, ExprPtr initializer)
   : name(std::move(name))
   , initializer(std::move(initializer))
@@ -185,6 +285,20 @@ void VarStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt VarStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitVarStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr VarStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitVarStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 WhileStmt::WhileStmt(ExprPtr condition, StmtPtr body)
   : condition(std::move(condition))
   , body(std::move(body))
@@ -207,6 +321,20 @@ void WhileStmt::execute(Interpreter& interpreter)
 
 /*---------------------------------------------------------------------------*/
 
+CompiledStmt WhileStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitWhileStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr WhileStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitWhileStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
 ForStmt::ForStmt(
   StmtPtr initializer,
   ExprPtr condition,
@@ -233,4 +361,18 @@ void ForStmt::execute(Interpreter& interpreter)
   interpreter.visitForStmt(*this);
 }
 
+/*---------------------------------------------------------------------------*/
+
+CompiledStmt ForStmt::compile(ClosureCompiler& compiler)
+{
+  return compiler.visitForStmt(*this);
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr ForStmt::transform(AstTransformer& transformer)
+{
+  return transformer.visitForStmt(*this);
+}
+
 }  // namespace lox
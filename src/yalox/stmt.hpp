@@ -24,6 +24,9 @@ class ForStmt;
 
 using StmtPtr = std::unique_ptr<Stmt>;
 
+// A statement compiled by the ClosureCompiler
+using CompiledStmt = std::function<void()>;
+
 /*---------------------------------------------------------------------------*/
 
 template <typename T>
@@ -58,6 +61,12 @@ public:
 
   // accept function for StmtVisitor<void>
   virtual void execute(Interpreter&) = 0;
+
+  // accept function for StmtVisitor<CompiledStmt>
+  virtual CompiledStmt compile(ClosureCompiler&) = 0;
+
+  // accept function for StmtVisitor<StmtPtr>
+  virtual StmtPtr transform(AstTransformer&) = 0;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -73,6 +82,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   std::vector<StmtPtr> statements;
 };
 
@@ -89,6 +102,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   Token name;
   std::vector<StmtPtr> methods;
 };
@@ -106,6 +123,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   ExprPtr expression;
 };
 
@@ -125,6 +146,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   Token name;
   std::vector<Token> params;
   std::vector<StmtPtr> body;
@@ -143,6 +168,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   ExprPtr condition;
   StmtPtr thenBranch;
   StmtPtr elseBranch;
@@ -161,6 +190,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   ExprPtr expression;
 };
 
@@ -177,6 +210,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   Token keyword;
   ExprPtr value;
 };
@@ -194,6 +231,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   Token name;
   ExprPtr initializer;
 };
@@ -211,6 +252,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   ExprPtr condition;
   StmtPtr body;
 };
@@ -232,6 +277,10 @@ public:
 
   void execute(Interpreter&) override;
 
+  CompiledStmt compile(ClosureCompiler&) override;
+
+  StmtPtr transform(AstTransformer&) override;
+
   StmtPtr initializer;
   ExprPtr condition;
   ExprPtr increment;
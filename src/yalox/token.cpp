@@ -1,7 +1,8 @@
 #include "token.hpp"
 
+#include <charconv>
 #include <format>
-#include <sstream>
+#include <iterator>
 
 namespace lox {
 
@@ -114,10 +115,16 @@ std::string toString(const LoxObject& obj)
   if ( obj ) {
     const auto& exprValue = obj.value();
     if ( std::holds_alternative<double>(exprValue) ) {
-      // use sstream to discard zeroes from fractional part of a whole number
-      std::ostringstream os;
-      os << std::get<double>(exprValue);
-      return os.str();
+      // 6 significant digits like std::ostream prints by default, which
+      // discards zeroes from fractional part of a whole number
+      char buffer[32];
+      const auto result = std::to_chars(
+        std::begin(buffer),
+        std::end(buffer),
+        std::get<double>(exprValue),
+        std::chars_format::general,
+        6);
+      return { buffer, result.ptr };
     } else if ( std::holds_alternative<bool>(exprValue) ) {
       return std::get<bool>(exprValue) ? "true" : "false";
     } else if ( std::holds_alternative<LoxCallable>(exprValue) ) {
@@ -125,7 +132,8 @@ std::string toString(const LoxObject& obj)
     } else if ( std::holds_alternative<LoxInstancePtr>(exprValue) ) {
       return std::get<LoxInstancePtr>(exprValue)->toString();
     }
-    return "\"" + std::get<std::string>(exprValue) + "\"";
+    const auto chars = std::get<LoxString>(exprValue).str();
+    return std::format("\"{}\"", chars);
   }
   return literal;
 }
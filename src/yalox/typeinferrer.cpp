@@ -0,0 +1,494 @@
+#include "typeinferrer.hpp"
+#include "interpreter.hpp"
+
+#include <format>
+
+namespace lox {
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+/** The type of a value that is one of two others.
+ */
+StaticType either(StaticType a, StaticType b)
+{
+  return a == b ? a : StaticType::UNKNOWN;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StaticType typeOf(const LoxObject& value)
+{
+  if ( !value ) return StaticType::NIL;
+
+  if ( std::holds_alternative<double>(value.value()) ) {
+    return StaticType::NUMBER;
+  }
+  if ( std::holds_alternative<LoxString>(value.value()) ) {
+    return StaticType::STRING;
+  }
+  if ( std::holds_alternative<bool>(value.value()) ) {
+    return StaticType::BOOL;
+  }
+
+  return StaticType::UNKNOWN;
+}
+
+}  // namespace
+
+/*---------------------------------------------------------------------------*/
+
+TypeInferrer::TypeInferrer(Interpreter& interpreter)
+  : AstTransformer(interpreter)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The program is analyzed twice: a use of a variable depends on whether it
+ * is assigned anywhere, which the first pass finds out.
+ */
+void TypeInferrer::infer(std::vector<StmtPtr>& statements)
+{
+  transform(statements);
+
+  state_.clear();
+  transform(statements);
+}
+
+/*---------------------------------------------------------------------------*/
+
+std::string TypeInferrer::summary() const
+{
+  const auto total = arithmetic_.size();
+  const auto known = specialized_.size();
+
+  return std::format(
+    "{} of {} arithmetic operations specialized ({}%)",
+    known,
+    total,
+    total > 0 ? known * 100 / total : 100);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Only the operand checks of the interpreter fail: those of arithmetic and
+ * comparisons, unless their operands are known to be numbers, or strings for
+ * "+".
+ */
+bool TypeInferrer::canFail(const Expr& expr)
+{
+  if ( auto unary = dynamic_cast<const UnaryExpr*>(&expr) ) {
+    return unary->op.type() == TokenType::MINUS &&
+           unary->right->type != StaticType::NUMBER;
+  }
+
+  auto binary = dynamic_cast<const BinaryExpr*>(&expr);
+  if ( !binary ) return false;
+
+  const auto left = binary->left->type;
+  const auto right = binary->right->type;
+
+  switch ( binary->op.type() ) {
+    case TokenType::BANG_EQUAL:
+    case TokenType::EQUAL_EQUAL:
+      return false;
+
+    case TokenType::PLUS:
+      if ( left == StaticType::STRING && right == StaticType::STRING ) {
+        return false;
+      }
+      [[fallthrough]];
+
+    default:
+      return left != StaticType::NUMBER || right != StaticType::NUMBER;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void TypeInferrer::declare(const Token& name, StaticType type)
+{
+  // Globals can be assigned by any function, at any time
+  if ( scopes_.empty() ) return;
+
+  scopes_.back()[name.lexeme()] = &name;
+
+  auto& variable =
+    variables_.try_emplace(&name, Variable{ level_, type, false, false })
+      .first->second;
+  variable.level = level_;
+  variable.declared = type;
+
+  state_[&name] = type;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Find the declaration of a local variable, the same way the resolver did.
+ */
+const Token* TypeInferrer::find(const Token& name) const
+{
+  for ( auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope ) {
+    if ( auto it = scope->find(name.lexeme()); it != scope->end() ) {
+      return it->second;
+    }
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void TypeInferrer::inferFunction(FunctionStmt& function)
+{
+  ++level_;
+  scopes_.emplace_back();
+
+  for ( const auto& param : function.params ) {
+    declare(param, StaticType::UNKNOWN);
+  }
+  transform(function.body);
+
+  scopes_.pop_back();
+  --level_;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void TypeInferrer::count(Expr& expr, bool specialized)
+{
+  arithmetic_.insert(&expr);
+
+  if ( specialized ) {
+    specialized_.insert(&expr);
+  } else {
+    specialized_.erase(&expr);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Where two paths meet, a variable keeps its type only if it has it on both.
+ */
+TypeInferrer::State TypeInferrer::join(const State& a, const State& b)
+{
+  State joined;
+  for ( const auto& [name, type] : a ) {
+    const auto it = b.find(name);
+    joined[name] = it != b.end() ? either(type, it->second)
+                                 : StaticType::UNKNOWN;
+  }
+
+  return joined;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitAssignExpr(AssignExpr& expr)
+{
+  transform(expr.value);
+  expr.type = expr.value->type;
+
+  if ( intpr_.isGlobal(expr) ) return nullptr;
+
+  if ( auto name = find(expr.name) ) {
+    auto& variable = variables_.at(name);
+    variable.assigned = true;
+
+    if ( variable.level == level_ ) {
+      state_[name] = expr.type;
+    } else {
+      variable.assignedInside = true;
+    }
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** An arithmetic operation is specialized when its operands are known to be
+ * numbers, or strings for "+". Whatever its operands, it can only result in
+ * a number or a bool, or fail.
+ */
+ExprPtr TypeInferrer::visitBinaryExpr(BinaryExpr& expr)
+{
+  AstTransformer::visitBinaryExpr(expr);
+
+  const auto left = expr.left->type;
+  const auto right = expr.right->type;
+  const bool numbers =
+    left == StaticType::NUMBER && right == StaticType::NUMBER;
+
+  switch ( expr.op.type() ) {
+    case TokenType::MINUS:
+    case TokenType::SLASH:
+    case TokenType::STAR:
+      expr.type = StaticType::NUMBER;
+      count(expr, numbers);
+      break;
+
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+      expr.type = StaticType::BOOL;
+      count(expr, numbers);
+      break;
+
+    case TokenType::PLUS:
+      if ( left == StaticType::NUMBER || right == StaticType::NUMBER ) {
+        expr.type = StaticType::NUMBER;
+      } else if ( left == StaticType::STRING || right == StaticType::STRING ) {
+        expr.type = StaticType::STRING;
+      } else {
+        expr.type = StaticType::UNKNOWN;
+      }
+      count(expr, numbers || (left == right && left == StaticType::STRING));
+      break;
+
+    default:
+      expr.type = StaticType::BOOL;
+      break;
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitGroupingExpr(GroupingExpr& expr)
+{
+  AstTransformer::visitGroupingExpr(expr);
+  expr.type = expr.expression->type;
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The parameters of an inlined body hold the arguments of the call. Like in
+ * the resolver, the body sees its own scopes and the globals only.
+ */
+ExprPtr TypeInferrer::visitInlineExpr(InlineExpr& expr)
+{
+  transform(expr.callee);
+  for ( auto& arg : expr.arguments ) {
+    transform(arg);
+  }
+
+  auto enclosingScopes = std::move(scopes_);
+  scopes_.clear();
+  ++level_;
+
+  scopes_.emplace_back();
+  for ( size_t i = 0; i < expr.arguments.size(); ++i ) {
+    declare(expr.function->params[i], expr.arguments[i]->type);
+  }
+  transform(expr.body);
+
+  --level_;
+  scopes_ = std::move(enclosingScopes);
+
+  expr.type = StaticType::UNKNOWN;
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitLiteralExpr(LiteralExpr& expr)
+{
+  expr.type = typeOf(expr.value);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitLogicalExpr(LogicalExpr& expr)
+{
+  transform(expr.left);
+
+  // The right operand may not be evaluated
+  const auto afterLeft = state_;
+  transform(expr.right);
+  state_ = join(afterLeft, state_);
+
+  expr.type = either(expr.left->type, expr.right->type);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitSetExpr(SetExpr& expr)
+{
+  AstTransformer::visitSetExpr(expr);
+  expr.type = expr.value->type;
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+ExprPtr TypeInferrer::visitUnaryExpr(UnaryExpr& expr)
+{
+  AstTransformer::visitUnaryExpr(expr);
+
+  if ( expr.op.type() == TokenType::MINUS ) {
+    expr.type = StaticType::NUMBER;
+    count(expr, expr.right->type == StaticType::NUMBER);
+  } else {
+    expr.type = StaticType::BOOL;
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** A variable of the function being analyzed has the type it has at this
+ * point, and one of an enclosing function has the type it is declared with
+ * if it keeps its value.
+ */
+ExprPtr TypeInferrer::visitVariableExpr(VariableExpr& expr)
+{
+  expr.type = StaticType::UNKNOWN;
+
+  if ( intpr_.isGlobal(expr) ) return nullptr;
+
+  auto name = find(expr.name);
+  if ( !name ) return nullptr;
+
+  const auto& variable = variables_.at(name);
+  if ( variable.level == level_ ) {
+    const auto it = state_.find(name);
+    if ( !variable.assignedInside && it != state_.end() ) {
+      expr.type = it->second;
+    }
+  } else if ( !variable.assigned ) {
+    expr.type = variable.declared;
+  }
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitBlockStmt(BlockStmt& stmt)
+{
+  scopes_.emplace_back();
+  transform(stmt.statements);
+  scopes_.pop_back();
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitClassStmt(ClassStmt& stmt)
+{
+  declare(stmt.name, StaticType::UNKNOWN);
+
+  // The scope of "this"
+  scopes_.emplace_back();
+  for ( auto& method : stmt.methods ) {
+    inferFunction(static_cast<FunctionStmt&>(*method));
+  }
+  scopes_.pop_back();
+
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitFunctionStmt(FunctionStmt& stmt)
+{
+  declare(stmt.name, StaticType::UNKNOWN);
+  inferFunction(stmt);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitIfStmt(IfStmt& stmt)
+{
+  transform(stmt.condition);
+
+  const auto entry = state_;
+  transform(stmt.thenBranch);
+  auto afterThen = std::move(state_);
+
+  state_ = entry;
+  if ( stmt.elseBranch ) {
+    transform(stmt.elseBranch);
+  }
+
+  state_ = join(afterThen, state_);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitVarStmt(VarStmt& stmt)
+{
+  auto type = StaticType::NIL;
+  if ( stmt.initializer ) {
+    transform(stmt.initializer);
+    type = stmt.initializer->type;
+  }
+
+  declare(stmt.name, type);
+  return nullptr;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The body is analyzed until the types its variables have when it starts
+ * over are the ones they had the time before. The last time annotates it.
+ */
+StmtPtr TypeInferrer::visitWhileStmt(WhileStmt& stmt)
+{
+  for ( ;; ) {
+    const auto entry = state_;
+    transform(stmt.condition);
+    auto exit = state_;
+
+    transform(stmt.body);
+
+    auto next = join(entry, state_);
+    if ( next == entry ) {
+      state_ = std::move(exit);
+      return nullptr;
+    }
+    state_ = std::move(next);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+StmtPtr TypeInferrer::visitForStmt(ForStmt& stmt)
+{
+  if ( stmt.initializer ) {
+    transform(stmt.initializer);
+  }
+
+  for ( ;; ) {
+    const auto entry = state_;
+    if ( stmt.condition ) {
+      transform(stmt.condition);
+    }
+    auto exit = state_;
+
+    transform(stmt.body);
+    if ( stmt.increment ) {
+      transform(stmt.increment);
+    }
+
+    auto next = join(entry, state_);
+    if ( next == entry ) {
+      state_ = std::move(exit);
+      return nullptr;
+    }
+    state_ = std::move(next);
+  }
+}
+
+}
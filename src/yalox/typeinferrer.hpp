@@ -0,0 +1,87 @@
+#pragma once
+
+#include "asttransformer.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lox {
+
+/*---------------------------------------------------------------------------*/
+
+/** Prove what type of value expressions evaluate to, and annotate them with
+ * it (see Expr::type).
+ *
+ * Local variables are followed through the code: a variable has the type of
+ * the value last assigned to it on every path that reaches a use, with loops
+ * analyzed until the types of their variables stop changing. Globals, calls,
+ * properties and parameters are unknown, and so is a local variable assigned
+ * by a function nested in the one that declares it. A nested function reading
+ * a variable of an enclosing one only knows its type if it is never assigned.
+ *
+ * The interpreter skips the operand checks of an operator whose operands have
+ * known types, and checks the others as usual.
+ */
+class TypeInferrer : public AstTransformer
+{
+public:
+  TypeInferrer(Interpreter&);
+
+  void infer(std::vector<StmtPtr>&);
+
+  // What fraction of the arithmetic operations have operands of known types
+  std::string summary() const;
+
+  // Whether a unary or binary operation may fail on the operands it gets
+  static bool canFail(const Expr&);
+
+  ExprPtr visitAssignExpr(AssignExpr&) override;
+  ExprPtr visitBinaryExpr(BinaryExpr&) override;
+  ExprPtr visitGroupingExpr(GroupingExpr&) override;
+  ExprPtr visitInlineExpr(InlineExpr&) override;
+  ExprPtr visitLiteralExpr(LiteralExpr&) override;
+  ExprPtr visitLogicalExpr(LogicalExpr&) override;
+  ExprPtr visitSetExpr(SetExpr&) override;
+  ExprPtr visitUnaryExpr(UnaryExpr&) override;
+  ExprPtr visitVariableExpr(VariableExpr&) override;
+
+  StmtPtr visitBlockStmt(BlockStmt&) override;
+  StmtPtr visitClassStmt(ClassStmt&) override;
+  StmtPtr visitFunctionStmt(FunctionStmt&) override;
+  StmtPtr visitIfStmt(IfStmt&) override;
+  StmtPtr visitVarStmt(VarStmt&) override;
+  StmtPtr visitWhileStmt(WhileStmt&) override;
+  StmtPtr visitForStmt(ForStmt&) override;
+
+private:
+  // A local variable, identified by the token that declares it
+  struct Variable
+  {
+    size_t level;         // number of functions around its declaration
+    StaticType declared;  // type of the value it is declared with
+    bool assigned;        // after its declaration
+    bool assignedInside;  // by a function nested in the one declaring it
+  };
+
+  using State = std::unordered_map<const Token*, StaticType>;
+
+  std::vector<std::unordered_map<std::string, const Token*>> scopes_;
+  std::unordered_map<const Token*, Variable> variables_;
+  size_t level_{};
+
+  // Types of the variables where the code being analyzed is
+  State state_;
+
+  std::unordered_set<Expr*> arithmetic_;
+  std::unordered_set<Expr*> specialized_;
+
+  void declare(const Token&, StaticType);
+  const Token* find(const Token&) const;
+  void inferFunction(FunctionStmt&);
+  void count(Expr&, bool specialized);
+
+  static State join(const State&, const State&);
+};
+
+}
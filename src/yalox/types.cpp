@@ -7,6 +7,127 @@ namespace lox {
 
 /*---------------------------------------------------------------------------*/
 
+LoxString::LoxString(std::string chars)
+  : size_(chars.size())
+{
+  if ( size_ ) text_ = new Text{ std::move(chars), 1 };
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString::LoxString(const char* chars)
+  : LoxString(std::string{ chars })
+{
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString::LoxString(const LoxString& other)
+  : text_(other.text_)
+  , size_(other.size_)
+{
+  if ( text_ ) ++(text_->count);
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString::LoxString(LoxString&& other) noexcept
+  : text_(other.text_)
+  , size_(other.size_)
+{
+  other.text_ = nullptr;
+  other.size_ = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString::~LoxString()
+{
+  release();
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString& LoxString::operator=(const LoxString& other)
+{
+  if ( text_ != other.text_ ) {
+    release();
+    text_ = other.text_;
+    if ( text_ ) ++(text_->count);
+  }
+  size_ = other.size_;
+  return *this;
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString& LoxString::operator=(LoxString&& other) noexcept
+{
+  if ( this != &other ) {
+    release();
+    text_ = other.text_;
+    size_ = other.size_;
+    other.text_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** The characters of the string, valid until a string is appended to its
+ * buffer.
+ */
+std::string_view LoxString::str() const
+{
+  if ( !text_ ) return {};
+  return { text_->chars.data(), size_ };
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Strings that share their characters are equal without comparing them.
+ */
+bool operator==(const LoxString& left, const LoxString& right)
+{
+  if ( left.text_ == right.text_ ) return left.size_ == right.size_;
+  return left.str() == right.str();
+}
+
+/*---------------------------------------------------------------------------*/
+
+LoxString operator+(const LoxString& left, const LoxString& right)
+{
+  if ( !right.size_ ) return left;
+  if ( !left.size_ ) return right;
+
+  // std::string copies what is appended before freeing a buffer it outgrows,
+  // so a string can be appended to its own buffer too
+  if ( left.size_ == left.text_->chars.size() ) {
+    left.text_->chars.append(right.text_->chars, 0, right.size_);
+
+    LoxString result{ left };
+    result.size_ += right.size_;
+    return result;
+  }
+
+  std::string chars;
+  chars.reserve(left.size_ + right.size_);
+  chars.append(left.str()).append(right.str());
+  return chars;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void LoxString::release()
+{
+  if ( text_ && --(text_->count) == 0 ) delete text_;
+  text_ = nullptr;
+  size_ = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Get value of an instance's property by its name.
  */
 LoxObject& LoxInstance::get(const Token& name)
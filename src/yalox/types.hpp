@@ -1,8 +1,11 @@
 #pragma once
 
 #include "aliases.hpp"
+#include "smallvector.hpp"
 
 #include <functional>
+#include <string>
+#include <string_view>
 
 namespace lox {
 
@@ -12,7 +15,58 @@ class FunctionStmt;
 
 /*---------------------------------------------------------------------------*/
 
-using LoxFunction = std::function<LoxObject(const std::vector<LoxObject>&)>;
+/** Lox strings are immutable, so a copy of one shares its characters with it
+ * rather than copying them. They are freed with the last copy, which makes
+ * reading a string variable or literal as cheap as reading a number.
+ *
+ * A string is the beginning of a buffer that may be longer: concatenating to
+ * the string that ends where its buffer does appends to the buffer in place,
+ * and the result shares it too. Building a string piece by piece then takes
+ * amortized constant time per piece, rather than copying what is built so far
+ * every time. The strings that are shorter than their buffer do not see what
+ * was appended to it.
+ */
+class LoxString
+{
+public:
+  LoxString(std::string chars = {});
+  LoxString(const char* chars);
+
+  LoxString(const LoxString&);
+  LoxString(LoxString&&) noexcept;
+
+  ~LoxString();
+
+  LoxString& operator=(const LoxString&);
+  LoxString& operator=(LoxString&&) noexcept;
+
+  std::string_view str() const;
+
+  friend bool operator==(const LoxString&, const LoxString&);
+  friend LoxString operator+(const LoxString&, const LoxString&);
+
+private:
+  // The characters and how many strings share them
+  struct Text
+  {
+    std::string chars;
+    unsigned count;
+  };
+
+  Text* text_{};  // none for the empty string
+  size_t size_{};
+
+  void release();
+};
+
+/*---------------------------------------------------------------------------*/
+
+// The arguments of a call. Most calls have few enough that they are passed
+// without allocating, and the function called may move them into its
+// parameters.
+using LoxArguments = small_vector<LoxObject, 8>;
+
+using LoxFunction = std::function<LoxObject(LoxArguments&)>;
 
 /*---------------------------------------------------------------------------*/
 
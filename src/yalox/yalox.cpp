@@ -5,6 +5,11 @@
 #include "scanner.hpp"
 #include "parser.hpp"
 #include "resolver.hpp"
+#include "constantfolder.hpp"
+#include "inliner.hpp"
+#include "typeinferrer.hpp"
+#include "deadcodeeliminator.hpp"
+#include "loophoister.hpp"
 // #include "astprinter.hpp"
 
 #include <iostream>
@@ -16,6 +21,12 @@ namespace lox {
 
 Interpreter YaLox::interpreter_ = Interpreter{};
 
+size_t YaLox::inlineBudget_ = Inliner::DEFAULT_BUDGET;
+
+bool YaLox::typeStats_ = false;
+
+bool YaLox::closedWorld_ = false;
+
 bool YaLox::hadError_ = false;
 
 bool YaLox::hadRuntimeError_ = false;
@@ -32,7 +43,7 @@ void YaLox::runScript(const std::string& filepath)
     // read all contents and run the script
     auto source = std::string{ std::istreambuf_iterator<char>(scriptFile),
                                std::istreambuf_iterator<char>() };
-    run(source);
+    run(source, true);
 
     // Indicate an error in the exit code
     if ( hadError_ ) {
@@ -51,10 +62,95 @@ void YaLox::runScript(const std::string& filepath)
 
 /*---------------------------------------------------------------------------*/
 
+/** Choose how the interpreter runs the code that follows.
+ */
+void YaLox::setExecutionMode(ExecutionMode mode)
+{
+  interpreter_.setMode(mode);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Set the largest function body, in syntax tree nodes, that is inlined at
+ * the places it is called. 0 turns inlining off.
+ */
+void YaLox::setInlineBudget(size_t budget)
+{
+  inlineBudget_ = budget;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Report how much of the arithmetic of the code that follows is specialized
+ * on the types of its operands.
+ */
+void YaLox::setTypeStats(bool enabled)
+{
+  typeStats_ = enabled;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Treat a script as the whole program, so that what it does not use of its
+ * own top-level declarations can be removed. The REPL is never closed.
+ */
+void YaLox::setClosedWorld(bool enabled)
+{
+  closedWorld_ = enabled;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Show what is printed at the end of every line instead of in large chunks,
+ * for a script whose output is watched as it runs. The REPL always is.
+ */
+void YaLox::setLineBuffered(bool enabled)
+{
+  interpreter_.setLineBuffered(enabled);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Optimize resolved statements, running the passes in order up to the last
+ * one given. Tell whether they can run, which they cannot if folding found an
+ * operation on constants that can only fail.
+ */
+bool YaLox::optimize(
+  Interpreter& interpreter,
+  std::vector<StmtPtr>& statements,
+  bool closedWorld,
+  Pass last)
+{
+  ConstantFolder folder{ interpreter };
+  folder.fold(statements);
+  if ( folder.failed() ) return false;
+  if ( last == Pass::FOLD ) return true;
+
+  Inliner(interpreter, inlineBudget_).inlineCalls(statements);
+  if ( last == Pass::INLINE ) return true;
+
+  TypeInferrer typeInferrer{ interpreter };
+  typeInferrer.infer(statements);
+  if ( typeStats_ ) {
+    std::cerr << "[types] " << typeInferrer.summary() << '\n';
+  }
+  if ( last == Pass::INFER ) return true;
+
+  DeadCodeEliminator(interpreter, closedWorld).eliminate(statements);
+  if ( last == Pass::ELIMINATE ) return true;
+
+  LoopHoister(interpreter).hoist(statements);
+  return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
 /** Show a prompt and let user interact with Lox.
  */
 void YaLox::runPrompt()
 {
+  setLineBuffered(true);
+
   std::cout << YALOX_NAME << " " << YALOX_VERSION << " (" << GIT_TAG << "-"
             << GIT_COMMIT_SHA << ", " << BUILD_TIMESTAMP << ") ["
             << COMPILER_INFO << "]\n"
@@ -79,9 +175,9 @@ void YaLox::runPrompt()
 
 /*---------------------------------------------------------------------------*/
 
-/** Actually execute the source.
+/** Actually execute the source, which is a whole program if it is a script.
  */
-void YaLox::run(const std::string& source)
+void YaLox::run(const std::string& source, bool wholeProgram)
 {
   Scanner scanner{ source };
   auto tokens = scanner.scanTokens();
@@ -98,6 +194,11 @@ void YaLox::run(const std::string& source)
   // Stop if there was a resolution error
   if ( hadError_ ) return;
 
+  // Stop if an operation on constants can only fail
+  if ( !optimize(interpreter_, statements, wholeProgram && closedWorld_) ) {
+    return;
+  }
+
   // std::cout << AstPrinter().print(*expression) << std::endl;
   // auto value = interpreter_.interpret(*expression);
   // std::cout << toString(value) << '\n';
@@ -19,6 +19,18 @@ inline const int ERR_SOFTWARE = 70;  // internal software error
 
 /*---------------------------------------------------------------------------*/
 
+// The passes that optimize a program before it runs, in the order they run
+enum class Pass
+{
+  FOLD,
+  INLINE,
+  INFER,
+  ELIMINATE,
+  HOIST
+};
+
+/*---------------------------------------------------------------------------*/
+
 /** The tree-walk interpreter YaLox.
  */
 class YaLox
@@ -27,6 +39,22 @@ public:
   static void runScript(const std::string& path);
   static void runPrompt();
 
+  static void setExecutionMode(ExecutionMode mode);
+
+  static void setInlineBudget(size_t budget);
+
+  static void setTypeStats(bool enabled);
+
+  static void setClosedWorld(bool enabled);
+
+  static void setLineBuffered(bool enabled);
+
+  static bool optimize(
+    Interpreter&,
+    std::vector<StmtPtr>& statements,
+    bool closedWorld,
+    Pass last = Pass::HOIST);
+
   static void error(int line, const std::string& message);
 
   static void
@@ -39,10 +67,16 @@ public:
 private:
   static Interpreter interpreter_;
 
+  static size_t inlineBudget_;
+
+  static bool typeStats_;
+
+  static bool closedWorld_;
+
   static bool hadError_;
   static bool hadRuntimeError_;
 
-  static void run(const std::string& source);
+  static void run(const std::string& source, bool wholeProgram = false);
 };
 
 }
@@ -7,6 +7,10 @@
 #include "interpreter.hpp"
 #include "scanner.hpp"
 #include "parser.hpp"
+#include "resolver.hpp"
+
+#include <iostream>
+#include <sstream>
 
 using namespace lox;
 
@@ -310,3 +314,280 @@ TEST_CASE("interpreter - evaluate unary expression")
 /*---------------------------------------------------------------------------*/
 
 TEST_CASE("interpreter - evaluate compound expression") {}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("interpreter - evaluate expression compiled to closures")
+{
+  auto eval = [](const std::string& source) {
+    auto expr = Parser(Scanner(source).scanTokens()).parse();
+    return toString(Interpreter(ExecutionMode::CLOSURES).interpret(*expr));
+  };
+
+  CHECK(eval("12 - 34") == "-22");
+  CHECK(eval("1 + 2 * 3 / (4 - 1)") == "3");
+  CHECK(eval("\"yet \" + \"another\"") == "\"yet another\"");
+  CHECK(eval("1 <= 2 == !(2 < 1)") == "true");
+  CHECK(eval("nil != false") == "true");
+  CHECK(eval("-(3)") == "-3");
+  CHECK(eval("nil or \"default\"") == "\"default\"");
+  CHECK(eval("false and 1") == "false");
+
+  // runtime errors
+  CHECK(eval("12 - \"34\"") == "nil");
+  CHECK(eval("\"12\" + 34") == "nil");
+  CHECK(eval("-\"34\"") == "nil");
+  CHECK(eval("clock(1)") == "nil");
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Resolve and run a program, returning what it printed.
+ */
+std::string runProgram(const std::string& source, ExecutionMode mode)
+{
+  std::ostringstream out;
+  auto coutBuf = std::cout.rdbuf(out.rdbuf());
+
+  Interpreter interpreter{ mode };
+  auto statements = Parser(Scanner(source).scanTokens()).parse2();
+  Resolver(interpreter).resolve(statements);
+  interpreter.interpret(std::move(statements));
+
+  std::cout.rdbuf(coutBuf);
+  return out.str();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Check what a program prints in both modes.
+ */
+void checkBothModes(const std::string& source, const std::string& expected)
+{
+  CHECK(runProgram(source, ExecutionMode::TREE_WALK) == expected);
+  CHECK(runProgram(source, ExecutionMode::CLOSURES) == expected);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("interpreter - closures mode runs programs like the tree-walk mode")
+{
+  SUBCASE("scopes")
+  {
+    checkBothModes(
+      "var a = \"global\"; { var a = \"outer\"; { var b = a; print b; } }"
+      "{ fun show() { print a; } show(); var a = \"block\"; show(); }",
+      "\"outer\"\n\"global\"\n\"global\"\n");
+  }
+
+  SUBCASE("loops")
+  {
+    checkBothModes(
+      "var sum = 0; for (var i = 0; i < 5; i = i + 1) sum = sum + i;"
+      "var n = 0; while (n < 3) { n = n + 1; } print sum; print n;"
+      "for (var j = n; j > 0; j = j - 1)"
+      "  if (j == 2) print \"two\"; else print j;",
+      "10\n3\n3\n\"two\"\n1\n");
+  }
+
+  SUBCASE("functions and closures")
+  {
+    checkBothModes(
+      "fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }"
+      "print fib(15);"
+      "fun makeCounter() { var i = 0; fun count() { i = i + 1; return i; }"
+      "  return count; }"
+      "var c1 = makeCounter(); var c2 = makeCounter();"
+      "c1(); print c1(); print c2(); print makeCounter; fun noop() {}"
+      "print noop();",
+      "610\n2\n1\n<fn makeCounter>\nnil\n");
+  }
+
+  SUBCASE("classes")
+  {
+    checkBothModes(
+      "class Point { init(x, y) { this.x = x; this.y = y; }"
+      "  sum() { return this.x + this.y; }"
+      "  moved(dx) { this.x = this.x + dx; return this; } }"
+      "var p = Point(1, 2); print p.sum(); print p.moved(10).sum();"
+      "p.y = \"y\"; print p.y; print p; var m = p.sum; p.x = 5; print m;"
+      "print p.init(0, 0).x;",
+      "3\n13\n\"y\"\n<Point instance>\n<fn sum>\n0\n");
+  }
+
+  SUBCASE("numbers")
+  {
+    checkBothModes(
+      "print 100; print 2.5; print 0.1 + 0.2; print 1234567; print 123456;"
+      "print -0; print 1 / 3; print 0.00001; print 1 / 0; print -1 / 0;",
+      "100\n2.5\n0.3\n1.23457e+06\n123456\n-0\n0.333333\n1e-05\ninf\n-inf\n");
+  }
+
+  SUBCASE("strings")
+  {
+    checkBothModes(
+      "var a = \"abc\"; var b = a; var c = \"ab\" + \"c\"; var e = \"\";"
+      "print a == b; print a == c; print e + a + e == c; print e == \"\";"
+      "a = a + \"d\"; print a; print b; print a == b; print e + \"\";",
+      "true\ntrue\ntrue\ntrue\n\"abcd\"\n\"abc\"\nfalse\n\"\"\n");
+  }
+
+  SUBCASE("strings built piece by piece")
+  {
+    checkBothModes(
+      "var s = \"ab\"; var t = s + \"c\"; var u = s + \"d\"; var v = t + t;"
+      "print s; print t; print u; print v; print s + s == \"abab\";"
+      "var w = \"\"; for (var i = 0; i < 100; i = i + 1) w = w + \"xy\";"
+      "var x = w; w = w + \"z\"; print x == w; print w == x + \"z\";",
+      "\"ab\"\n\"abc\"\n\"abd\"\n\"abcabc\"\ntrue\nfalse\ntrue\n");
+  }
+
+  SUBCASE("runtime error stops the program")
+  {
+    checkBothModes(
+      "print \"before\"; { fun f() { return -nil; } print f(); }"
+      "print \"after\";",
+      "\"before\"\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("interpreter - tail calls run in constant stack space")
+{
+  SUBCASE("self recursion")
+  {
+    checkBothModes(
+      "fun sum(n, acc) { if (n == 0) return acc; return sum(n - 1, acc + n); }"
+      "print sum(20000, 0) == 200010000;",
+      "true\n");
+  }
+
+  SUBCASE("mutual recursion")
+  {
+    checkBothModes(
+      "fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }"
+      "fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }"
+      "print isEven(20000); print isOdd(20001);",
+      "true\ntrue\n");
+  }
+
+  SUBCASE("methods and closures")
+  {
+    checkBothModes(
+      "class Loop { run(n) { if (n == 0) return \"done\";"
+      "  return this.run(n - 1); } }"
+      "print Loop().run(20000);"
+      "fun counter() { var n = 0; fun next(last) { n = n + 1;"
+      "  if (n == last) return n; return next(last); } return next; }"
+      "print counter()(20000);",
+      "\"done\"\n20000\n");
+  }
+
+  SUBCASE("a tail call that fails reports its own line")
+  {
+    checkBothModes(
+      "fun f(n) { if (n == 0) return g(); return f(n - 1); }\n"
+      "fun g() {\n return nil(); }\n print \"before\"; print f(10);",
+      "\"before\"\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("interpreter - arguments are passed to every parameter")
+{
+  SUBCASE("as many as fit in place")
+  {
+    checkBothModes(
+      "fun f(a, b, c, d, e, k, g, h) { return a + b + c + d + e + k + g + h; }"
+      "print f(\"a\", \"b\", \"c\", \"d\", \"e\", \"f\", \"g\", \"h\");",
+      "\"abcdefgh\"\n");
+  }
+
+  SUBCASE("more than fit in place")
+  {
+    checkBothModes(
+      "fun f(a, b, c, d, e, k, g, h, i, j) {"
+      "  if (a == 0) return b + c + d + e + k + g + h + i + j;"
+      "  return f(a - 1, b, c, d, e, k, g, h, i, j + 1); }"
+      "print f(0, 1, 2, 3, 4, 5, 6, 7, 8, 9); print f(100, 1, 1, 1, 1, 1, 1, 1,"
+      "  1, 1);",
+      "45\n109\n");
+  }
+
+  SUBCASE("to methods and initializers")
+  {
+    checkBothModes(
+      "class P { init(a, b, c, d, e, k, g, h, i) { this.s = a + i; }"
+      "  add(x) { return this.s + x; } }"
+      "var p = P(1, 2, 3, 4, 5, 6, 7, 8, 9); print p.add(0);"
+      "print P(\"a\", 2, 3, 4, 5, 6, 7, 8, \"b\").s;",
+      "10\n\"ab\"\n");
+  }
+
+  SUBCASE("or fail when their number does not match")
+  {
+    checkBothModes(
+      "fun f(a, b) { return a; } print \"before\"; print f(1, 2, 3);",
+      "\"before\"\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("interpreter - print writes to the output it is given")
+{
+  // Captures what is printed without going through a stream
+  struct Captured : public OutputSink
+  {
+    std::string text;
+    size_t flushes{};
+
+    void write(std::string_view chars) override { text.append(chars); }
+    void flush() override { ++flushes; }
+  };
+
+  SUBCASE("an output of the embedder")
+  {
+    for ( auto mode : { ExecutionMode::TREE_WALK, ExecutionMode::CLOSURES } ) {
+      Captured out;
+      Interpreter interpreter{ mode };
+      interpreter.setOutput(out);
+
+      auto statements =
+        Parser(Scanner("print 1; print \"two\";").scanTokens()).parse2();
+      Resolver(interpreter).resolve(statements);
+      interpreter.interpret(std::move(statements));
+
+      CHECK(out.text == "1\n\"two\"\n");
+      CHECK(out.flushes == 1);
+    }
+  }
+
+  SUBCASE("a stream, through a buffer")
+  {
+    std::ostringstream os;
+    BufferedOutput out{ os };
+    out.write("kept");
+    CHECK(os.str().empty());
+    out.flush();
+    CHECK(os.str() == "kept");
+
+    const std::string large(BufferedOutput::CAPACITY, 'x');
+    out.write("a");
+    out.write(large);
+    CHECK(os.str() == "kepta" + large);
+  }
+
+  SUBCASE("a stream, line by line")
+  {
+    std::ostringstream os;
+    BufferedOutput out{ os };
+    out.setLineBuffered(true);
+    out.write("one");
+    CHECK(os.str().empty());
+    out.write("\n");
+    CHECK(os.str() == "one\n");
+  }
+}
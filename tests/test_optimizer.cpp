@@ -0,0 +1,527 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#undef FALSE
+#undef TRUE
+
+#include "yalox.hpp"
+#include "interpreter.hpp"
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "astprinter.hpp"
+#include "constantfolder.hpp"
+#include "inliner.hpp"
+#include "typeinferrer.hpp"
+#include "deadcodeeliminator.hpp"
+#include "loophoister.hpp"
+
+#include <format>
+#include <iostream>
+#include <sstream>
+
+using namespace lox;
+
+namespace {
+
+/*---------------------------------------------------------------------------*/
+
+/** Fold an expression and print what is left of it.
+ */
+std::string fold(const std::string& source)
+{
+  Interpreter interpreter;
+  auto expr = Parser(Scanner(source).scanTokens()).parse();
+  ConstantFolder(interpreter).fold(expr);
+  return AstPrinter().print(*expr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Inline the calls of a program and print the expression of its last
+ * statement, which must be a print statement or a block ending with one.
+ */
+std::string inlined(
+  const std::string& source,
+  size_t budget = Inliner::DEFAULT_BUDGET)
+{
+  Interpreter interpreter;
+  auto statements = Parser(Scanner(source).scanTokens()).parse2();
+  Resolver(interpreter).resolve(statements);
+  Inliner(interpreter, budget).inlineCalls(statements);
+
+  auto last = statements.back().get();
+  while ( auto block = dynamic_cast<BlockStmt*>(last) ) {
+    last = block->statements.back().get();
+  }
+  return AstPrinter().print(*(dynamic_cast<PrintStmt&>(*last).expression));
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Parse and resolve a program, then optimize it like YaLox::run does up to
+ * the pass given, so that the pass after it is tested on what it gets in a
+ * real run.
+ */
+std::vector<StmtPtr>
+optimized(Interpreter& interpreter, const std::string& source, Pass last)
+{
+  auto statements = Parser(Scanner(source).scanTokens()).parse2();
+  Resolver(interpreter).resolve(statements);
+  YaLox::optimize(interpreter, statements, false, last);
+  return statements;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Infer the types of a program and tell how much of it is specialized.
+ */
+std::string specialized(const std::string& source)
+{
+  Interpreter interpreter;
+  auto statements = optimized(interpreter, source, Pass::INLINE);
+
+  TypeInferrer typeInferrer{ interpreter };
+  typeInferrer.infer(statements);
+  return typeInferrer.summary();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Optimize a program and count the statements removed from it.
+ */
+size_t eliminated(const std::string& source, bool closedWorld = false)
+{
+  Interpreter interpreter;
+  auto statements = optimized(interpreter, source, Pass::INFER);
+
+  DeadCodeEliminator eliminator{ interpreter, closedWorld };
+  eliminator.eliminate(statements);
+  return eliminator.removed();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Optimize a program and count the operations moved out of its loops.
+ */
+size_t hoisted(const std::string& source)
+{
+  Interpreter interpreter;
+  auto statements = optimized(interpreter, source, Pass::ELIMINATE);
+
+  LoopHoister loopHoister{ interpreter };
+  loopHoister.hoist(statements);
+  return loopHoister.hoisted();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Run a program, optimized or not, returning what it printed.
+ */
+std::string run(
+  const std::string& source,
+  bool optimize,
+  ExecutionMode mode = ExecutionMode::TREE_WALK)
+{
+  std::ostringstream out;
+  auto coutBuf = std::cout.rdbuf(out.rdbuf());
+
+  Interpreter interpreter{ mode };
+  auto statements = Parser(Scanner(source).scanTokens()).parse2();
+  Resolver(interpreter).resolve(statements);
+  if ( !optimize || YaLox::optimize(interpreter, statements, true) ) {
+    interpreter.interpret(std::move(statements));
+  }
+
+  std::cout.rdbuf(coutBuf);
+  return out.str();
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Check what a program prints, not optimized and optimized in both modes.
+ */
+void checkSamePrinted(const std::string& source, const std::string& expected)
+{
+  CHECK(run(source, false) == expected);
+  CHECK(run(source, true) == expected);
+  CHECK(run(source, true, ExecutionMode::CLOSURES) == expected);
+}
+
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - fold constant expressions")
+{
+  CHECK(fold("60 * 60 * 24") == "86400");
+  CHECK(fold("(1 + 2) * 3 - 4 / 8") == "8.5");
+  CHECK(fold("\"Lox\" + \" \" + \"rocks\"") == "\"Lox rocks\"");
+  CHECK(fold("1 < 2 == !(2 <= 1)") == "true");
+  CHECK(fold("\"a\" != \"a\"") == "false");
+  CHECK(fold("-(-3)") == "3");
+  CHECK(fold("!nil") == "true");
+
+  // only the constant part of an expression
+  CHECK(fold("x * (60 * 60)") == "(* (var x) 3600)");
+  CHECK(fold("(x)") == "(var x)");
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - simplify logical and unary expressions")
+{
+  CHECK(fold("nil or x") == "(var x)");
+  CHECK(fold("1 or x") == "1");
+  CHECK(fold("false and x") == "false");
+  CHECK(fold("\"\" and x") == "(var x)");
+  CHECK(fold("x or 1") == "(or (var x) 1)");
+
+  CHECK(fold("!!(x < y)") == "(< (var x) (var y))");
+  CHECK(fold("!!!x") == "(! (var x))");
+  CHECK(fold("!!x") == "(! (! (var x)))");
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - operations on constants that always fail are errors")
+{
+  std::ostringstream err;
+  auto cerrBuf = std::cerr.rdbuf(err.rdbuf());
+
+  CHECK(fold("1 - \"one\"") == "(- 1 \"one\")");
+  CHECK(fold("-nil") == "(- nil)");
+  CHECK(fold("true + 1") == "(+ true 1)");
+
+  std::cerr.rdbuf(cerrBuf);
+  CHECK(
+    err.str() ==
+    "[line 1] Error at '-': Operands must be numbers.\n"
+    "[line 1] Error at '-': Operand must be a number.\n"
+    "[line 1] Error at '+': Operands must be two numbers or two strings.\n");
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - folded programs print the same")
+{
+  SUBCASE("constant conditions")
+  {
+    checkSamePrinted(
+      "var n = 0; if (1 > 2) print \"no\"; else print \"yes\";"
+      "if (nil) print \"never\"; while (false) print \"never\";"
+      "for (var i = 10; 1 < 0; i = i + 1) print i; print i;"
+      "fun loop() { for (var j = 0; true; j = j + 1) if (j == 2) return j; }"
+      "print loop();",
+      "\"yes\"\n10\n2\n");
+  }
+
+  SUBCASE("dead branches keep their variables out of reach")
+  {
+    checkSamePrinted(
+      "var x = \"global\"; fun f() { var x = \"local\";"
+      "  if (false) { print x; } else { print x; } }"
+      "f(); print x; { var y = 1; print false and y; print y or false; }",
+      "\"local\"\n\"global\"\nfalse\n1\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - inline calls to small functions")
+{
+  const std::string square = "fun square(x) { return x * x; }";
+
+  CHECK(inlined(square + "print square(3);") == "(inline (var square) 3)");
+  CHECK(
+    inlined(square + "print square(square(2));") ==
+    "(inline (var square) (inline (var square) 2))");
+
+  // not with a budget too small, nor with the wrong number of arguments
+  CHECK(inlined(square + "print square(3);", 2) == "(call (var square) 3)");
+  CHECK(inlined(square + "print square(3);", 0) == "(call (var square) 3)");
+  CHECK(inlined(square + "print square(1, 2);") == "(call (var square) 1 2)");
+
+  // not a local variable
+  CHECK(
+    inlined(square + "{ var square = clock; print square(); }") ==
+    "(call (var square))");
+
+  // not recursive functions, closures, or returns from loops
+  CHECK(
+    inlined("fun f(n) { if (n > 0) return f(n - 1); return n; } print f(3);") ==
+    "(call (var f) 3)");
+  CHECK(
+    inlined("fun f() { fun g() {} return g; } print f();") ==
+    "(call (var f))");
+  CHECK(
+    inlined("fun f() { while (true) return 1; } print f();") ==
+    "(call (var f))");
+
+  // not a name declared twice
+  CHECK(
+    inlined("fun f() { return 1; } var f = 2; print f();") ==
+    "(call (var f))");
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - inlined programs print the same")
+{
+  SUBCASE("early returns")
+  {
+    checkSamePrinted(
+      "fun sign(x) { if (x < 0) return -1; if (x == 0) { return 0; }"
+      "  print \"positive\"; return 1; print \"never\"; }"
+      "print sign(-5); print sign(0); print sign(7);"
+      "fun nothing(x) { if (x) return; print x; }"
+      "print nothing(true); print nothing(false);",
+      "-1\n0\n\"positive\"\n1\nnil\nfalse\nnil\n");
+  }
+
+  SUBCASE("parameters and locals do not clash with the caller's")
+  {
+    checkSamePrinted(
+      "var a = \"global\"; fun get() { return a; }"
+      "fun add(a, b) { var sum = a + b; return sum; }"
+      "fun caller() { var a = \"local\"; var sum = 1;"
+      "  print get(); print add(sum, 2); print a; print sum; }"
+      "caller(); { var b = 10; print add(b, add(b, 1)); }",
+      "\"global\"\n3\n\"local\"\n1\n21\n");
+  }
+
+  SUBCASE("nested calls of inlined functions")
+  {
+    checkSamePrinted(
+      "fun twice(x) { return x + x; } fun quad(x) { return twice(twice(x)); }"
+      "fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }"
+      "fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }"
+      "print quad(3); print isEven(10); print isOdd(7);",
+      "12\ntrue\ntrue\n");
+  }
+
+  SUBCASE("tail calls through small functions stay tail calls")
+  {
+    checkSamePrinted(
+      "fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }"
+      "fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }"
+      "fun check(n) { return isEven(n); } print check(20000);",
+      "true\n");
+  }
+
+  SUBCASE("calls of a function that changed are not inlined")
+  {
+    checkSamePrinted(
+      "fun early() { return late(); } print clock() > 0;"
+      "fun late() { return \"late\"; } print early();"
+      "fun f() { return 1; } fun g() { return 2; }"
+      "var saved = f; f = g; print f(); f = saved; print f();",
+      "true\n\"late\"\n2\n1\n");
+  }
+
+  SUBCASE("runtime errors")
+  {
+    checkSamePrinted(
+      "fun half(x) { return x / 2; } print half(4); print half(\"4\");",
+      "2\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - infer the types of local variables")
+{
+  auto check = [](const std::string& source, size_t known, size_t total) {
+    CHECK(
+      specialized(source) ==
+      std::format(
+        "{} of {} arithmetic operations specialized ({}%)",
+        known,
+        total,
+        known * 100 / total));
+  };
+
+  // through loops, but not parameters or globals
+  check(
+    "fun f(n) { var sum = 0; var i = 0;"
+    "  while (i < n) { sum = sum + i; i = i + 1; } return sum; }",
+    2,
+    3);
+  check("var g = 1; print g + 1; { var l = 1; print -l; }", 1, 2);
+  check("{ var s = \"a\"; s = s + \"b\"; print s + s; }", 2, 2);
+
+  // where paths meet
+  check("{ var x = 1; if (c) x = \"s\"; print x - 1; }", 0, 1);
+  check("{ var x = 1; if (c) x = 2; else x = 3; print x - 1; }", 1, 1);
+  check("{ var x = 1; while (c) { print x - 1; x = \"s\"; } }", 0, 1);
+  check("{ var x = 1; var y = x or 2; print y * 2; }", 1, 1);
+
+  // captured by a function
+  check(
+    "fun f() { var x = 1; fun g() { x = \"s\"; } g(); return x + 1; }",
+    0,
+    1);
+  check("fun f() { var x = 1; fun g() { return x * 2; } return g(); }", 1, 1);
+
+  // arguments of inlined calls
+  check("fun sq(x) { return x * x; } { var a = 3; print sq(a); }", 1, 2);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - specialized programs print the same")
+{
+  SUBCASE("numbers and strings")
+  {
+    checkSamePrinted(
+      "fun f(n) { var sum = 0; for (var i = 0; i < n; i = i + 1) {"
+      "  sum = sum + i * 2 - -1; } var s = \"s\"; s = s + \"!\";"
+      "  print s + s; return sum / 2; } print f(10);",
+      "\"s!s!\"\n50\n");
+  }
+
+  SUBCASE("a variable that changes type in a loop")
+  {
+    checkSamePrinted(
+      "{ var x = 0; var i = 0;"
+      "  while (i < 3) { print x + 1; if (i == 1) x = \"s\"; i = i + 1; } }",
+      "1\n1\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - hoist invariant operations out of loops")
+{
+  // from conditions, even if they could fail, when nothing comes before them
+  CHECK(hoisted("var n = 10; for (var i = 0; i < n * 2; i = i + 1) {}") == 1);
+  CHECK(hoisted("var i = 0; while (i < n * 2) i = i + 1;") == 1);
+  CHECK(hoisted("var i = 0; while (i + 1 < n * 2) i = i + 1;") == 0);
+
+  // from bodies, only if they cannot fail
+  CHECK(
+    hoisted(
+      "fun f(n) { var k = 3; var sum = 0;"
+      "  for (var i = 0; i < n; i = i + 1) { sum = sum + k * 2 + n * 2; }"
+      "  return sum; }") == 1);
+  CHECK(
+    hoisted("{ var i = 0; while (i < 9) { print -(i + 1); i = 1; } }") == 0);
+
+  // not what the loop changes
+  CHECK(
+    hoisted(
+      "{ var k = 1; var i = 0;"
+      "  while (i < 10) { print k * 2; k = k + 1; i = i + 1; } }") == 0);
+  CHECK(
+    hoisted(
+      "{ var k = 1; var i = 0;"
+      "  while (i < 10) { var k = 2; print k * 2; i = i + 1; } }") == 0);
+
+  // not globals, or locals that a function assigns, in loops making calls
+  CHECK(
+    hoisted("var n = 10; var i = 0; while (i < n * 2) { clock(); i = i + 1; }")
+    == 0);
+  CHECK(
+    hoisted(
+      "{ var n = 10; var i = 0;"
+      "  while (i < n * 2) { clock(); i = i + 1; } }") == 1);
+  CHECK(
+    hoisted(
+      "{ var n = 10; var i = 0; fun f() { n = 1; }"
+      "  while (i < n * 2) { clock(); i = i + 1; } f(); }") == 0);
+
+  // not calls or properties
+  CHECK(
+    hoisted(
+      "class C {} var c = C(); c.x = 1; var i = 0;"
+      "while (i < c.x * 2) i = i + 1;") == 0);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - hoisted programs print the same")
+{
+  SUBCASE("nested loops")
+  {
+    checkSamePrinted(
+      "fun f() { var total = 0; var k = 2;"
+      "  for (var i = 0; i < 3; i = i + 1) {"
+      "    for (var j = 0; j < k * 2; j = j + 1) { total = total + i * k + 1; }"
+      "  } return total; } print f();",
+      "36\n");
+  }
+
+  SUBCASE("the variable of a for loop outlives it")
+  {
+    checkSamePrinted(
+      "var n = 3; for (var i = 0; i < n + 1; i = i + 1) {} print i;", "4\n");
+  }
+
+  SUBCASE("a variable that a call assigns")
+  {
+    checkSamePrinted(
+      "fun f() { var k = 1; fun bump() { k = k + 1; } var sum = 0;"
+      "  for (var i = 0; i < 3; i = i + 1) { sum = sum + k * 2; bump(); }"
+      "  return sum; } print f();",
+      "12\n");
+  }
+
+  SUBCASE("an operation that would fail in a body that never runs")
+  {
+    checkSamePrinted(
+      "var s = \"s\"; var i = 0; while (i < 0) { print s * 2; } print i;",
+      "0\n");
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - remove dead code and unused declarations")
+{
+  // after returns
+  CHECK(eliminated("fun f() { return 1; print 2; print 3; }") == 2);
+  CHECK(
+    eliminated("fun f(x) { if (x) { return 1; } else return 2; print x; }") ==
+    1);
+  CHECK(eliminated("fun f(x) { if (x) return 1; print x; }") == 0);
+
+  // unused locals that can go without a trace
+  CHECK(eliminated("{ var a; var b = 1; var c = -b; var d = b + c; }") == 4);
+  CHECK(eliminated("{ var a = clock(); var b = c * 2; var d = \"d\"; }") == 1);
+  CHECK(eliminated("{ var a = 1; print a; a = 2; }") == 0);
+  CHECK(eliminated("{ var a = 1; { var a = 2; print a; } }") == 1);
+  CHECK(
+    eliminated("{ fun f(n) { return f(n - 1); } class C { m() { C(); } } }") ==
+    2);
+  CHECK(eliminated("fun f() { var a = 1; fun g() { print a; } }") == 2);
+
+  // unused top-level functions and classes in a closed world
+  const std::string program =
+    "fun f() { return g(); } fun g() { return 1; } fun h() { return h(); }"
+    "class C {} var v = 1; print f();";
+  CHECK(eliminated(program) == 0);
+  CHECK(eliminated(program, true) == 2);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("optimizer - programs without their dead code print the same")
+{
+  SUBCASE("unused declarations")
+  {
+    checkSamePrinted(
+      "fun unused() { print \"never\"; } var g = 1;"
+      "fun f(x) { var a = x; var b = 2; var c = b * 2; fun h() { return a; }"
+      "  if (x > 1) { return c; print \"never\"; } return b; }"
+      "print f(1); print f(2); print g;",
+      "2\n4\n1\n");
+  }
+
+  SUBCASE("initializers that fail or have effects")
+  {
+    checkSamePrinted(
+      "fun f() { print \"called\"; return 1; }"
+      "{ var a = f(); var b = \"s\"; var c = -b; print \"never\"; }",
+      "\"called\"\n");
+  }
+}
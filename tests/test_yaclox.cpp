@@ -0,0 +1,673 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "compiler.h"
+#include "image.h"
+#include "jit.h"
+#include "object.h"
+#include "profiler.h"
+#include "table.h"
+#include "verifier.h"
+#include "vm.h"
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Run a script in a fresh VM and keep the VM alive for inspection
+struct Script
+{
+  InterpretResult result;
+
+  explicit Script(const char* source, Backend backend = BACKEND_STACK)
+  {
+    initVM();
+    vm.backend = backend;
+    result = interpret(source);
+  }
+
+  // Run a bytecode image instead of source
+  struct FromImage
+  {
+  };
+
+  Script(const char* path, FromImage)
+  {
+    initVM();
+    ObjFunction* function = loadImage(path);
+    result = function == nullptr ? INTERPRET_COMPILE_ERROR
+                                 : interpretFunction(function);
+  }
+
+  ~Script() { freeVM(); }
+
+  Value global(const char* name) const
+  {
+    Value value = NIL_VAL;
+    ObjString* key = copyString(name, (int)std::char_traits<char>::length(name));
+    tableGet(&vm.globals, key, &value);
+    return value;
+  }
+
+  double number(const char* name) const
+  {
+    Value value = global(name);
+    REQUIRE(IS_NUMBER(value));
+    return AS_NUMBER(value);
+  }
+
+  std::string string(const char* name) const
+  {
+    Value value = global(name);
+    REQUIRE(IS_STRING(value));
+    return AS_CSTRING(value);
+  }
+};
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox compiler - expressions")
+{
+  Script script("var a = -(1.5 + 2.5) * 3 / 2;"
+                "var b = !(1 < 2) == false;"
+                "var c = \"con\" + \"cat\";");
+  CHECK(script.result == INTERPRET_OK);
+  CHECK(script.number("a") == -6);
+  CHECK(IS_BOOL(script.global("b")));
+  CHECK(AS_BOOL(script.global("b")) == true);
+  CHECK(script.string("c") == "concat");
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox compiler - locals and scopes")
+{
+  Script script("var r; { var a = 1; { var a = 2; r = a; } r = r + a; }");
+  CHECK(script.result == INTERPRET_OK);
+  CHECK(script.number("r") == 3);
+
+  Script shadow("var r; { var a = 1; { var b = a + 1; a = b * 10; } r = a; }");
+  CHECK(shadow.result == INTERPRET_OK);
+  CHECK(shadow.number("r") == 20);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox compiler - control flow")
+{
+  Script script("var sum = 0;"
+                "for (var i = 0; i < 10; i = i + 1) {"
+                "  if (i == 5) sum = sum + 100; else sum = sum + i;"
+                "}"
+                "var n = 0; while (n < 7) n = n + 1;"
+                "var x = nil or \"or\";"
+                "var y = false and 1;");
+  CHECK(script.result == INTERPRET_OK);
+  CHECK(script.number("sum") == 140);
+  CHECK(script.number("n") == 7);
+  CHECK(script.string("x") == "or");
+  CHECK(IS_BOOL(script.global("y")));
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox compiler - functions")
+{
+  Script script("fun fib(n) { if (n < 2) return n;"
+                "  return fib(n - 2) + fib(n - 1); }"
+                "var f = fib(15);"
+                "fun noReturn() {} var r = noReturn();");
+  CHECK(script.result == INTERPRET_OK);
+  CHECK(script.number("f") == 610);
+  CHECK(IS_NIL(script.global("r")));
+  CHECK(IS_CLOSURE(script.global("fib")));
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox closures - upvalues")
+{
+  const char* source =
+    // Each call gets its own variable, closed when makeCounter returns
+    "fun makeCounter() { var n = 0; fun inc() { n = n + 1; return n; }"
+    "  return inc; }"
+    "var c1 = makeCounter(); var c2 = makeCounter();"
+    "c1(); c1(); var a = c1(); var b = c2();"
+    // Two closures share a variable that is still open
+    "var get; var set;"
+    "fun pair() { var x = \"one\"; fun g() { return x; }"
+    "  fun s(v) { x = v; } get = g; set = s; set(\"two\"); return x; }"
+    "var inside = pair(); set(\"three\"); var outside = get();"
+    // A block variable is closed on block exit, one per iteration
+    "var fs = nil; var sum = 0;"
+    "for (var i = 1; i <= 3; i = i + 1) { var j = i;"
+    "  fun f() { return j; } if (i == 2) fs = f; }"
+    "{ var y = 10; fun h() { fun k() { return y * 2; } return k; }"
+    "  sum = h()() + fs(); }";
+
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    Script script(source, backend);
+    CHECK(script.result == INTERPRET_OK);
+    CHECK(script.number("a") == 3);
+    CHECK(script.number("b") == 1);
+    CHECK(script.string("inside") == "two");
+    CHECK(script.string("outside") == "three");
+    CHECK(script.number("sum") == 22);
+    CHECK(vm.openUpvalues == nullptr);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox compiler - errors")
+{
+  CHECK(Script("print 1 +;").result == INTERPRET_COMPILE_ERROR);
+  CHECK(Script("1 = 2;").result == INTERPRET_COMPILE_ERROR);
+  CHECK(Script("return 1;").result == INTERPRET_COMPILE_ERROR);
+  CHECK(Script("{ var a = a; }").result == INTERPRET_COMPILE_ERROR);
+  CHECK(Script("{ var a; var a; }").result == INTERPRET_COMPILE_ERROR);
+  CHECK(Script("fun f(a) {} f();").result == INTERPRET_RUNTIME_ERROR);
+  CHECK(Script("-\"a\";").result == INTERPRET_RUNTIME_ERROR);
+  CHECK(Script("print undefined;").result == INTERPRET_RUNTIME_ERROR);
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Compile a script without running it and keep its bytecode
+struct Compiled
+{
+  std::vector<uint8_t> code;
+  std::vector<Value> constants;
+
+  explicit Compiled(const char* source)
+  {
+    initVM();
+    ObjFunction* function = compile(source);
+    REQUIRE(function != nullptr);
+    Chunk* chunk = &function->chunk;
+    code.assign(chunk->code, chunk->code + chunk->size);
+    constants.assign(
+      chunk->constants.values, chunk->constants.values + chunk->constants.size);
+  }
+
+  ~Compiled() { freeVM(); }
+
+  // Counts only scripts without closures, whose length needs the constants
+  int count(OpCode op) const
+  {
+    int n = 0;
+    for ( size_t i = 0; i < code.size(); i += (size_t)opcodeLength(code[i]) ) {
+      if ( code[i] == op ) n++;
+    }
+    return n;
+  }
+};
+
+/*---------------------------------------------------------------------------*/
+
+#ifdef PEEPHOLE_OPTIMIZER
+TEST_CASE("yaclox peephole - constant folding")
+{
+  Compiled compiled("var a = -(1 + 2) * 3 - 4 / 2;");
+  REQUIRE(compiled.code.size() == 6);
+  CHECK(compiled.code[0] == OP_CONSTANT);
+  CHECK(AS_NUMBER(compiled.constants[compiled.code[1]]) == -11);
+  CHECK(compiled.code[2] == OP_DEFINE_GLOBAL);
+  CHECK(compiled.code[4] == OP_NIL);
+  CHECK(compiled.code[5] == OP_RETURN);
+
+  Compiled comparison("var b = !(1 < 2);");
+  CHECK(comparison.code[0] == OP_FALSE);
+  CHECK(comparison.code[1] == OP_DEFINE_GLOBAL);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox peephole - fused instructions")
+{
+  Compiled local("{ var a = 1; var b = a + 2; }");
+  // OP_CONSTANT 0, then OP_GET_LOCAL 1 + OP_CONSTANT + OP_ADD in one
+  REQUIRE(local.code.size() >= 5);
+  CHECK(local.code[2] == OP_GET_LOCAL_CONSTANT_ADD);
+  CHECK(local.code[3] == 1);
+  CHECK(AS_NUMBER(local.constants[local.code[4]]) == 2);
+
+  Compiled branch("var x; if (!x) x = 1;");
+  // OP_NIL, OP_DEFINE_GLOBAL x, OP_GET_GLOBAL x, then the fused test
+  CHECK(branch.count(OP_NOT) == 0);
+  CHECK(branch.count(OP_JUMP_IF_TRUE) == 1);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox peephole - jumps and dead code")
+{
+  // The jump over the else branch would land on the loop's backward jump
+  Compiled loop("var i = 0; while (i < 3) { if (i == 1) i = 5; else i = i + 1; }");
+  CHECK(loop.count(OP_JUMP) == 0);
+  CHECK(loop.count(OP_LOOP) == 2);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox peephole - unreachable code")
+{
+  {
+    // Constant conditions: the else branch and everything after the
+    // infinite loop are never run
+    Compiled compiled("if (true) { print 1; } else { print 2; }"
+                      "while (true) {} print 3;");
+    CHECK(compiled.count(OP_PRINT) == 1);
+    CHECK(compiled.count(OP_RETURN) == 0);
+  }
+
+  Script script("var i = 0; var n = 0;"
+                "while (i < 10) { if (i == 1) i = i + 2; else i = i + 1;"
+                "  n = n + 1; }"
+                "fun f(x) { if (x) return 1; else return 2; print 3; }"
+                "var a = f(true); var b = f(nil);");
+  CHECK(script.result == INTERPRET_OK);
+  CHECK(script.number("n") == 9);
+  CHECK(script.number("a") == 1);
+  CHECK(script.number("b") == 2);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox peephole - superinstructions")
+{
+  {
+    Compiled compiled("{ var a = 1; var b = 2; var c = a + b;"
+                      "  while (a < 10) a = a + 1; print a; print b; }");
+    CHECK(compiled.count(OP_GET_LOCAL_GET_LOCAL_ADD) == 1);
+    CHECK(compiled.count(OP_GET_LOCAL_CONSTANT) == 1);
+    CHECK(compiled.count(OP_LESS_JUMP_IF_FALSE) == 1);
+    CHECK(compiled.count(OP_GET_LOCAL_CONSTANT_ADD) == 1);
+    CHECK(compiled.count(OP_SET_LOCAL_POP) == 1);
+    CHECK(compiled.count(OP_LESS) == 0);
+  }
+
+  const char* source = "var r; var s;"
+                       "{ var a = 0; var b = 3; var x = \"x\";"
+                       "  while (a < b) a = a + 1;"
+                       "  for (var i = 0; i < 4; i = i + 1) x = x + x;"
+                       "  r = a + b; s = x + \"!\"; }";
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    Script script(source, backend);
+    CHECK(script.result == INTERPRET_OK);
+    CHECK(script.number("r") == 6);
+    CHECK(script.string("s") == "xxxxxxxxxxxxxxxx!");
+  }
+
+  CHECK(Script("{ var a = 1; var b = nil; print a + b; }").result ==
+        INTERPRET_RUNTIME_ERROR);
+  CHECK(Script("{ var a = 1; var b = nil; if (a < b) print 1; }").result ==
+        INTERPRET_RUNTIME_ERROR);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox register backend - same results as the stack backend")
+{
+  const char* source =
+    "fun fib(n) { if (n < 2) return n; return fib(n - 2) + fib(n - 1); }"
+    "var f = fib(12);"
+    "var s = \"\";"
+    "for (var i = 0; i < 4; i = i + 1) { var t = s; s = t + \"ab\"; }"
+    "var r;"
+    "{ var a = 1; var b = a; a = a + 5; var c = a * b - 2; b = c = 7;"
+    "  r = a * 100 + b * 10 + c; }"
+    "var g = !(f > 100) or -f < 0 and f != 3;";
+
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    Script script(source, backend);
+    CHECK(script.result == INTERPRET_OK);
+    CHECK(script.number("f") == 144);
+    CHECK(script.string("s") == "abababab");
+    CHECK(script.number("r") == 677);
+    CHECK(AS_BOOL(script.global("g")) == true);
+  }
+
+  CHECK(Script("fun f(a) {} f();", BACKEND_REGISTER).result ==
+        INTERPRET_RUNTIME_ERROR);
+  CHECK(Script("var x = 1 + nil;", BACKEND_REGISTER).result ==
+        INTERPRET_RUNTIME_ERROR);
+  CHECK(Script("fun f(n) { return f(n + 1); } f(0);", BACKEND_REGISTER)
+          .result == INTERPRET_RUNTIME_ERROR);
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox register backend - fewer instructions")
+{
+  const char* source = "var total = 0;"
+                       "{ var n = 0; while (n < 100) { n = n + 1; } total = n; }";
+
+  uint64_t executed[2];
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    Script script(source, backend);
+    CHECK(script.number("total") == 100);
+    executed[backend] = vm.instructionCount;
+  }
+
+  CHECK(executed[BACKEND_REGISTER] < executed[BACKEND_STACK]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+// Compile a script into a bytecode image in the temporary directory
+struct Image
+{
+  std::string path;
+
+  Image(const char* source, Backend backend)
+    : path((std::filesystem::temp_directory_path() / "test_yaclox.yacb").string())
+  {
+    initVM();
+    vm.backend = backend;
+    ObjFunction* function = compile(source);
+    REQUIRE(function != nullptr);
+    CHECK(writeImage(function, path.c_str()));
+    freeVM();
+  }
+
+  ~Image() { std::filesystem::remove(path); }
+};
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox images - compile once, load and run")
+{
+  const char* source =
+    "fun makeAdder(n) { fun add(m) { return n + m; } return add; }"
+    "var add2 = makeAdder(2);"
+    "var x = add2(40); var s = \"ima\" + \"ge\"; var b = !nil;";
+
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    Image image(source, backend);
+    CHECK(isImage(image.path.c_str()));
+
+    Script script(image.path.c_str(), Script::FromImage{});
+    CHECK(script.result == INTERPRET_OK);
+    CHECK(script.number("x") == 42);
+    CHECK(script.string("s") == "image");
+    CHECK(AS_BOOL(script.global("b")) == true);
+    CHECK(AS_CLOSURE(script.global("add2"))->function->chunk.mapped);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox images - malformed images are rejected")
+{
+  Image image("fun f() { return \"s\"; } print f();", BACKEND_STACK);
+  const auto size = std::filesystem::file_size(image.path);
+
+  // Every truncation is caught while reading, before anything runs
+  for ( std::uintmax_t length = 4; length < size; length += 3 ) {
+    CAPTURE(length);
+    std::filesystem::resize_file(image.path, length);
+    initVM();
+    CHECK(loadImage(image.path.c_str()) == nullptr);
+    CHECK(vm.image == nullptr);
+    freeVM();
+  }
+
+  std::ofstream(image.path, std::ios::binary) << "YACL\x63\x00";
+  initVM();
+  CHECK(loadImage(image.path.c_str()) == nullptr);
+  freeVM();
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox images - code that fails verification is rejected")
+{
+  Image image("print 1;", BACKEND_STACK);
+
+  // Point the script's first constant load past the end of its constants
+  std::vector<char> bytes(std::filesystem::file_size(image.path));
+  const auto length = (std::streamsize)bytes.size();
+  std::ifstream(image.path, std::ios::binary).read(bytes.data(), length);
+  const char load[] = {OP_CONSTANT, 0, OP_PRINT};
+  auto at = std::search(bytes.begin(), bytes.end(), load, load + sizeof(load));
+  REQUIRE(at != bytes.end());
+  at[1] = 9;
+  std::ofstream(image.path, std::ios::binary).write(bytes.data(), length);
+
+  initVM();
+  CHECK(loadImage(image.path.c_str()) == nullptr);
+  CHECK(vm.image == nullptr);
+  freeVM();
+}
+
+/*---------------------------------------------------------------------------*/
+
+// A stack function assembled by hand, to feed the verifier what the compiler
+// never emits
+struct Bytecode
+{
+  ObjFunction* function;
+
+  Bytecode(std::initializer_list<uint8_t> code, int arity = 0)
+  {
+    initVM();
+    function = newFunction();
+    push(OBJ_VAL(function));
+    function->arity = arity;
+    addConstant(&function->chunk, NUMBER_VAL(1));
+    for ( uint8_t byte : code ) appendChunk(&function->chunk, byte, 1);
+  }
+
+  ~Bytecode() { freeVM(); }
+
+  bool verify() const { return verifyFunction(function); }
+};
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox verifier - compiled code passes")
+{
+  const char* source =
+    "fun fib(n) { if (n < 2) return n; return fib(n - 2) + fib(n - 1); }"
+    "fun makeCounter() { var i = 0; fun count() { i = i + 1; return i; }"
+    "  return count; }"
+    "var c = makeCounter(); c(); var x = fib(10) + c();";
+
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    Script script(source, backend);
+    CHECK(script.result == INTERPRET_OK);
+    CHECK(script.number("x") == 57);
+  }
+
+  // Three values deep on top of the function itself, plus room for addValues()
+  Bytecode add({OP_CONSTANT, 0, OP_CONSTANT, 0, OP_ADD, OP_RETURN});
+  CHECK(add.verify());
+  CHECK(add.function->chunk.frameSize == 5);
+
+  Bytecode argument({OP_GET_LOCAL, 1, OP_RETURN}, 1);
+  CHECK(argument.verify());
+
+  // "var b = a; print b;" fuses into a read of the local just pushed
+  Bytecode fused({OP_GET_LOCAL_GET_LOCAL, 0, 1, OP_POP, OP_RETURN});
+  CHECK(fused.verify());
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox verifier - malformed code is rejected")
+{
+  SUBCASE("constant out of range")
+  {
+    Bytecode bytecode({OP_CONSTANT, 1, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("global name that is not a string")
+  {
+    Bytecode bytecode({OP_GET_GLOBAL, 0, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("local out of range")
+  {
+    Bytecode bytecode({OP_GET_LOCAL, 1, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("fused local read past the one just pushed")
+  {
+    Bytecode bytecode({OP_GET_LOCAL_GET_LOCAL, 0, 2, OP_POP, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("upvalue the function does not have")
+  {
+    Bytecode bytecode({OP_GET_UPVALUE, 0, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("jump into the middle of an instruction")
+  {
+    Bytecode bytecode({OP_JUMP, 0, 1, OP_CONSTANT, 0, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("stack underflow")
+  {
+    Bytecode bytecode({OP_POP, OP_POP, OP_NIL, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("different stack depths where paths meet")
+  {
+    Bytecode bytecode({OP_FALSE, OP_JUMP_IF_FALSE, 0, 1, OP_NIL, OP_RETURN});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("falling off the end")
+  {
+    Bytecode bytecode({OP_NIL, OP_POP});
+    CHECK_FALSE(bytecode.verify());
+  }
+  SUBCASE("truncated instruction")
+  {
+    Bytecode bytecode({OP_NIL, OP_RETURN, OP_CONSTANT});
+    CHECK_FALSE(bytecode.verify());
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+#ifdef PROFILER
+TEST_CASE("yaclox profiler - hit counts per instruction")
+{
+  const char* source = "fun f(n) { return n + 1; }"
+                       "var x = 0;"
+                       "for (var i = 0; i < 10; i = i + 1) x = f(x);";
+
+  for ( Backend backend : {BACKEND_STACK, BACKEND_REGISTER} ) {
+    CAPTURE(backend);
+    initVM();
+    vm.backend = backend;
+    startProfiler();
+    CHECK(interpret(source) == INTERPRET_OK);
+    stopProfiler();
+
+    Value f = NIL_VAL;
+    tableGet(&vm.globals, copyString("f", 1), &f);
+    REQUIRE(IS_CLOSURE(f));
+    Chunk* chunk = &AS_CLOSURE(f)->function->chunk;
+    REQUIRE(chunk->profile != nullptr);
+
+    // The body is straight-line code: every instruction ran once per call
+    uint64_t hits = 0;
+    int instructions = 0;
+    for ( int offset = 0; offset < chunk->size; offset++ ) {
+      if ( chunk->profile[offset].hits == 0 ) continue;
+      CHECK(chunk->profile[offset].hits == 10);
+      hits += chunk->profile[offset].hits;
+      instructions++;
+    }
+    CHECK(instructions > 0);
+    CHECK(hits < vm.instructionCount);
+    freeVM();
+  }
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+#ifdef JIT
+static Chunk* globalChunk(const char* name)
+{
+  Value value = NIL_VAL;
+  int length = (int)std::char_traits<char>::length(name);
+  tableGet(&vm.globals, copyString(name, length), &value);
+  REQUIRE(IS_CLOSURE(value));
+  return &AS_CLOSURE(value)->function->chunk;
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox jit - hot functions run as machine code")
+{
+  const char* source =
+    "fun sum(n) { var t = 0; for (var i = 0; i < n; i = i + 1) t = t + i;"
+    "  return t; }"
+    "fun add(a, b) { return a + b; }"
+    "var x = sum(100);"
+    "var y = 0; for (var i = 0; i < 20; i = i + 1) y = add(y, i);"
+    "var s = add(\"a\", \"b\");";
+
+  initVM();
+  vm.jitThreshold = 10;
+  CHECK(interpret(source) == INTERPRET_OK);
+
+  // The loop made sum hot while it was running
+  Chunk* sum = globalChunk("sum");
+  REQUIRE(sum->jit != nullptr);
+  CHECK(sum->jit->deopts == 0);
+
+  // Strings fail the guard on the addition, the interpreter adds them
+  Chunk* add = globalChunk("add");
+  REQUIRE(add->jit != nullptr);
+  CHECK(add->jit->deopts == 1);
+
+  Value x = NIL_VAL, y = NIL_VAL, s = NIL_VAL;
+  tableGet(&vm.globals, copyString("x", 1), &x);
+  tableGet(&vm.globals, copyString("y", 1), &y);
+  tableGet(&vm.globals, copyString("s", 1), &s);
+  CHECK(AS_NUMBER(x) == 4950);
+  CHECK(AS_NUMBER(y) == 190);
+  CHECK(std::string(AS_CSTRING(s)) == "ab");
+  freeVM();
+}
+
+/*---------------------------------------------------------------------------*/
+
+TEST_CASE("yaclox jit - failing guards hand the function back")
+{
+  const char* source =
+    "fun add(a, b) { return a + b; }"
+    "var s = \"\"; for (var i = 0; i < 200; i = i + 1) s = add(s, \"x\");";
+
+  initVM();
+  vm.jitThreshold = 1;
+  CHECK(interpret(source) == INTERPRET_OK);
+
+  Chunk* add = globalChunk("add");
+  CHECK(add->jit == nullptr);
+  CHECK(add->hotness == -1);
+
+  Value s = NIL_VAL;
+  tableGet(&vm.globals, copyString("s", 1), &s);
+  CHECK(AS_STRING(s)->length == 200);
+  freeVM();
+}
+#endif